@@ -0,0 +1,126 @@
+#include "benchmark.hpp"
+#include "scePadHandle.hpp"
+#include "scePadSettings.hpp"
+#include "audioPassthrough.hpp"
+#include "controllerEmulation.hpp"
+#include "inputBridge.hpp"
+#include "latencyTracer.hpp"
+#include "udp.hpp"
+#include <duaLib.h>
+#include <cmath>
+
+// Defined in audioPassthrough.cpp, miniaudio calls them from its audio threads
+void captureDataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+void playbackDualsenseDataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+void playbackDualshock4DataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+
+#define AUDIO_PERIOD_FRAMES 480 // 10ms at 48kHz
+
+static s_ScePadData movingState(uint32_t step) {
+	s_ScePadData state = {};
+	state.bitmask_buttons = SCE_BM_L2 | ((step & 1) ? SCE_BM_CROSS : 0);
+	state.LeftStick.X = (uint8_t)(128 + 100 * std::sin(step * 0.01f));
+	state.LeftStick.Y = (uint8_t)(128 + 100 * std::cos(step * 0.01f));
+	state.RightStick.X = 128 + (step % 16);
+	state.RightStick.Y = 128 - (step % 16);
+	state.L2_Analog = (uint8_t)step;
+	state.R2_Analog = (uint8_t)(255 - step);
+	state.angularVelocity.x = (float)(step % 200) - 100.0f;
+	state.angularVelocity.z = 50.0f;
+	state.connected = true;
+	return state;
+}
+
+static void settingsBenchmarks(BenchmarkSuite& suite, AudioPassthrough& audio) {
+	s_scePadSettings settings = {};
+	suite.run("app/applySettings", [&] {
+		applySettings(0, settings, audio);
+	});
+
+	s_scePadSettings disco = {};
+	disco.discoMode = true;
+	disco.audioToLed = true;
+	suite.run("app/applySettings/discoMode", [&] {
+		applySettings(0, disco, audio);
+	});
+}
+
+static void emulationBenchmarks(BenchmarkSuite& suite) {
+	s_scePadSettings settings = {};
+	settings.leftStickDeadzone = 10;
+	settings.rightStickDeadzone = 10;
+	settings.leftTriggerThreshold = 20;
+	settings.gyroToRightStick = true;
+	settings.gyroToRightStickDeadzone = 4;
+
+	uint32_t step = 0;
+	suite.run("app/applyInputSettingsToScePadState", [&] {
+		s_ScePadData state = movingState(step++);
+		Vigem::applyInputSettingsToScePadState(settings, state);
+		keep(state);
+	});
+
+	suite.run("app/InputBridge::updateFromPs5", [&] {
+		InputBridge::instance().updateFromPs5(movingState(step++), 0);
+	});
+
+	// A new report every call, so every call lands in the histogram
+	uint64_t receivedAtUs = LatencyTracer::nowUs();
+	suite.run("app/LatencyTracer::record", [&] {
+		LatencyTracer::instance().record(LatencyStage::Xbox360, 0, receivedAtUs++);
+	});
+	LatencyTracer::instance().reset();
+}
+
+static void udpBenchmarks(BenchmarkSuite& suite) {
+	if (!suite.selected("app/dsxPacket")) return;
+
+	// Trigger effect, lightbar and trigger threshold, what a DSX mod typically sends every frame
+	static const char packet[] =
+		"{\"instructions\":["
+		"{\"type\":1,\"parameters\":[0,2,22,2,7,8]},"
+		"{\"type\":2,\"parameters\":[0,255,64,\"128\"]},"
+		"{\"type\":4,\"parameters\":[0,1,40]}"
+		"]}";
+
+	UDP udp;
+	suite.run("app/dsxPacket", [&] {
+		udp.handlePacket(packet);
+	});
+}
+
+static void audioBenchmarks(BenchmarkSuite& suite, AudioPassthrough& audio) {
+	if (!suite.selected("app/audio")) return;
+
+	// Only pUserData is looked at, a device that never got initialized is fine
+	ma_device device = {};
+	device.pUserData = &audio;
+
+	std::vector<float> captured(AUDIO_PERIOD_FRAMES * 2);
+	for (size_t i = 0; i < captured.size(); i++)
+		captured[i] = std::sin(i * 0.05f) * 0.5f;
+	std::vector<float> dualsenseOutput(AUDIO_PERIOD_FRAMES * 4);
+	std::vector<float> dualshock4Output(AUDIO_PERIOD_FRAMES * 2);
+
+	// One capture period followed by the playback that consumes it, like the audio threads do
+	suite.run("app/audio/dualsensePassthrough", [&] {
+		captureDataCallback(&device, nullptr, captured.data(), AUDIO_PERIOD_FRAMES);
+		playbackDualsenseDataCallback(&device, dualsenseOutput.data(), nullptr, AUDIO_PERIOD_FRAMES);
+		keep(dualsenseOutput[0]);
+	});
+
+	suite.run("app/audio/dualshock4Passthrough", [&] {
+		captureDataCallback(&device, nullptr, captured.data(), AUDIO_PERIOD_FRAMES);
+		playbackDualshock4DataCallback(&device, dualshock4Output.data(), nullptr, AUDIO_PERIOD_FRAMES);
+		keep(dualshock4Output[0]);
+	});
+}
+
+void runAppBenchmarks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	AudioPassthrough audio;
+
+	settingsBenchmarks(suite, audio);
+	emulationBenchmarks(suite);
+	udpBenchmarks(suite);
+	audioBenchmarks(suite, audio);
+}
@@ -0,0 +1,75 @@
+#include "benchmark.hpp"
+#include <algorithm>
+#include <numeric>
+
+BenchmarkSuite::BenchmarkSuite(const std::string& filter, std::chrono::nanoseconds minBatchTime) : m_filter(filter), m_minBatchTime(minBatchTime) {}
+
+bool BenchmarkSuite::selected(const std::string& name) const {
+	return m_filter.empty() || name.find(m_filter) != std::string::npos;
+}
+
+void BenchmarkSuite::report(const std::string& name, const std::string& unit, uint64_t iterations, std::vector<double> samples, nlohmann::json extra) {
+	BenchmarkResult result = {};
+	result.name = name;
+	result.unit = unit;
+	result.iterations = iterations;
+	result.extra = std::move(extra);
+
+	if (!samples.empty()) {
+		std::sort(samples.begin(), samples.end());
+		result.median = samples[samples.size() / 2];
+		result.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+		result.min = samples.front();
+		result.max = samples.back();
+	}
+
+	printf("%-48s %12.2f %-10s (min %.2f, max %.2f)\n", result.name.c_str(), result.median, result.unit.c_str(), result.min, result.max);
+	m_results.push_back(std::move(result));
+}
+
+const std::vector<BenchmarkResult>& BenchmarkSuite::results() const {
+	return m_results;
+}
+
+nlohmann::json BenchmarkSuite::toJson() const {
+	nlohmann::json results = nlohmann::json::array();
+
+	for (const BenchmarkResult& result : m_results) {
+		results.push_back({
+			{"name", result.name},
+			{"unit", result.unit},
+			{"iterations", result.iterations},
+			{"median", result.median},
+			{"mean", result.mean},
+			{"min", result.min},
+			{"max", result.max},
+			{"extra", result.extra},
+		});
+	}
+
+	return results;
+}
+
+void BenchmarkSuite::check(const std::string& name, bool passed, const std::string& detail) {
+	if (passed) printf("%-48s %12s\n", name.c_str(), "ok");
+	else printf("%-48s %12s %s\n", name.c_str(), "FAILED", detail.c_str());
+	m_checks.push_back({ name, passed, passed ? std::string() : detail });
+}
+
+int BenchmarkSuite::failedChecks() const {
+	return (int)std::count_if(m_checks.begin(), m_checks.end(), [](const CheckResult& check) { return !check.passed; });
+}
+
+nlohmann::json BenchmarkSuite::checksToJson() const {
+	nlohmann::json checks = nlohmann::json::array();
+
+	for (const CheckResult& check : m_checks) {
+		checks.push_back({
+			{"name", check.name},
+			{"passed", check.passed},
+			{"detail", check.detail},
+		});
+	}
+
+	return checks;
+}
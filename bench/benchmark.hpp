@@ -0,0 +1,104 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <simulatedTransport.h>
+
+#define BENCHMARK_SAMPLES 7
+
+// Keeps the compiler from optimizing away a result nobody looks at
+template <typename T>
+inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static const volatile void* sink;
+	sink = &value;
+#endif
+}
+
+struct BenchmarkResult {
+	std::string name;
+	std::string unit;
+	uint64_t iterations = 0;
+	double median = 0;
+	double mean = 0;
+	double min = 0;
+	double max = 0;
+	nlohmann::json extra = nlohmann::json::object(); // Anything else a macro benchmark measured
+};
+
+struct CheckResult {
+	std::string name;
+	bool passed = false;
+	std::string detail; // What went wrong, empty when it passed
+};
+
+class BenchmarkSuite {
+private:
+	std::string m_filter;
+	std::chrono::nanoseconds m_minBatchTime;
+	std::vector<BenchmarkResult> m_results;
+	std::vector<CheckResult> m_checks;
+
+	template <typename F>
+	std::chrono::nanoseconds timeBatch(F& fn, uint64_t count) {
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < count; i++)
+			fn();
+		return std::chrono::steady_clock::now() - start;
+	}
+
+public:
+	BenchmarkSuite(const std::string& filter, std::chrono::nanoseconds minBatchTime);
+
+	bool selected(const std::string& name) const;
+	// Summarizes per operation samples in the given unit
+	void report(const std::string& name, const std::string& unit, uint64_t iterations, std::vector<double> samples, nlohmann::json extra = nlohmann::json::object());
+	const std::vector<BenchmarkResult>& results() const;
+	nlohmann::json toJson() const;
+
+	// Records a correctness check, any failed one makes the bench exit with 1
+	void check(const std::string& name, bool passed, const std::string& detail = "");
+	int failedChecks() const;
+	nlohmann::json checksToJson() const;
+
+	// Runs fn in batches that take at least the minimum batch time and reports ns per call
+	template <typename F>
+	void run(const std::string& name, F fn) {
+		if (!selected(name)) return;
+
+		uint64_t batch = 1;
+		fn(); // Warm up caches and first use initialization
+
+		while (batch < (1ull << 32)) {
+			auto elapsed = timeBatch(fn, batch);
+			if (elapsed >= m_minBatchTime) break;
+			batch *= elapsed * 10 < m_minBatchTime ? 10 : 2;
+		}
+
+		std::vector<double> samples;
+		for (int i = 0; i < BENCHMARK_SAMPLES; i++)
+			samples.push_back((double)timeBatch(fn, batch).count() / (double)batch);
+
+		report(name, "ns/op", batch * BENCHMARK_SAMPLES, samples);
+	}
+};
+
+// duaLib running on simulated controllers, the first CONTROLLER_COUNT opened one per user ID
+struct BenchmarkEnvironment {
+	simulatedTransport transport;
+	std::vector<simulatedDeviceConfig> devices; // What every simulated device got added with
+	std::chrono::milliseconds window{2000};    // How long macro benchmarks measure
+};
+
+// Correctness checks that need the same setup, reported through BenchmarkSuite::check
+void runDuaLibChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment);
+void runDuaLibBenchmarks(BenchmarkSuite& suite, BenchmarkEnvironment& environment);
+void runAppBenchmarks(BenchmarkSuite& suite, BenchmarkEnvironment& environment);
+
+#endif
@@ -0,0 +1,336 @@
+#include "benchmark.hpp"
+#include "scePadHandle.hpp"
+#include <duaLib.h>
+#include "legacyDecoder.hpp"
+#include <crc.h>
+#include <inputDecoder.h>
+#include <triggerFactory.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#define SWEEP_IDLE_REPORT_RATE_HZ 10 // What controllers left out of a sweep step still send
+#define SWEEP_WARMUP_MS 250           // Longer than an idle report interval so every device is back at full rate
+
+static uint64_t steadyMicroseconds() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+	if (values.empty()) return 0;
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+}
+
+static void apiBenchmarks(BenchmarkSuite& suite) {
+	s_ScePadData state = {};
+	suite.run("duaLib/scePadReadState", [&] {
+		scePadReadState(g_scePad[0], &state);
+		keep(state);
+	});
+
+	// What scePadReadStateMulti replaces, one call per handle
+	s_ScePadData states[CONTROLLER_COUNT] = {};
+	suite.run("duaLib/scePadReadState(every handle)", [&] {
+		for (int i = 0; i < CONTROLLER_COUNT; i++)
+			scePadReadState(g_scePad[i], &states[i]);
+		keep(states);
+	});
+
+	uint32_t validMask = 0;
+	suite.run("duaLib/scePadReadStateMulti", [&] {
+		scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), states, CONTROLLER_COUNT, &validMask, nullptr);
+		keep(states);
+	});
+
+	s_ScePadRawState raw = {};
+	suite.run("duaLib/scePadGetRawState", [&] {
+		scePadGetRawState(g_scePad[0], &raw);
+		keep(raw);
+	});
+}
+
+static void crcBenchmarks(BenchmarkSuite& suite) {
+	// Bluetooth output report with its 0xA2 prefix, the CRC covers everything but the last 4 bytes
+	unsigned char report[79] = { 0xA2, 0x31 };
+	for (size_t i = 2; i < sizeof(report); i++)
+		report[i] = (unsigned char)(i * 37);
+
+	suite.run("crc/compute", [&] {
+		keep(compute(report, sizeof(report) - 4));
+	});
+	suite.run("crc/computeWithPrefix", [&] {
+		keep(computeWithPrefix(0xA1, report + 1, sizeof(report) - 5));
+	});
+	suite.run("crc/computeBytewise", [&] {
+		keep(computeBytewise(report, sizeof(report) - 4));
+	});
+}
+
+// One report with a bit of everything going on: D-pad north east, cross and L1 held, one finger on the touchpad
+template <typename T>
+static T decodeSample() {
+	T input = {};
+	input.LeftStickX = 140;
+	input.LeftStickY = 90;
+	input.RightStickX = 128;
+	input.RightStickY = 200;
+	input.TriggerLeft = 30;
+	input.TriggerRight = 255;
+	input.DPad = Direction::NorthEast;
+	input.ButtonCross = 1;
+	input.ButtonL1 = 1;
+	input.ButtonR2 = 1;
+	return input;
+}
+
+// The field by field decoder the reader used before against the table driven one it uses now, both
+// without the motion values which come from the calibration now and aren't part of the report decode
+static void decodeBenchmarks(BenchmarkSuite& suite) {
+	dualsenseData::USBGetStateData dualsense = decodeSample<dualsenseData::USBGetStateData>();
+	dualsense.touchData.Finger[0].FingerX = 900;
+	dualsense.touchData.Finger[0].FingerY = 500;
+	dualsense.touchData.Finger[1].NotTouching = 1;
+
+	dualshock4Data::USBGetStateData dualshock4 = decodeSample<dualshock4Data::USBGetStateData>();
+	dualshock4.Finger1X = 900;
+	dualshock4.Finger1Y = 500;
+	dualshock4.Finger2Active = 1;
+
+	s_ScePadData data = {};
+
+	suite.run("decode/DualSense fieldByField", [&] {
+		keep(dualsense);
+		data = {};
+		legacyDecode(dualsense, false, false, true, &data);
+		keep(data);
+	});
+	suite.run("decode/DualSense table", [&] {
+		keep(dualsense);
+		data = {};
+		decodeReport(dualsense, data);
+		keep(data);
+	});
+	suite.run("decode/DualShock4 fieldByField", [&] {
+		keep(dualshock4);
+		data = {};
+		legacyDecode(dualshock4, false, false, true, &data);
+		keep(data);
+	});
+	suite.run("decode/DualShock4 table", [&] {
+		keep(dualshock4);
+		data = {};
+		decodeReport(dualshock4, data);
+		keep(data);
+	});
+}
+
+static void triggerEffectBenchmarks(BenchmarkSuite& suite) {
+	uint8_t forces[11] = {};
+	uint8_t strengths[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 8, 8 };
+	uint8_t step = 0;
+
+	// Parameters change every call so nothing gets folded away
+	suite.run("triggerEffect/Feedback", [&] {
+		keep(TriggerEffectGenerator::Feedback(forces, 0, step++ % 10, 8));
+		keep(forces);
+	});
+	suite.run("triggerEffect/Weapon", [&] {
+		keep(TriggerEffectGenerator::Weapon(forces, 0, 2 + step++ % 5, 8, 8));
+		keep(forces);
+	});
+	suite.run("triggerEffect/Vibration", [&] {
+		keep(TriggerEffectGenerator::Vibration(forces, 0, step++ % 10, 8, 30));
+		keep(forces);
+	});
+	suite.run("triggerEffect/MultiplePositionFeedback", [&] {
+		step++;
+		strengths[step % 10] = step % 9;
+		keep(TriggerEffectGenerator::MultiplePositionFeedback(forces, 0, strengths));
+		keep(forces);
+	});
+	suite.run("triggerEffect/SlopeFeedback", [&] {
+		keep(TriggerEffectGenerator::SlopeFeedback(forces, 0, step++ % 5, 9, 1, 8));
+		keep(forces);
+	});
+	suite.run("triggerEffect/MultiplePositionVibration", [&] {
+		step++;
+		strengths[step % 10] = step % 9;
+		keep(TriggerEffectGenerator::MultiplePositionVibration(forces, 0, 30, strengths));
+		keep(forces);
+	});
+	suite.run("triggerEffect/Galloping", [&] {
+		keep(TriggerEffectGenerator::Galloping(forces, 0, step++ % 4, 9, 2, 4, 20));
+		keep(forces);
+	});
+	suite.run("triggerEffect/Machine", [&] {
+		keep(TriggerEffectGenerator::Machine(forces, 0, step++ % 4, 9, 3, 5, 20, 10));
+		keep(forces);
+	});
+}
+
+static uint64_t totalReportsRead() {
+	uint64_t total = 0;
+	for (int i = 0; i < CONTROLLER_COUNT; i++) {
+		s_ScePadIoStatistics stats = {};
+		if (scePadGetIoStatistics(g_scePad[i], &stats) == SCE_OK) total += stats.reportsRead;
+	}
+	return total;
+}
+
+static uint64_t totalReportsSent(BenchmarkEnvironment& environment) {
+	uint64_t total = 0;
+	for (int i = 0; i < (int)environment.devices.size(); i++)
+		total += environment.transport.reportsSent(i);
+	return total;
+}
+
+// Full reader loop: transport read, decode, motion and fusion, history, publishing
+static void readerBenchmarks(BenchmarkSuite& suite, BenchmarkEnvironment& environment, std::chrono::milliseconds window) {
+	if (suite.selected("reader/delivery")) {
+		uint64_t readBefore = totalReportsRead();
+		uint64_t sentBefore = totalReportsSent(environment);
+		std::this_thread::sleep_for(window);
+		uint64_t read = totalReportsRead() - readBefore;
+		uint64_t sent = totalReportsSent(environment) - sentBefore;
+
+		suite.report("reader/delivery", "%", read, { sent ? 100.0 * read / sent : 0.0 }, {
+			{"reportsRead", read},
+			{"reportsSent", sent},
+			{"reportsPerSecond", read * 1000.0 / window.count()},
+		});
+	}
+
+	if (suite.selected("reader/sampleAge")) {
+		// How old the newest published report is when someone looks, at the simulated report rates
+		std::vector<double> ages;
+		auto end = std::chrono::steady_clock::now() + window;
+
+		while (std::chrono::steady_clock::now() < end) {
+			for (int i = 0; i < CONTROLLER_COUNT; i++) {
+				s_ScePadRawState raw = {};
+				uint64_t now = steadyMicroseconds();
+				if (scePadGetRawState(g_scePad[i], &raw) == SCE_OK && raw.size > 0 && now >= raw.receivedAtUs)
+					ages.push_back((double)(now - raw.receivedAtUs));
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(300));
+		}
+
+		suite.report("reader/sampleAge", "us", ages.size(), ages, {
+			{"p90", percentile(ages, 0.90)},
+			{"p99", percentile(ages, 0.99)},
+			{"p999", percentile(ages, 0.999)},
+		});
+	}
+
+	if (suite.selected("reader/saturated")) {
+		// Every device sends as fast as it gets read, so the readers themselves are the bottleneck
+		for (int i = 0; i < (int)environment.devices.size(); i++)
+			environment.transport.setReportRate(i, 1000000);
+
+		std::vector<double> perController;
+		std::vector<uint64_t> before(CONTROLLER_COUNT);
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
+			s_ScePadIoStatistics stats = {};
+			scePadGetIoStatistics(g_scePad[i], &stats);
+			before[i] = stats.reportsRead;
+		}
+
+		std::this_thread::sleep_for(window);
+
+		uint64_t total = 0;
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
+			s_ScePadIoStatistics stats = {};
+			scePadGetIoStatistics(g_scePad[i], &stats);
+			total += stats.reportsRead - before[i];
+			perController.push_back((stats.reportsRead - before[i]) * 1000.0 / window.count());
+		}
+
+		for (int i = 0; i < (int)environment.devices.size(); i++)
+			environment.transport.setReportRate(i, environment.devices[i].reportRateHz);
+
+		suite.report("reader/saturated", "reports/s", total, perController, {
+			{"totalReportsPerSecond", total * 1000.0 / window.count()},
+			{"hardwareThreads", std::thread::hardware_concurrency()},
+		});
+	}
+}
+
+// How long every report waits between the simulated device having it ready and a reader picking it up,
+// with 1, 2, 4... controllers open. The devices setupEnvironment left unplugged get plugged in for the sweep,
+// the watcher puts them into slots in its own order so whatever gets read counts as open.
+static void readerLatencySweep(BenchmarkSuite& suite, BenchmarkEnvironment& environment, std::chrono::milliseconds window) {
+	int available = std::min((int)environment.devices.size(), SCE_PAD_MAX_CONTROLLER_COUNT);
+	std::vector<int> handles(available, 0);
+	for (int i = 0; i < CONTROLLER_COUNT; i++)
+		handles[i] = g_scePad[i];
+
+	bool plugged = false;
+	for (int count = 1; count <= available; count *= 2) {
+		std::string name = "reader/p99Latency/" + std::to_string(count) + " devices";
+		if (!suite.selected(name)) continue;
+
+		if (count > CONTROLLER_COUNT && !plugged) {
+			for (int i = CONTROLLER_COUNT; i < available; i++)
+				environment.transport.setConnected(i, true);
+			plugged = true;
+		}
+
+		// Open slots beyond CONTROLLER_COUNT only fill up once the watcher found their device
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		for (int i = CONTROLLER_COUNT; i < count; i++) {
+			if (handles[i] <= 0) handles[i] = scePadOpen(i + 1, 0, 0);
+
+			s_ScePadData state = {};
+			while ((scePadReadState(handles[i], &state) != SCE_OK || !state.connected) && std::chrono::steady_clock::now() < deadline)
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		// The always open controllers that aren't part of this step only trickle
+		for (int i = 0; i < CONTROLLER_COUNT; i++)
+			environment.transport.setReportRate(i, i < count ? environment.devices[i].reportRateHz : SWEEP_IDLE_REPORT_RATE_HZ);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(SWEEP_WARMUP_MS));
+		for (int i = 0; i < available; i++)
+			environment.transport.takeReadDelays(i);
+
+		std::this_thread::sleep_for(window);
+
+		std::vector<double> delays;
+		std::vector<double> perDevice;
+		for (int i = 0; i < available; i++) {
+			std::vector<uint32_t> taken = environment.transport.takeReadDelays(i);
+			if (taken.empty() || (i < CONTROLLER_COUNT && i >= count)) continue;
+
+			std::vector<double> device(taken.begin(), taken.end());
+			perDevice.push_back(percentile(device, 0.99));
+			delays.insert(delays.end(), device.begin(), device.end());
+		}
+
+		// The per device p99s are what gets summarized, the pooled percentiles go along
+		suite.report(name, "us", delays.size(), perDevice, {
+			{"devices", perDevice.size()},
+			{"p50", percentile(delays, 0.50)},
+			{"p99", percentile(delays, 0.99)},
+			{"p999", percentile(delays, 0.999)},
+		});
+	}
+
+	for (int i = CONTROLLER_COUNT; i < available; i++) {
+		if (handles[i] > 0) scePadClose(handles[i]);
+		environment.transport.setConnected(i, false);
+	}
+
+	for (int i = 0; i < CONTROLLER_COUNT; i++)
+		environment.transport.setReportRate(i, environment.devices[i].reportRateHz);
+	std::this_thread::sleep_for(std::chrono::milliseconds(SWEEP_WARMUP_MS));
+}
+
+void runDuaLibBenchmarks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	apiBenchmarks(suite);
+	crcBenchmarks(suite);
+	decodeBenchmarks(suite);
+	triggerEffectBenchmarks(suite);
+	readerBenchmarks(suite, environment, environment.window);
+	readerLatencySweep(suite, environment, environment.window);
+}
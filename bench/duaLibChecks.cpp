@@ -0,0 +1,512 @@
+#include "benchmark.hpp"
+#include "scePadHandle.hpp"
+#include "legacyDecoder.hpp"
+#include <duaLib.h>
+#include <crc.h>
+#include <inputDecoder.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+
+#define CRC_CHECK_MAX_LENGTH 320 // Five of the PCLMUL path's 64 byte folds plus leftovers
+#define CRC_CHECK_ALIGNMENTS 64
+#define DECODE_CHECK_REPORTS 200000
+#define TORN_READ_CHECK_THREADS 3
+#define COALESCE_CHECK_ROUNDS 50
+#define HISTORY_CHECK_REPORTS 300
+#define HISTORY_CHECK_READERS 3
+#define HISTORY_CHECK_SHARED_REPORTS 4000
+#define HISTORY_CHECK_SHARED_RATE_HZ 8000
+
+static bool isDualshock4(const simulatedDeviceConfig& config) {
+	return config.productID == 0x05c4 || config.productID == 0x09cc;
+}
+
+// Sticks and triggers all set to value, the rest left at rest
+static void setSimulatedInput(BenchmarkEnvironment& environment, int device, uint8_t value) {
+	if (isDualshock4(environment.devices[device])) {
+		dualshock4Data::USBGetStateData state = {};
+		state.LeftStickX = state.LeftStickY = state.RightStickX = state.RightStickY = value;
+		state.TriggerLeft = state.TriggerRight = value;
+		environment.transport.setInput(device, state);
+	}
+	else {
+		dualsenseData::USBGetStateData state = {};
+		state.LeftStickX = state.LeftStickY = state.RightStickX = state.RightStickY = value;
+		state.TriggerLeft = state.TriggerRight = value;
+		environment.transport.setInput(device, state);
+	}
+}
+
+// Waits until every controller published a report with its input from setSimulatedInput
+static bool waitForInput(const uint8_t* values, std::chrono::milliseconds timeout) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	while (std::chrono::steady_clock::now() < deadline) {
+		int matching = 0;
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
+			s_ScePadData state = {};
+			if (scePadReadState(g_scePad[i], &state) == SCE_OK && state.LeftStick.X == values[i]) matching++;
+		}
+
+		if (matching == CONTROLLER_COUNT) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// Every fast CRC path against the bytewise reference for every length up to CRC_CHECK_MAX_LENGTH at
+// every start offset within a cache line, with the output report seed and the DS4 input report seed
+static void crcChecks(BenchmarkSuite& suite) {
+	if (!suite.selected("check/crc")) return;
+
+	struct crcSeedCase { const char* name; unsigned char prefix; };
+	const crcSeedCase seeds[] = { { "DualSense BT output", 0xA2 }, { "DS4 input", 0xA1 } };
+
+	std::vector<unsigned char> buffer(CRC_CHECK_MAX_LENGTH + CRC_CHECK_ALIGNMENTS);
+	std::mt19937 random(14);
+	for (unsigned char& byte : buffer)
+		byte = (unsigned char)random();
+
+	uint64_t compared = 0;
+	uint64_t mismatches = 0;
+	std::string failure;
+
+	auto expect = [&](const char* path, const char* seed, size_t length, size_t alignment, uint32_t expected, uint32_t actual) {
+		compared++;
+		if (expected == actual) return;
+
+		if (mismatches++ == 0) {
+			char detail[160] = {};
+			std::snprintf(detail, sizeof(detail), "%s, %s seed, length %zu at offset %zu: 0x%08" PRIx32 " instead of 0x%08" PRIx32,
+				path, seed, length, alignment, actual, expected);
+			failure = detail;
+		}
+	};
+
+	if (hashTable[0xA2] != crcSeed) {
+		mismatches++;
+		failure = "crcSeed isn't hashTable[0xA2]";
+	}
+
+	for (const crcSeedCase& seed : seeds) {
+		uint32_t state = hashTable[seed.prefix];
+
+		for (size_t alignment = 0; alignment < CRC_CHECK_ALIGNMENTS; alignment++) {
+			for (size_t length = 0; length <= CRC_CHECK_MAX_LENGTH; length++) {
+				unsigned char* data = buffer.data() + alignment;
+				uint32_t expected = computeBytewise(data, length, state);
+
+				expect("computeSliceBy8", seed.name, length, alignment, expected, computeSliceBy8(data, length, state));
+				expect("computePclmul", seed.name, length, alignment, expected, computePclmul(data, length, state));
+				expect("computeWithPrefix", seed.name, length, alignment, expected, computeWithPrefix(seed.prefix, data, length));
+				if (state == crcSeed)
+					expect("compute", seed.name, length, alignment, expected, compute(data, length));
+			}
+		}
+	}
+
+	if (mismatches > 0)
+		failure = std::to_string(mismatches) + " of " + std::to_string(compared) + " differ, first: " + failure;
+	else if (!crcPclmulSupported())
+		printf("No PCLMULQDQ on this CPU, computePclmul only checked its slice-by-8 fallback\n");
+
+	suite.check("check/crc", mismatches == 0, failure);
+}
+
+static bool sameReportFields(const s_ScePadData& a, const s_ScePadData& b) {
+	if (a.bitmask_buttons != b.bitmask_buttons || a.timestamp != b.timestamp) return false;
+	if (a.LeftStick.X != b.LeftStick.X || a.LeftStick.Y != b.LeftStick.Y || a.RightStick.X != b.RightStick.X || a.RightStick.Y != b.RightStick.Y) return false;
+	if (a.L2_Analog != b.L2_Analog || a.R2_Analog != b.R2_Analog || a.touchData.touchNum != b.touchData.touchNum) return false;
+
+	for (int i = 0; i < 2; i++) {
+		const auto& left = a.touchData.touch[i];
+		const auto& right = b.touchData.touch[i];
+		if (left.id != right.id || left.x != right.x || left.y != right.y || left.reserve[0] != right.reserve[0]) return false;
+	}
+	return true;
+}
+
+// The table driven decoder against the field by field one it replaced, on random reports so every
+// button byte value and D-pad direction comes up
+template <typename T>
+static void decodeCheck(BenchmarkSuite& suite, const char* name) {
+	std::string check = std::string("check/decode ") + name;
+	if (!suite.selected(check)) return;
+
+	std::mt19937 random(13);
+	uint64_t mismatches = 0;
+	std::string failure;
+
+	for (int i = 0; i < DECODE_CHECK_REPORTS; i++) {
+		T input = {};
+		uint8_t* bytes = reinterpret_cast<uint8_t*>(&input);
+		for (size_t j = 0; j < sizeof(input); j++)
+			bytes[j] = (uint8_t)random();
+
+		s_ScePadData expected = {};
+		s_ScePadData actual = {};
+		legacyDecode(input, false, false, true, &expected);
+		decodeReport(input, actual);
+
+		if (!sameReportFields(expected, actual) && mismatches++ == 0) {
+			char detail[96] = {};
+			std::snprintf(detail, sizeof(detail), "report %d, buttons 0x%08" PRIx32 " instead of 0x%08" PRIx32, i, actual.bitmask_buttons, expected.bitmask_buttons);
+			failure = detail;
+		}
+	}
+
+	if (mismatches > 0)
+		failure = std::to_string(mismatches) + " of " + std::to_string(DECODE_CHECK_REPORTS) + " differ, first: " + failure;
+	suite.check(check, mismatches == 0, failure);
+}
+
+static void readStateMultiChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/scePadReadStateMulti")) return;
+
+	// Different input on every controller so a mixed up slot shows
+	uint8_t values[CONTROLLER_COUNT] = {};
+	for (int i = 0; i < CONTROLLER_COUNT; i++) {
+		values[i] = (uint8_t)(17 + i * 13);
+		setSimulatedInput(environment, i, values[i]);
+	}
+
+	std::string failure;
+	if (!waitForInput(values, std::chrono::seconds(1))) failure = "simulated input never showed up";
+
+	s_ScePadData states[CONTROLLER_COUNT] = {};
+	uint32_t validMask = 0;
+	if (failure.empty() && scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), states, CONTROLLER_COUNT, &validMask, nullptr) != SCE_OK)
+		failure = "scePadReadStateMulti failed";
+
+	for (int i = 0; i < CONTROLLER_COUNT && failure.empty(); i++) {
+		s_ScePadData single = {};
+		scePadReadState(g_scePad[i], &single);
+
+		if (!(validMask & (1u << i))) failure = "handle " + std::to_string(i) + " missing from validMask";
+		else if (states[i].LeftStick.X != values[i] || states[i].RightStick.Y != values[i] || states[i].R2_Analog != values[i])
+			failure = "handle " + std::to_string(i) + " got another controller's input";
+		else if (states[i].bitmask_buttons != single.bitmask_buttons || states[i].connected != single.connected)
+			failure = "handle " + std::to_string(i) + " differs from scePadReadState";
+	}
+
+	suite.check("check/scePadReadStateMulti", failure.empty(), failure);
+}
+
+// Sticks and triggers always move together in setSimulatedInput, so a snapshot where they disagree was
+// torn between two reports. Readers hammer every way of getting input out while the simulated devices keep
+// changing it and a setter keeps the slot locks and the writer busy.
+static void tornReadChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/torn reads")) return;
+
+	std::atomic<bool> running = true;
+	std::atomic<uint64_t> snapshots = 0;
+	std::atomic<uint64_t> torn = 0;
+	std::atomic<uint64_t> backwards = 0;
+
+	auto consistent = [](const s_ScePadData& state) {
+		uint8_t value = state.LeftStick.X;
+		return state.LeftStick.Y == value && state.RightStick.X == value && state.RightStick.Y == value &&
+			state.L2_Analog == value && state.R2_Analog == value;
+	};
+
+	std::vector<std::thread> threads;
+	threads.emplace_back([&] {
+		uint8_t value = 0;
+		while (running) {
+			value = (uint8_t)(value + 1);
+			for (int i = 0; i < CONTROLLER_COUNT; i++)
+				setSimulatedInput(environment, i, value);
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+
+	threads.emplace_back([&] {
+		uint8_t value = 0;
+		while (running) {
+			value = (uint8_t)(value + 1);
+			s_SceLightBar color = { value, value, value };
+			for (int i = 0; i < CONTROLLER_COUNT; i++)
+				scePadSetLightBar(g_scePad[i], &color);
+		}
+	});
+
+	for (int t = 0; t < TORN_READ_CHECK_THREADS; t++) {
+		threads.emplace_back([&, t] {
+			uint64_t lastReceived[CONTROLLER_COUNT] = {};
+
+			auto inspect = [&](int i, const s_ScePadData& state, uint64_t receivedAtUs) {
+				snapshots.fetch_add(1, std::memory_order_relaxed);
+				if (!consistent(state)) torn.fetch_add(1, std::memory_order_relaxed);
+				if (receivedAtUs < lastReceived[i]) backwards.fetch_add(1, std::memory_order_relaxed);
+				lastReceived[i] = receivedAtUs;
+			};
+
+			while (running) {
+				if (t == 0) {
+					s_ScePadData states[CONTROLLER_COUNT] = {};
+					uint64_t receivedAtUs[CONTROLLER_COUNT] = {};
+					uint32_t validMask = 0;
+					scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), states, CONTROLLER_COUNT, &validMask, receivedAtUs);
+
+					for (int i = 0; i < CONTROLLER_COUNT; i++) {
+						if (validMask & (1u << i)) inspect(i, states[i], receivedAtUs[i]);
+					}
+				}
+				else {
+					for (int i = 0; i < CONTROLLER_COUNT; i++) {
+						s_ScePadData state = {};
+						uint64_t receivedAtUs = 0;
+						if (scePadReadStateTimed(g_scePad[i], &state, &receivedAtUs) == SCE_OK) inspect(i, state, receivedAtUs);
+					}
+				}
+			}
+		});
+	}
+
+	std::this_thread::sleep_for(environment.window);
+	running = false;
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::string failure;
+	if (snapshots == 0) failure = "no snapshot could be read";
+	else if (torn > 0) failure = std::to_string(torn.load()) + " of " + std::to_string(snapshots.load()) + " snapshots were torn";
+	else if (backwards > 0) failure = std::to_string(backwards.load()) + " snapshots went back in time";
+
+	suite.check("check/torn reads", failure.empty(), failure);
+}
+
+// Bluetooth output reports get their CRC from the writer right before they go out, every one of them has to
+// carry the right one for the report it ended up being
+static void outputCrcChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/output CRC")) return;
+
+	for (int i = 0; i < CONTROLLER_COUNT; i++)
+		environment.transport.takeOutputReports(i);
+
+	for (uint8_t value = 1; value <= 32; value++) {
+		s_SceLightBar color = { value, (uint8_t)(255 - value), value };
+		for (int i = 0; i < CONTROLLER_COUNT; i++)
+			scePadSetLightBar(g_scePad[i], &color);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	uint64_t checked = 0;
+	std::string failure;
+	for (int i = 0; i < CONTROLLER_COUNT && failure.empty(); i++) {
+		if (environment.devices[i].busType != 2) continue;
+
+		for (const capturedReport& report : environment.transport.takeOutputReports(i)) {
+			if (report.feature || report.data.size() < 5) continue;
+
+			uint32_t expected = computeWithPrefix(0xA2, report.data.data(), report.data.size() - 4);
+			uint32_t actual = 0;
+			std::memcpy(&actual, report.data.data() + report.data.size() - 4, sizeof(actual));
+			checked++;
+
+			if (actual != expected) {
+				failure = "device " + std::to_string(i) + " sent a report with a wrong CRC";
+				break;
+			}
+		}
+	}
+
+	if (failure.empty() && checked == 0) failure = "no Bluetooth output report was written";
+	suite.check("check/output CRC", failure.empty(), failure);
+}
+
+// Unplugs a controller until its slot is lost and plugs it back in, the slot's old handle has to be closed
+// by then instead of leaking with every replug
+static void replugChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/replug closes handles")) return;
+
+	auto linkState = [] {
+		s_ScePadIoStatistics stats = {};
+		return scePadGetIoStatistics(g_scePad[0], &stats) == SCE_OK ? stats.linkState : -1;
+	};
+
+	auto waitFor = [&](int state) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (linkState() != state && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		return linkState() == state;
+	};
+
+	std::string failure;
+	for (int replug = 0; replug < 2 && failure.empty(); replug++) {
+		environment.transport.setConnected(0, false);
+		if (!waitFor(SCE_PAD_LINK_STATE_LOST)) failure = "the unplugged controller was never lost";
+
+		environment.transport.setConnected(0, true);
+		if (failure.empty() && !waitFor(SCE_PAD_LINK_STATE_CONNECTED)) failure = "the controller never came back";
+	}
+
+	int open = environment.transport.openHandles(0);
+	if (failure.empty() && open != 1) failure = std::to_string(open) + " handles open to the device after 2 replugs";
+
+	suite.check("check/replug closes handles", failure.empty(), failure);
+}
+
+// Two setters inside one coalescing window end up in the same report, which has to carry both updates.
+// The DualSense USB controller takes the light bar and a speaker volume 1.2ms apart, well inside the window.
+static void coalescedSetterChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/coalesced setters")) return;
+
+	std::string failure;
+	int lostColors = 0;
+	int lostVolumes = 0;
+
+	for (int round = 1; round <= COALESCE_CHECK_ROUNDS; round++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		environment.transport.takeOutputReports(0);
+
+		s_SceLightBar color = { (uint8_t)round, (uint8_t)(100 + round), 7 };
+		s_ScePadVolumeGain gain = { (uint8_t)round, 0, 0, 0 };
+		scePadSetLightBar(g_scePad[0], &color);
+		std::this_thread::sleep_for(std::chrono::microseconds(1200));
+		scePadSetVolumeGain(g_scePad[0], &gain);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		bool sawColor = false;
+		bool sawVolume = false;
+		for (const capturedReport& report : environment.transport.takeOutputReports(0)) {
+			if (report.feature || report.data.size() < 1 + sizeof(dualsenseData::SetStateData) || report.data[0] != 0x02) continue;
+
+			dualsenseData::SetStateData state = {};
+			std::memcpy(&state, report.data.data() + 1, sizeof(state));
+			if (state.AllowLedColor && state.LedRed == color.r && state.LedGreen == color.g && state.LedBlue == color.b) sawColor = true;
+			if (state.AllowSpeakerVolume && state.VolumeSpeaker == (uint8_t)(gain.speakerVolume + 64)) sawVolume = true;
+		}
+
+		if (!sawColor) lostColors++;
+		if (!sawVolume) lostVolumes++;
+	}
+
+	if (lostColors || lostVolumes)
+		failure = "light bar lost " + std::to_string(lostColors) + " and volume lost " + std::to_string(lostVolumes) + " of " + std::to_string(COALESCE_CHECK_ROUNDS) + " times";
+
+	suite.check("check/coalesced setters", failure.empty(), failure);
+}
+
+// The history of the DualSense USB controller at 1 kHz. One consumer with its own cursor has to get every report
+// in order exactly once and pick up at the oldest one still there after the reader lapped it. Consumers sharing
+// scePadRead's cursor have to split the reports between them without getting any twice. The controller stands
+// still at the start and the end of that part so both ends of the count are known, and it runs at 8 kHz in
+// between so the callers keep getting in each other's way.
+static void historyChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	if (!suite.selected("check/input history")) return;
+
+	auto newestSequence = [] {
+		s_ScePadRawState state = {};
+		return scePadGetRawState(g_scePad[0], &state) == SCE_OK ? state.sequence : 0;
+	};
+
+	auto waitForReports = [&](uint64_t after, uint64_t reports) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+		while (newestSequence() < after + reports && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return newestSequence() >= after + reports;
+	};
+
+	std::string failure;
+	s_ScePadSample samples[64];
+	uint64_t cursor = 0;
+	uint64_t expected = 0;
+	int received = 0;
+
+	// Skip what's there already, everything after has to come in order
+	while (scePadReadSamples(g_scePad[0], samples, 64, &cursor) > 0) {}
+	expected = cursor;
+
+	while (received < HISTORY_CHECK_REPORTS && failure.empty()) {
+		int read = scePadReadSamples(g_scePad[0], samples, 64, &cursor);
+		for (int i = 0; i < read && failure.empty(); i++, expected++) {
+			if (samples[i].sequence != expected)
+				failure = "got report " + std::to_string(samples[i].sequence) + " instead of " + std::to_string(expected);
+		}
+		received += read;
+		if (read == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+
+	// Let the reader lap the cursor, the next read starts at the oldest report still in the history
+	if (failure.empty() && !waitForReports(expected, 64 + 32)) failure = "the controller stopped sending reports";
+	if (failure.empty()) {
+		uint64_t newest = newestSequence();
+		int read = scePadReadSamples(g_scePad[0], samples, 64, &cursor);
+
+		if (read != 64) failure = "read " + std::to_string(read) + " reports after being lapped instead of 64";
+		else if (samples[0].sequence <= expected || samples[0].sequence + 63 < newest)
+			failure = "resynced to report " + std::to_string(samples[0].sequence) + " with the newest at " + std::to_string(newest);
+
+		for (int i = 1; i < read && failure.empty(); i++) {
+			if (samples[i].sequence != samples[i - 1].sequence + 1) failure = "reports out of order after being lapped";
+		}
+	}
+
+	// scePadRead gets lapped the same way
+	s_ScePadData data[64];
+	while (failure.empty() && scePadRead(g_scePad[0], data, 64) > 0) {}
+	if (failure.empty() && !waitForReports(newestSequence(), 64 + 32)) failure = "the controller stopped sending reports";
+	if (failure.empty()) {
+		int read = scePadRead(g_scePad[0], data, 64);
+		if (read != 64) failure = "scePadRead returned " + std::to_string(read) + " reports after being lapped instead of 64";
+	}
+
+	// Stand still, then count what the shared cursor hands out while reports come in
+	environment.transport.setReportRate(0, 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	while (scePadRead(g_scePad[0], data, 64) > 0) {}
+	uint64_t first = newestSequence();
+
+	std::atomic<bool> stop = false;
+	std::atomic<uint64_t> shared = 0;
+	std::vector<std::thread> readers;
+	for (int i = 0; i < HISTORY_CHECK_READERS && failure.empty(); i++) {
+		readers.emplace_back([&] {
+			s_ScePadData chunk[64];
+			while (!stop) {
+				int read = scePadRead(g_scePad[0], chunk, 64);
+				if (read > 0) shared += read;
+			}
+		});
+	}
+
+	environment.transport.setReportRate(0, HISTORY_CHECK_SHARED_RATE_HZ);
+	if (failure.empty() && !waitForReports(first, HISTORY_CHECK_SHARED_REPORTS)) failure = "the controller stopped sending reports";
+
+	environment.transport.setReportRate(0, 1);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	stop = true;
+	for (std::thread& reader : readers) reader.join();
+
+	int read = 0;
+	while ((read = scePadRead(g_scePad[0], data, 64)) > 0) shared += read;
+	uint64_t last = newestSequence();
+	environment.transport.setReportRate(0, 1000);
+
+	// Fewer only means the callers got lapped, more means some reports went out twice
+	if (failure.empty() && shared > last - first)
+		failure = std::to_string(HISTORY_CHECK_READERS) + " scePadRead callers got " + std::to_string(shared.load()) + " reports out of " + std::to_string(last - first);
+
+	// The controller is back at 1 kHz once it sends again
+	waitForReports(last, 1);
+
+	suite.check("check/input history", failure.empty(), failure);
+}
+
+void runDuaLibChecks(BenchmarkSuite& suite, BenchmarkEnvironment& environment) {
+	crcChecks(suite);
+	decodeCheck<dualsenseData::USBGetStateData>(suite, "DualSense");
+	decodeCheck<dualshock4Data::USBGetStateData>(suite, "DualShock4");
+	readStateMultiChecks(suite, environment);
+	tornReadChecks(suite, environment);
+	historyChecks(suite, environment);
+	outputCrcChecks(suite, environment);
+	coalescedSetterChecks(suite, environment);
+	replugChecks(suite, environment);
+}
@@ -0,0 +1,194 @@
+#ifndef LEGACY_DECODER_H
+#define LEGACY_DECODER_H
+
+#include <duaLib.h>
+#include <dataStructures.h>
+
+// duaLib's field by field decoder from before the table driven one in inputDecoder.h, kept as the
+// baseline for the decode benchmark and the reference for the decode check. g_particularMode became
+// a parameter, everything else is as it was.
+
+#define LEGACY_DEADBAND_MIN 0.017453292
+
+inline void legacyDecode(const dualsenseData::USBGetStateData& input, bool motion, bool velocityDeadband, bool particularMode, s_ScePadData* data) {
+#pragma region buttons
+	uint32_t bitmaskButtons = 0;
+	if (input.ButtonCross) bitmaskButtons |= SCE_BM_CROSS;
+	if (input.ButtonCircle) bitmaskButtons |= SCE_BM_CIRCLE;
+	if (input.ButtonTriangle) bitmaskButtons |= SCE_BM_TRIANGLE;
+	if (input.ButtonSquare) bitmaskButtons |= SCE_BM_SQUARE;
+
+	if (input.ButtonL1) bitmaskButtons |= SCE_BM_L1;
+	if (input.ButtonL2) bitmaskButtons |= SCE_BM_L2;
+	if (input.ButtonR1) bitmaskButtons |= SCE_BM_R1;
+	if (input.ButtonR2) bitmaskButtons |= SCE_BM_R2;
+
+	if (input.ButtonL3) bitmaskButtons |= SCE_BM_L3;
+	if (input.ButtonR3) bitmaskButtons |= SCE_BM_R3;
+
+	if (input.DPad == Direction::NorthEast) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_E_DPAD;
+	if (input.DPad == Direction::NorthWest) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_W_DPAD;
+	if (input.DPad == Direction::SouthEast) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_E_DPAD;
+	if (input.DPad == Direction::SouthWest) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_W_DPAD;
+
+	if (input.DPad == Direction::North) bitmaskButtons |= SCE_BM_N_DPAD;
+	if (input.DPad == Direction::South) bitmaskButtons |= SCE_BM_S_DPAD;
+	if (input.DPad == Direction::East) bitmaskButtons |= SCE_BM_E_DPAD;
+	if (input.DPad == Direction::West) bitmaskButtons |= SCE_BM_W_DPAD;
+
+	if (input.ButtonOptions) bitmaskButtons |= SCE_BM_OPTIONS;
+
+	if (input.ButtonPad) bitmaskButtons |= SCE_BM_TOUCH;
+	if (input.ButtonMute) bitmaskButtons |= SCE_BM_MICBUTTON;
+
+	if (particularMode) {
+		if (input.ButtonCreate) bitmaskButtons |= SCE_BM_SHARE;
+		if (input.ButtonHome) bitmaskButtons |= SCE_BM_PSBTN;
+	}
+
+	data->bitmask_buttons = bitmaskButtons;
+#pragma endregion
+
+#pragma region sticks
+	data->LeftStick.X = input.LeftStickX;
+	data->LeftStick.Y = input.LeftStickY;
+	data->RightStick.X = input.RightStickX;
+	data->RightStick.Y = input.RightStickY;
+#pragma endregion
+
+#pragma region triggers
+	data->L2_Analog = input.TriggerLeft;
+	data->R2_Analog = input.TriggerRight;
+#pragma endregion
+
+#pragma region gyro
+	if (motion) {
+		data->acceleration.x = (float)input.AccelerometerX;
+		data->acceleration.y = (float)input.AccelerometerY;
+		data->acceleration.z = (float)input.AccelerometerZ;
+
+		data->angularVelocity.x = (float)input.AngularVelocityX;
+		data->angularVelocity.y = (float)input.AngularVelocityY;
+		data->angularVelocity.z = (float)input.AngularVelocityZ;
+
+		data->angularVelocity.x = velocityDeadband == true && (data->angularVelocity.x < LEGACY_DEADBAND_MIN && data->angularVelocity.x > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.x;
+		data->angularVelocity.y = velocityDeadband == true && (data->angularVelocity.y < LEGACY_DEADBAND_MIN && data->angularVelocity.y > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.y;
+		data->angularVelocity.z = velocityDeadband == true && (data->angularVelocity.z < LEGACY_DEADBAND_MIN && data->angularVelocity.z > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.z;
+	}
+#pragma endregion
+
+#pragma region touchpad
+	data->touchData.touchNum = (input.touchData.Finger[0].NotTouching > 0 ? 0 : 1) + (input.touchData.Finger[1].NotTouching > 0 ? 0 : 1);
+
+	data->touchData.touch[0].id = input.touchData.Finger[0].Index;
+	data->touchData.touch[0].x = input.touchData.Finger[0].FingerX;
+	data->touchData.touch[0].y = input.touchData.Finger[0].FingerY;
+	data->touchData.touch[0].reserve[0] = input.touchData.Finger[0].NotTouching;
+
+	data->touchData.touch[1].id = input.touchData.Finger[1].Index;
+	data->touchData.touch[1].x = input.touchData.Finger[1].FingerX;
+	data->touchData.touch[1].y = input.touchData.Finger[1].FingerY;
+	data->touchData.touch[1].reserve[0] = input.touchData.Finger[1].NotTouching;
+#pragma endregion
+
+#pragma region misc
+	data->timestamp = input.DeviceTimeStamp;
+	data->extUnitData = {};
+	data->connectionCount = 0;
+	for (int j = 0; j < 12; j++)
+		data->deviceUniqueData[j] = {};
+	data->deviceUniqueDataLen = sizeof(data->deviceUniqueData);
+#pragma endregion
+}
+
+inline void legacyDecode(const dualshock4Data::USBGetStateData& input, bool motion, bool velocityDeadband, bool particularMode, s_ScePadData* data) {
+#pragma region buttons
+	uint32_t bitmaskButtons = 0;
+	if (input.ButtonCross) bitmaskButtons |= SCE_BM_CROSS;
+	if (input.ButtonCircle) bitmaskButtons |= SCE_BM_CIRCLE;
+	if (input.ButtonTriangle) bitmaskButtons |= SCE_BM_TRIANGLE;
+	if (input.ButtonSquare) bitmaskButtons |= SCE_BM_SQUARE;
+
+	if (input.ButtonL1) bitmaskButtons |= SCE_BM_L1;
+	if (input.ButtonL2) bitmaskButtons |= SCE_BM_L2;
+	if (input.ButtonR1) bitmaskButtons |= SCE_BM_R1;
+	if (input.ButtonR2) bitmaskButtons |= SCE_BM_R2;
+
+	if (input.ButtonL3) bitmaskButtons |= SCE_BM_L3;
+	if (input.ButtonR3) bitmaskButtons |= SCE_BM_R3;
+
+	if (input.DPad == Direction::NorthEast) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_E_DPAD;
+	if (input.DPad == Direction::NorthWest) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_W_DPAD;
+	if (input.DPad == Direction::SouthEast) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_E_DPAD;
+	if (input.DPad == Direction::SouthWest) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_W_DPAD;
+
+	if (input.DPad == Direction::North) bitmaskButtons |= SCE_BM_N_DPAD;
+	if (input.DPad == Direction::South) bitmaskButtons |= SCE_BM_S_DPAD;
+	if (input.DPad == Direction::East) bitmaskButtons |= SCE_BM_E_DPAD;
+	if (input.DPad == Direction::West) bitmaskButtons |= SCE_BM_W_DPAD;
+
+	if (input.ButtonOptions) bitmaskButtons |= SCE_BM_OPTIONS;
+
+	if (input.ButtonPad) bitmaskButtons |= SCE_BM_TOUCH;
+
+	if (particularMode) {
+		if (input.ButtonShare) bitmaskButtons |= SCE_BM_SHARE;
+		if (input.ButtonHome) bitmaskButtons |= SCE_BM_PSBTN;
+	}
+
+	data->bitmask_buttons = bitmaskButtons;
+#pragma endregion
+
+#pragma region sticks
+	data->LeftStick.X = input.LeftStickX;
+	data->LeftStick.Y = input.LeftStickY;
+	data->RightStick.X = input.RightStickX;
+	data->RightStick.Y = input.RightStickY;
+#pragma endregion
+
+#pragma region triggers
+	data->L2_Analog = input.TriggerLeft;
+	data->R2_Analog = input.TriggerRight;
+#pragma endregion
+
+#pragma region gyro
+	if (motion) {
+		data->acceleration.x = (float)input.AccelerometerX;
+		data->acceleration.y = (float)input.AccelerometerY;
+		data->acceleration.z = (float)input.AccelerometerZ;
+
+		data->angularVelocity.x = (float)input.AngularVelocityX;
+		data->angularVelocity.y = (float)input.AngularVelocityY;
+		data->angularVelocity.z = (float)input.AngularVelocityZ;
+
+		data->angularVelocity.x = velocityDeadband == true && (data->angularVelocity.x < LEGACY_DEADBAND_MIN && data->angularVelocity.x > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.x;
+		data->angularVelocity.y = velocityDeadband == true && (data->angularVelocity.y < LEGACY_DEADBAND_MIN && data->angularVelocity.y > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.y;
+		data->angularVelocity.z = velocityDeadband == true && (data->angularVelocity.z < LEGACY_DEADBAND_MIN && data->angularVelocity.z > -LEGACY_DEADBAND_MIN) ? 0 : data->angularVelocity.z;
+	}
+#pragma endregion
+
+#pragma region touchpad
+	data->touchData.touchNum = (input.Finger1Active > 0 ? 0 : 1) + (input.Finger2Active > 0 ? 0 : 1);
+
+	data->touchData.touch[0].id = input.Finger1ID;
+	data->touchData.touch[0].x = input.Finger1X;
+	data->touchData.touch[0].y = input.Finger1Y;
+	data->touchData.touch[0].reserve[0] = input.Finger1Active;
+
+	data->touchData.touch[1].id = input.Finger2ID;
+	data->touchData.touch[1].x = input.Finger2X;
+	data->touchData.touch[1].y = input.Finger2Y;
+	data->touchData.touch[1].reserve[0] = input.Finger2Active;
+#pragma endregion
+
+#pragma region misc
+	data->timestamp = input.Timestamp;
+	data->extUnitData = {};
+	data->connectionCount = 0;
+	for (int j = 0; j < 12; j++)
+		data->deviceUniqueData[j] = {};
+	data->deviceUniqueDataLen = sizeof(data->deviceUniqueData);
+#pragma endregion
+}
+
+#endif
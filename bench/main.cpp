@@ -0,0 +1,147 @@
+#include "benchmark.hpp"
+#include "scePadHandle.hpp"
+#include <duaLib.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <thread>
+
+// Usage: DualSenseY_bench [--filter <substring>] [--json <file>] [--commit <id>] [--quick] [--check]
+// Runs without any controller connected, duaLib talks to simulated ones instead.
+// The correctness checks always run first, --check runs only them. Exits with 1 if any of them failed.
+
+static std::string utcTimestamp() {
+	std::time_t now = std::time(nullptr);
+	std::tm utc = {};
+#if !defined(__linux__) && !defined(__APPLE__)
+	gmtime_s(&utc, &now);
+#else
+	gmtime_r(&now, &utc);
+#endif
+	char buffer[32] = {};
+	std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+	return buffer;
+}
+
+static std::string compilerName() {
+#if defined(__clang__)
+	return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+	return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc " + std::to_string(_MSC_VER);
+#else
+	return "unknown";
+#endif
+}
+
+static bool setupEnvironment(BenchmarkEnvironment& environment) {
+	// A mix of what people actually plug in, repeated for every slot. Only the first CONTROLLER_COUNT are
+	// plugged in, the reader latency sweep plugs in the rest.
+	simulatedDeviceConfig configs[4] = {};
+	configs[0].productID = 0x0ce6;
+	configs[0].busType = 1;
+	configs[0].reportRateHz = 1000;
+	configs[1].productID = 0x0ce6;
+	configs[1].busType = 2;
+	configs[1].reportRateHz = 1000;
+	configs[1].jitterUs = 250;
+	configs[2].productID = 0x09cc;
+	configs[2].busType = 2;
+	configs[2].reportRateHz = 800;
+	configs[2].jitterUs = 250;
+	configs[3].productID = 0x09cc;
+	configs[3].busType = 1;
+	configs[3].reportRateHz = 1000;
+
+	for (int i = 0; i < SCE_PAD_MAX_CONTROLLER_COUNT; i++) {
+		int device = environment.transport.addDevice(configs[i % 4]);
+		environment.devices.push_back(configs[i % 4]);
+		if (i >= CONTROLLER_COUNT) environment.transport.setConnected(device, false);
+	}
+
+	s_ScePadInitParam initParam = {};
+	initParam.allowBT = true;
+	scePadSetTransport(&environment.transport);
+	scePadSetControllerCount(SCE_PAD_MAX_CONTROLLER_COUNT);
+	scePadInit3(&initParam);
+	for (int i = 0; i < CONTROLLER_COUNT; i++)
+		g_scePad[i] = scePadOpen(i + 1, 0, 0);
+
+	// Probing happens in the background, wait until every controller delivered a report
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (std::chrono::steady_clock::now() < deadline) {
+		int ready = 0;
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
+			s_ScePadData state = {};
+			if (scePadReadState(g_scePad[i], &state) == SCE_OK && state.connected) ready++;
+		}
+
+		if (ready == CONTROLLER_COUNT) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+int main(int argc, char* argv[]) {
+	std::string filter;
+	std::string jsonPath;
+	std::string commit = "unknown";
+	bool quick = false;
+	bool checksOnly = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--filter") && i + 1 < argc) filter = argv[++i];
+		else if (!std::strcmp(argv[i], "--json") && i + 1 < argc) jsonPath = argv[++i];
+		else if (!std::strcmp(argv[i], "--commit") && i + 1 < argc) commit = argv[++i];
+		else if (!std::strcmp(argv[i], "--quick")) quick = true;
+		else if (!std::strcmp(argv[i], "--check")) checksOnly = true;
+		else {
+			printf("Usage: %s [--filter <substring>] [--json <file>] [--commit <id>] [--quick] [--check]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Never freed, duaLib's threads can still touch the transport after scePadTerminate
+	BenchmarkEnvironment& environment = *new BenchmarkEnvironment();
+	environment.window = std::chrono::milliseconds(quick ? 500 : 2000);
+
+	BenchmarkSuite suite(filter, quick ? std::chrono::milliseconds(5) : std::chrono::milliseconds(50));
+	suite.check("setup/controllersReady", setupEnvironment(environment), "not every simulated controller delivered a report within 5s");
+
+	runDuaLibChecks(suite, environment);
+	if (!checksOnly) {
+		runDuaLibBenchmarks(suite, environment);
+		runAppBenchmarks(suite, environment);
+	}
+
+	nlohmann::json output = {
+		{"commit", commit},
+		{"timestamp", utcTimestamp()},
+		{"compiler", compilerName()},
+		{"controllerCount", CONTROLLER_COUNT},
+		{"hardwareThreads", std::thread::hardware_concurrency()},
+		{"quick", quick},
+		{"results", suite.toJson()},
+		{"checks", suite.checksToJson()},
+	};
+
+	if (!jsonPath.empty()) {
+		std::ofstream file(jsonPath);
+		if (!file) {
+			printf("Couldn't write %s\n", jsonPath.c_str());
+			return 1;
+		}
+		file << output.dump(4) << "\n";
+	}
+
+	scePadTerminate();
+
+	if (suite.failedChecks() > 0) {
+		printf("%d check(s) failed\n", suite.failedChecks());
+		return 1;
+	}
+	return 0;
+}
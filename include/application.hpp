@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "scePadSettings.hpp"
+#include "scePadHandle.hpp"
 #include "appSettings.hpp"
 
 constexpr auto WIN32_MSG_WINDOW_MUTEX = "DSYMSG";
@@ -19,7 +20,7 @@ struct glfwDeleter {
 class Application {
 private:
 	std::unique_ptr<GLFWwindow, glfwDeleter> m_glfwWindow;
-	s_scePadSettings m_scePadSettings[4] = {};
+	s_scePadSettings m_scePadSettings[CONTROLLER_COUNT] = {};
 	bool isMinimized();
 	void disableControllerInputIfMinimized();
 	AppSettings m_appSettings = {};
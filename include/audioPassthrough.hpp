@@ -6,20 +6,20 @@
 #include <vector>
 #include <mutex>
 #include <atomic>
+#include "scePadHandle.hpp"
 
 class AudioPassthrough {
 private:
-	std::vector<float> m_audioBuffer[4];
+	std::vector<float> m_audioBuffer[CONTROLLER_COUNT];
 	std::mutex m_bufferMutex;
 	std::chrono::steady_clock::time_point lastTimeValidated;
 
-	ma_device m_controller[4];
-	ma_device_id m_controllerId[4];
+	ma_device m_controller[CONTROLLER_COUNT];
+	ma_device_id m_controllerId[CONTROLLER_COUNT];
 	static ma_device m_captureDevice;
-	bool m_active[4] = {false,false,false,false};
-	uint32_t m_indexes[4] = { 0,1,2,3 };
+	bool m_active[CONTROLLER_COUNT] = {};
 	std::atomic<float> m_currentCapturePeak = 0.0f;
-	std::atomic<float> m_hapticIntensity[4] = { 1.0f,1.0f,1.0f,1.0f };
+	std::atomic<float> m_hapticIntensity[CONTROLLER_COUNT];
 
 	void startCaptureDevice(ma_device* pDevice);
 
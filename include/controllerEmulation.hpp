@@ -22,8 +22,8 @@
 #include <client.hpp>
 #include <unordered_map>
 
-// User (4) + Peers (4)
-static int constexpr VIGEM_CONTROLLER_MAX = 8;
+// Users + Peers
+static int constexpr VIGEM_CONTROLLER_MAX = CONTROLLER_COUNT * 2;
 
 class Vigem {  
 private:  
@@ -47,7 +47,7 @@ private:
 
    std::thread m_vigemThread;
    std::atomic<bool> m_vigemThreadRunning = true;
-   VigemUserData m_userData[4] = { {0,this},{1,this},{2,this},{3,this} };
+   VigemUserData m_userData[CONTROLLER_COUNT] = {};
    void update360ByTarget(PVIGEM_TARGET Target, s_ScePadData& state);
    void updateDs4ByTarget(PVIGEM_TARGET Target, s_ScePadData& state);
    void emulatedControllerUpdate();
@@ -55,7 +55,6 @@ private:
    std::unordered_map<uint32_t, PVIGEM_TARGET> m_PeerControllerTargets;
 #endif
 
-   void applyInputSettingsToScePadState(s_scePadSettings& settings, s_ScePadData& state);
    s_scePadSettings* m_scePadSettings = nullptr;
    UDP& m_udp;
    std::atomic<uint32_t> m_selectedController = 0;
@@ -65,6 +64,7 @@ public:
    void plugControllerByIndex(uint32_t index, uint32_t controllerType);  
    bool isVigemConnected(); 
    void setSelectedController(uint32_t selectedController);
+   static void applyInputSettingsToScePadState(s_scePadSettings& settings, s_ScePadData& state);
    void SetPeerControllerDataPointer(std::shared_ptr<std::unordered_map<uint32_t, PeerControllerData>> Pointer);
 };
 
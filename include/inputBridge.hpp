@@ -1,5 +1,6 @@
 #pragma once
 #include "scePadSettings.hpp"
+#include "scePadHandle.hpp"
 #include <unordered_map>
 #include <string>
 #include <mutex>
@@ -22,5 +23,5 @@ private:
     InputBridge& operator=(const InputBridge&) = delete;
 
     std::mutex m_mutex;
-    InputBridgeState m_states[4];
+    InputBridgeState m_states[CONTROLLER_COUNT];
 };
@@ -0,0 +1,74 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include "scePadHandle.hpp"
+
+// Where a controller report ends up, latency is measured from when duaLib read it from the device
+enum class LatencyStage {
+	Xbox360,       // Vigem::update360ByTarget
+	DualShock4,    // Vigem::updateDs4ByTarget
+	KeyboardMouse, // SendInput from the keyboard and mouse mapper
+	PeerInput,     // Client::CMD_PEER_INPUT_STATE
+	Count
+};
+
+struct LatencySummary {
+	uint64_t count = 0;
+	uint64_t minUs = 0;
+	uint64_t maxUs = 0;
+	double meanUs = 0;
+	uint64_t p50Us = 0;
+	uint64_t p90Us = 0;
+	uint64_t p99Us = 0;
+	uint64_t p999Us = 0;
+};
+
+// HDR style histogram: exact below 32us, above that every power of two is split into 16 buckets,
+// so any value is off by at most 1/16. Recording is lock free and safe from any thread.
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKET_BITS = 5;
+	static constexpr int MAX_VALUE_BITS = 27; // ~134s, anything above gets clamped
+	static constexpr int BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) << (SUB_BUCKET_BITS - 1);
+
+	void record(uint64_t valueUs);
+	LatencySummary summary() const;
+	void reset();
+
+	static int bucketIndex(uint64_t valueUs);
+	// Largest value that ends up in the bucket
+	static uint64_t bucketUpperBound(int index);
+
+private:
+	std::atomic<uint64_t> m_buckets[BUCKET_COUNT] = {};
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<uint64_t> m_sum = 0;
+	std::atomic<uint64_t> m_min = UINT64_MAX;
+	std::atomic<uint64_t> m_max = 0;
+};
+
+class LatencyTracer {
+public:
+	static LatencyTracer& instance();
+
+	// Records how long ago receivedAtUs (from scePadReadStateTimed/Multi) was. Consumers poll faster
+	// than reports come in, so only the first time a stage sees a report of a controller counts.
+	void record(LatencyStage stage, uint32_t index, uint64_t receivedAtUs);
+	LatencySummary summary(LatencyStage stage) const;
+	void reset();
+
+	static const char* stageName(LatencyStage stage);
+	static uint64_t nowUs();
+
+private:
+	LatencyTracer() = default;
+	LatencyTracer(const LatencyTracer&) = delete;
+	LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+	LatencyHistogram m_histograms[(int)LatencyStage::Count];
+	std::atomic<uint64_t> m_lastRecorded[(int)LatencyStage::Count][CONTROLLER_COUNT] = {};
+};
+
+#endif // LATENCYTRACER_H
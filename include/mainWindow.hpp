@@ -21,6 +21,7 @@ class MainWindow {
 private:
 	int m_selectedController = 0;
 	bool about(bool* open);
+	bool latency(bool* open);
 	bool menuBar(int& currentController, s_scePadSettings& scePadSettings);
 	bool controllers(int& currentController, s_scePadSettings& scePadSettings, float scale);
 	bool led(s_scePadSettings& scePadSettings, float scale);
@@ -44,7 +45,7 @@ public:
 	MainWindow(Strings& strings, AudioPassthrough& audio, Vigem& vigem, UDP& udp, AppSettings& appSettings, Client& client)
 		: m_strings(strings), m_audio(audio), m_vigem(vigem), m_udp(udp), m_appSettings(appSettings), m_client(client) {
 	}
-	void show(s_scePadSettings scePadSettings[4], float scale);
+	void show(s_scePadSettings scePadSettings[CONTROLLER_COUNT], float scale);
 	int getSelectedController();
 };
 
@@ -2,6 +2,7 @@
 #define CUSTOMTRIGGERS_H
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
 
 enum DSXTriggerMode : uint8_t {
@@ -1,6 +1,13 @@
 #ifndef SCEPADHANDLE_H
 #define SCEPADHANDLE_H
 
-inline uint32_t g_scePad[4] = { 0,0,0,0 };
+#include <cstdint>
+
+// Number of duaLib user IDs the app opens, set from CMake
+#ifndef CONTROLLER_COUNT
+#define CONTROLLER_COUNT 4
+#endif
+
+inline uint32_t g_scePad[CONTROLLER_COUNT] = {};
 
 #endif
\ No newline at end of file
@@ -226,6 +226,8 @@ private:
 public:
 	bool isActive();
 	s_scePadSettings getSettings();
+	// Parses a DSX packet and applies its instructions, throws on malformed JSON
+	void handlePacket(const char* buffer);
 	void setVibrationToUdpConfig(s_ScePadVibrationParam vibration);
 	UDP();
 	~UDP();
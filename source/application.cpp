@@ -15,8 +15,10 @@
 #include <thread>
 #include <chrono>
 #include <cassert>
+#include <cstdlib>
 #include <imgui.h>
 #include <duaLib.h>
+#include <capture.h>
 #include <backends/imgui_impl_opengl3.h>
 #include <backends/imgui_impl_glfw.h>
 #include <stb_image/stb_image.h>
@@ -30,6 +32,11 @@
 #include "keyboardMouseMapper.hpp"
 #include "client.hpp"
 
+// DUALSENSEY_RECORD=<file> records everything exchanged with the controllers, DUALSENSEY_REPLAY=<file>
+// plays such a recording back instead of talking to real ones (DUALSENSEY_REPLAY_SPEED, 0 is as fast as possible)
+static recordingTransport g_recorder(hidTransport());
+static replayTransport g_replay;
+
 #if !defined(__linux__) && !defined(__MACOS__)
 bool colorsChanged = false;
 WNDPROC originalWndProc = nullptr;
@@ -73,11 +80,19 @@ bool Application::run() {
 	#pragma region Initialize duaLib
 	s_ScePadInitParam initParam = {};
 	initParam.allowBT = true;
+	if (const char* replayFile = std::getenv("DUALSENSEY_REPLAY")) {
+		const char* speed = std::getenv("DUALSENSEY_REPLAY_SPEED");
+		if (g_replay.load(replayFile, speed ? std::atof(speed) : 1.0)) scePadSetTransport(&g_replay);
+		else LOGE("[duaLib] Couldn't load replay %s", replayFile);
+	}
+	else if (const char* recordFile = std::getenv("DUALSENSEY_RECORD")) {
+		if (g_recorder.start(recordFile)) scePadSetTransport(&g_recorder);
+		else LOGE("[duaLib] Couldn't create recording %s", recordFile);
+	}
+	scePadSetControllerCount(CONTROLLER_COUNT);
 	scePadInit3(&initParam);
-	g_scePad[0] = scePadOpen(1, 0, 0);
-	g_scePad[1] = scePadOpen(2, 0, 0);
-	g_scePad[2] = scePadOpen(3, 0, 0);
-	g_scePad[3] = scePadOpen(4, 0, 0);
+	for (int i = 0; i < CONTROLLER_COUNT; i++)
+		g_scePad[i] = scePadOpen(i + 1, 0, 0);
 	scePadSetParticularMode(true);
 #pragma endregion
 	#if (!defined(PRODUCTION_BUILD) || PRODUCTION_BUILD == 0) && defined(_WIN32) && (!defined(__linux__) && !defined(__APPLE__))
@@ -157,7 +172,7 @@ bool Application::run() {
 		udp.setVibrationToUdpConfig(m_scePadSettings[selectedController].rumbleFromEmulatedController);
 		audio.validate();	
 		
-		for (int i = 0; i < 4; i++) {
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
 			loadDefaultConfigs(i, &m_scePadSettings[i]);
 			applySettings(i, i == (selectedController) && udp.isActive() ? udp.getSettings() : m_scePadSettings[i], audio);
 		}
@@ -314,12 +329,12 @@ Application::~Application() {
 	// Unhide controllers
 #ifdef WINDOWS
 	if (isRunningAsAdministratorWindows()) {
-		for(int i = 0;i<4;i++)
+		for (int i = 0; i < CONTROLLER_COUNT; i++)
 			unhideController(scePadGetPath(g_scePad[i]));
 	}
 
 	if (m_appSettings.DisableAllBluetoothControllersOnExit) {
-		for (int i = 0; i < 4; i++)
+		for (int i = 0; i < CONTROLLER_COUNT; i++)
 			DisableBluetoothDevice(scePadGetMacAddress(g_scePad[i]));
 	}
 #endif
@@ -327,4 +342,5 @@ Application::~Application() {
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 	scePadTerminate();
+	g_recorder.stop();
 }
\ No newline at end of file
@@ -121,7 +121,7 @@ void captureDataCallback(ma_device* pDevice, void* pOutput, const void* pInput,
 		float sampleL = inputF32[frame * numChannels + 0];
 		float sampleR = inputF32[frame * numChannels + 1];
 
-		for (uint32_t i = 0; i < 4; ++i) {
+		for (uint32_t i = 0; i < CONTROLLER_COUNT; ++i) {
 			userData->m_audioBuffer[i].push_back(sampleL);
 			userData->m_audioBuffer[i].push_back(sampleR);
 
@@ -147,7 +147,7 @@ void playbackDualsenseDataCallback(ma_device* pDevice, void* pOutput, const void
     std::lock_guard<std::mutex> lock(userData->m_bufferMutex);
 
 	uint32_t index = 0;
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 		if (&userData->m_controller[i] == pDevice) {
 			index = i;
 			break;
@@ -183,7 +183,7 @@ void playbackDualshock4DataCallback(ma_device* pDevice, void* pOutput, const voi
 	std::lock_guard<std::mutex> lock(userData->m_bufferMutex);
 
 	uint32_t index = 0;
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 		if (&userData->m_controller[i] == pDevice) {
 			index = i;
 		}
@@ -230,6 +230,9 @@ void AudioPassthrough::startCaptureDevice(ma_device* pDevice) {
 }
 
 AudioPassthrough::AudioPassthrough() {
+	for (auto& intensity : m_hapticIntensity)
+		intensity = 1.0f;
+
 	if (ma_context_init(NULL, 0, NULL, &g_context) != MA_SUCCESS) return;
 	lastTimeValidated = std::chrono::steady_clock::now();
 }
@@ -237,7 +240,7 @@ AudioPassthrough::AudioPassthrough() {
 AudioPassthrough::~AudioPassthrough() {
 	ma_device_uninit(&m_captureDevice);
 
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 		if(isMaDeviceWorking(&m_controller[i]))
 			ma_device_uninit(&m_controller[i]);
 	}
@@ -258,7 +261,7 @@ void AudioPassthrough::validate() {
 
 		{
 			std::lock_guard<std::mutex> lock(m_bufferMutex);
-			for (uint32_t i = 0; i < 4; i++) {
+			for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 				m_audioBuffer[i].clear();
 				m_audioBuffer[i].shrink_to_fit();
 			}	
@@ -267,7 +270,7 @@ void AudioPassthrough::validate() {
 		startCaptureDevice(&m_captureDevice);
 	}
 
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 		if (m_active[i] && !isMaDeviceWorking(&m_controller[i])) {
 			startByUserId(i + 1);
 		}
@@ -278,7 +281,7 @@ void AudioPassthrough::validate() {
 
 bool AudioPassthrough::startByUserId(uint32_t userId) {
 #if (!defined(__linux__)) && (!defined(__MACOS__))
-	assert(userId >= 1 && userId <= 4);
+	assert(userId >= 1 && userId <= CONTROLLER_COUNT);
 
 	uint32_t index = userId - 1;
 
@@ -293,7 +296,7 @@ bool AudioPassthrough::startByUserId(uint32_t userId) {
 	
 	{
 		std::lock_guard<std::mutex> lock(m_bufferMutex);
-		for (uint32_t i = 0; i < 4; i++) {
+		for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 			m_audioBuffer[i].clear();
 		}
 	}
@@ -346,7 +349,7 @@ bool AudioPassthrough::startByUserId(uint32_t userId) {
 }
 
 bool AudioPassthrough::stopByUserId(uint32_t userId) {
-	assert(userId >= 1 && userId <= 4);
+	assert(userId >= 1 && userId <= CONTROLLER_COUNT);
 
 	uint32_t index = userId - 1;
 
@@ -369,7 +372,7 @@ bool AudioPassthrough::stopByUserId(uint32_t userId) {
 }
 
 void AudioPassthrough::setHapticIntensityByUserId(uint32_t userId, float intensity) {
-	assert(userId >= 1 && userId <= 4);
+	assert(userId >= 1 && userId <= CONTROLLER_COUNT);
 
 	m_hapticIntensity[userId - 1] = intensity;
 }
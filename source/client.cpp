@@ -4,6 +4,7 @@
 #include "log.hpp"
 #include "upnp.hpp"
 #include "scePadHandle.hpp"
+#include "latencyTracer.hpp"
 #include <algorithm>
 #include "applicationVersion.hpp"
 
@@ -632,12 +633,14 @@ void Client::InputStateSendoutService() {
 		s_ScePadData InputState = { };
 		InputState.LeftStick.X = 128; InputState.LeftStick.Y = 128;
 		InputState.RightStick.X = 128; InputState.RightStick.Y = 128;
-		int result = scePadReadState(g_scePad[m_SelectedController], &InputState);
+		uint64_t receivedAtUs = 0;
+		int result = scePadReadStateTimed(g_scePad[m_SelectedController], &InputState, &receivedAtUs);
 
 		for (auto& it : *m_PeerControllers) {
 			auto now = std::chrono::steady_clock::now();
 			if (it.second.AllowedToSend) {
 				CMD_PEER_INPUT_STATE(it.first, InputState);
+				LatencyTracer::instance().record(LatencyStage::PeerInput, m_SelectedController, receivedAtUs);
 
 				auto& simpleSettings = it.second.SimpleSettings;
 				auto& settings = m_ScePadSettings[m_SelectedController];
@@ -679,7 +682,7 @@ void Client::InputStateSendoutService() {
 		SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, 0);
 		WaitForSingleObject(hTimer, INFINITE);
 	#else
-		std::this_thread::sleep_for(std::chrono::miliseconds(10));
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 	#endif
 	}
 }
@@ -4,6 +4,7 @@
 #include "controllerHotkey.hpp"
 #include <cmath>
 #include "inputBridge.hpp"
+#include "latencyTracer.hpp"
 
 int convertRange(int value, int oldMin, int oldMax, int newMin, int newMax) {
 	if (oldMin == oldMax) {
@@ -163,7 +164,8 @@ Vigem::Vigem(s_scePadSettings* scePadSettings, UDP& udp) : m_scePadSettings(sceP
 		m_vigemClientInitalized = true;
 	}
 
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
+		m_userData[i] = { (int)i, this };
 		m_360[i] = vigem_target_x360_alloc();
 		m_ds4[i] = vigem_target_ds4_alloc();
 	}
@@ -177,7 +179,7 @@ Vigem::~Vigem() {
 		m_vigemThread.join();
 	}
 
-	for (uint32_t i = 0; i < 4; i++) {
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 		vigem_target_x360_unregister_notification(m_360[i]);
 		vigem_target_remove(m_vigemClient, m_360[i]);
 		vigem_target_ds4_unregister_notification(m_ds4[i]);
@@ -193,7 +195,7 @@ Vigem::~Vigem() {
 
 void Vigem::plugControllerByIndex(uint32_t index, uint32_t controllerType) {
 #ifdef WINDOWS
-	static uint32_t lastEmulatedController[4] = {};
+	static uint32_t lastEmulatedController[CONTROLLER_COUNT] = {};
 
 	if ((EmulatedController)controllerType == EmulatedController::NONE && (EmulatedController)lastEmulatedController[index] != EmulatedController::NONE) {
 		vigem_target_remove(m_vigemClient, m_360[index]);
@@ -297,24 +299,30 @@ void Vigem::emulatedControllerUpdate() {
 	liDueTime.QuadPart = -5000LL;
 
 	while (m_vigemThreadRunning) {
-		for (uint32_t i = 0; i < 4; i++) {
+		s_ScePadData scePadStates[CONTROLLER_COUNT] = {};
+		uint64_t receivedAtUs[CONTROLLER_COUNT] = {};
+		uint32_t validMask = 0;
+		scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), scePadStates, CONTROLLER_COUNT, &validMask, receivedAtUs);
+
+		for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 
 			if ((EmulatedController)m_scePadSettings[i].emulatedController != EmulatedController::NONE) {
-				s_ScePadData scePadState = {};
-				uint32_t result = scePadReadState(g_scePad[i], &scePadState);
+				s_ScePadData& scePadState = scePadStates[i];
 				InputBridge::instance().updateFromPs5(scePadState, i);
 
 
 				s_scePadSettings settingsToUse = (m_selectedController == i && m_udp.isActive()) ? m_udp.getSettings() : m_scePadSettings[i];
 				applyInputSettingsToScePadState(settingsToUse, scePadState);
 
-				if (result == SCE_OK) {
+				if (validMask & (1u << i)) {
 
 					if ((EmulatedController)m_scePadSettings[i].emulatedController == EmulatedController::XBOX360) {
 						update360ByTarget(m_360[i], scePadState);
+						LatencyTracer::instance().record(LatencyStage::Xbox360, i, receivedAtUs[i]);
 					}
 					else if ((EmulatedController)m_scePadSettings[i].emulatedController == EmulatedController::DUALSHOCK4) {
 						updateDs4ByTarget(m_ds4[i], scePadState);
+						LatencyTracer::instance().record(LatencyStage::DualShock4, i, receivedAtUs[i]);
 					}
 				}
 			}
@@ -4,8 +4,10 @@
 #include <Windows.h>
 #endif 
 
+#include <atomic>
 #include <chrono>
 #include "scePadHandle.hpp"
+#include "latencyTracer.hpp"
 #include <duaLib.h>
 
 
@@ -15,6 +17,10 @@ constexpr WORD SC_A = 0x1E;
 constexpr WORD SC_S = 0x1F;
 constexpr WORD SC_D = 0x20;
 
+// Bumped on every SendInput so the mapper thread can tell which reports produced input. Atomic
+// because the send helpers are free functions, nothing keeps them on the mapper thread.
+static std::atomic<uint64_t> g_inputsSent = 0;
+
 void sendKeyScan(WORD scancode, bool down) {
 	INPUT input = {};
 	input.type = INPUT_KEYBOARD;
@@ -22,6 +28,7 @@ void sendKeyScan(WORD scancode, bool down) {
 	input.ki.wScan = scancode;
 
 	SendInput(1, &input, sizeof(INPUT));
+	g_inputsSent.fetch_add(1, std::memory_order_relaxed);
 }
 
 void MouseClick(DWORD flag, DWORD mouseData = 0) {
@@ -32,6 +39,7 @@ void MouseClick(DWORD flag, DWORD mouseData = 0) {
 	input.mi.time = 0;
 	input.mi.dwExtraInfo = 0;
 	SendInput(1, &input, sizeof(INPUT));
+	g_inputsSent.fetch_add(1, std::memory_order_relaxed);
 }
 #endif
 
@@ -62,13 +70,19 @@ void KeyboardMouseMapper::thread() {
 			fire = true;
 		}
 
-		for (int i = 0; i < 4; i++) {
-			s_ScePadData state = {};
-			int result = scePadReadState(g_scePad[i], &state);
+		s_ScePadData states[CONTROLLER_COUNT] = {};
+		uint64_t receivedAtUs[CONTROLLER_COUNT] = {};
+		uint32_t validMask = 0;
+		scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), states, CONTROLLER_COUNT, &validMask, receivedAtUs);
+
+		for (int i = 0; i < CONTROLLER_COUNT; i++) {
+			s_ScePadData& state = states[i];
 
-			if (result != SCE_OK || m_scePadSettings == nullptr)
+			if (!(validMask & (1u << i)) || m_scePadSettings == nullptr)
 				continue;
 
+			uint64_t inputsSentBefore = g_inputsSent.load(std::memory_order_relaxed);
+
 		#pragma region Touchpad as mouse
 			if (m_scePadSettings[i].touchpadAsMouse && !state.touchData.touch[0].reserve[0]) {
 
@@ -164,8 +178,8 @@ void KeyboardMouseMapper::thread() {
 		#pragma region Gyro to mouse
 
 			if (m_scePadSettings[i].gyroToMouse) {
-				static bool lastVelX[4] = { 0 };
-				static bool lastVelY[4] = { 0 };
+				static bool lastVelX[CONTROLLER_COUNT] = { 0 };
+				static bool lastVelY[CONTROLLER_COUNT] = { 0 };
 
 				float velX = -state.angularVelocity.z;
 				float velY = -state.angularVelocity.x;
@@ -184,7 +198,7 @@ void KeyboardMouseMapper::thread() {
 
 		#pragma region Mouse1 hotkey
 			if (m_scePadSettings[i].useMouse1Hotkey) {
-				static bool wasPressed[4] = { false };
+				static bool wasPressed[CONTROLLER_COUNT] = { false };
 
 				if ((state.bitmask_buttons & m_scePadSettings[i].mouse1Hotkey) && !wasPressed[i]) {
 					MouseClick(MOUSEEVENTF_LEFTDOWN);
@@ -197,6 +211,9 @@ void KeyboardMouseMapper::thread() {
 			}
 
 		#pragma endregion
+
+			if (g_inputsSent.load(std::memory_order_relaxed) != inputsSentBefore)
+				LatencyTracer::instance().record(LatencyStage::KeyboardMouse, i, receivedAtUs[i]);
 		}
 
 		if (fire) {
@@ -218,6 +235,7 @@ void KeyboardMouseMapper::moveCursor(int x, int y) {
 	input.mi.dy = y;
 
 	SendInput(1, &input, sizeof(INPUT));
+	g_inputsSent.fetch_add(1, std::memory_order_relaxed);
 #endif
 }
 
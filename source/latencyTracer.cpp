@@ -0,0 +1,121 @@
+#include "latencyTracer.hpp"
+#include <algorithm>
+#include <chrono>
+
+int LatencyHistogram::bucketIndex(uint64_t valueUs) {
+	constexpr uint64_t maxValue = (1ull << MAX_VALUE_BITS) - 1;
+	if (valueUs > maxValue) valueUs = maxValue;
+	if (valueUs < (1ull << SUB_BUCKET_BITS)) return (int)valueUs;
+
+	int bits = 0;
+	for (uint64_t v = valueUs; v; v >>= 1) bits++;
+
+	int shift = bits - SUB_BUCKET_BITS;
+	return (shift << (SUB_BUCKET_BITS - 1)) + (int)(valueUs >> shift);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index) {
+	if (index < (1 << SUB_BUCKET_BITS)) return (uint64_t)index;
+
+	int shift = (index >> (SUB_BUCKET_BITS - 1)) - 1;
+	uint64_t subBucket = (uint64_t)(index - (shift << (SUB_BUCKET_BITS - 1)));
+	return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueUs) {
+	m_buckets[bucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(valueUs, std::memory_order_relaxed);
+
+	uint64_t current = m_min.load(std::memory_order_relaxed);
+	while (valueUs < current && !m_min.compare_exchange_weak(current, valueUs, std::memory_order_relaxed)) {}
+
+	current = m_max.load(std::memory_order_relaxed);
+	while (valueUs > current && !m_max.compare_exchange_weak(current, valueUs, std::memory_order_relaxed)) {}
+}
+
+LatencySummary LatencyHistogram::summary() const {
+	LatencySummary summary = {};
+
+	uint64_t buckets[BUCKET_COUNT] = {};
+	uint64_t total = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		total += buckets[i];
+	}
+
+	if (total == 0) return summary;
+
+	summary.count = total;
+	summary.minUs = m_min.load(std::memory_order_relaxed);
+	summary.maxUs = m_max.load(std::memory_order_relaxed);
+	summary.meanUs = (double)m_sum.load(std::memory_order_relaxed) / (double)m_count.load(std::memory_order_relaxed);
+
+	// Upper bound of the bucket the percentile falls into, never above the real maximum
+	auto percentile = [&](double fraction) {
+		uint64_t target = (uint64_t)(fraction * total + 0.5);
+		if (target < 1) target = 1;
+
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			seen += buckets[i];
+			if (seen >= target) return std::min(bucketUpperBound(i), summary.maxUs);
+		}
+		return summary.maxUs;
+	};
+
+	summary.p50Us = percentile(0.50);
+	summary.p90Us = percentile(0.90);
+	summary.p99Us = percentile(0.99);
+	summary.p999Us = percentile(0.999);
+	return summary;
+}
+
+void LatencyHistogram::reset() {
+	for (auto& bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_min.store(UINT64_MAX, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+LatencyTracer& LatencyTracer::instance() {
+	static LatencyTracer tracer;
+	return tracer;
+}
+
+uint64_t LatencyTracer::nowUs() {
+	// Same clock duaLib stamps reports with
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyTracer::record(LatencyStage stage, uint32_t index, uint64_t receivedAtUs) {
+	if (receivedAtUs == 0 || stage >= LatencyStage::Count || index >= CONTROLLER_COUNT) return;
+
+	std::atomic<uint64_t>& last = m_lastRecorded[(int)stage][index];
+	if (last.exchange(receivedAtUs, std::memory_order_relaxed) == receivedAtUs) return;
+
+	uint64_t now = nowUs();
+	m_histograms[(int)stage].record(now > receivedAtUs ? now - receivedAtUs : 0);
+}
+
+LatencySummary LatencyTracer::summary(LatencyStage stage) const {
+	if (stage >= LatencyStage::Count) return {};
+	return m_histograms[(int)stage].summary();
+}
+
+void LatencyTracer::reset() {
+	for (auto& histogram : m_histograms)
+		histogram.reset();
+}
+
+const char* LatencyTracer::stageName(LatencyStage stage) {
+	switch (stage) {
+		case LatencyStage::Xbox360: return "ViGEm Xbox 360";
+		case LatencyStage::DualShock4: return "ViGEm DualShock 4";
+		case LatencyStage::KeyboardMouse: return "Keyboard and mouse";
+		case LatencyStage::PeerInput: return "Peer input";
+		default: return "Unknown";
+	}
+}
@@ -15,6 +15,8 @@
 #include "controllerHotkey.hpp"
 #include <process.hpp>
 #include "applicationVersion.hpp"
+#include "latencyTracer.hpp"
+#include <ctime>
 
 #define str(string) m_strings.getString(string).c_str()
 #define strr(string) m_strings.getString(string)
@@ -42,11 +44,83 @@ bool MainWindow::about(bool* open) {
 	return true;
 }
 
+bool MainWindow::latency(bool* open) {
+	if (!ImGui::Begin("Input latency", open, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoDocking)) {
+		ImGui::End();
+		return false;
+	}
+
+	ImGui::Text("Time from duaLib reading a report to it reaching each output, in microseconds");
+
+	if (ImGui::BeginTable("latency", 9, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		const char* columns[] = { "Stage", "Count", "Min", "p50", "p90", "p99", "p99.9", "Max", "Mean" };
+		for (const char* column : columns)
+			ImGui::TableSetupColumn(column);
+		ImGui::TableHeadersRow();
+
+		for (int i = 0; i < (int)LatencyStage::Count; i++) {
+			LatencyStage stage = (LatencyStage)i;
+			LatencySummary summary = LatencyTracer::instance().summary(stage);
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(LatencyTracer::stageName(stage));
+			ImGui::TableNextColumn(); ImGui::Text("%llu", (unsigned long long)summary.count);
+			if (summary.count == 0) continue;
+
+			for (uint64_t value : { summary.minUs, summary.p50Us, summary.p90Us, summary.p99Us, summary.p999Us, summary.maxUs }) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)value);
+			}
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", summary.meanUs);
+		}
+
+		ImGui::EndTable();
+	}
+
+	if (ImGui::Button("Reset"))
+		LatencyTracer::instance().reset();
+
+	ImGui::End();
+	return true;
+}
+
+// duaLib always keeps the most recent controller I/O, this writes it out so DUALSENSEY_REPLAY can play it back.
+// coveredUs is how far back the recording has everything, it depends on how many controllers are sending.
+static std::string saveFlightRecording(uint64_t& coveredUs) {
+	std::string directory = sago::getDocumentsFolder() + "/DSY/FlightRecordings/";
+	if (!std::filesystem::is_directory(directory))
+		std::filesystem::create_directories(directory);
+
+	std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	std::tm local{};
+#if !defined(__linux__) && !defined(__APPLE__)
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+
+	char name[64] = {};
+	std::strftime(name, sizeof(name), "Flight-%Y%m%d-%H%M%S.dcap", &local);
+	std::string path = directory + name;
+
+	if (scePadDumpFlightRecorder(path.c_str(), &coveredUs) != SCE_OK) {
+		LOGE("Failed to save flight recording to %s", path.c_str());
+		return "";
+	}
+
+	return path;
+}
+
 static bool showLoadFailedError = false;
 static bool showSetDefaultConfigSuccess = false;
 static bool showControllerNotConnectedError = false;
 bool MainWindow::menuBar(int& currentController, s_scePadSettings& scePadSettings) {
 	static bool openAbout = false;
+	static bool openLatency = false;
+	static bool showFlightRecording = false;
+	static std::string flightRecordingPath = "";
+	static uint64_t flightRecordingCoveredUs = 0;
+	bool saveFlight = false;
 
 	if (ImGui::BeginMainMenuBar()) {
 		if (ImGui::BeginMenu(str("File"))) {
@@ -165,6 +239,9 @@ bool MainWindow::menuBar(int& currentController, s_scePadSettings& scePadSetting
 			ImGui::TextLinkOpenURL("Discord", "https://discord.gg/AFYvxf282U");
 			ImGui::TextLinkOpenURL("GitHub", "https://github.com/WujekFoliarz/DualSenseY-v2/issues");
 			ImGui::MenuItem(str("About"), "", &openAbout);
+			ImGui::MenuItem("Input latency", "", &openLatency);
+			if (ImGui::MenuItem("Save flight recording", "Ctrl+Shift+F"))
+				saveFlight = true;
 
 			ImGui::EndMenu();
 		}
@@ -181,6 +258,39 @@ bool MainWindow::menuBar(int& currentController, s_scePadSettings& scePadSetting
 	}
 
 	if (openAbout) about(&openAbout);
+	if (openLatency) latency(&openLatency);
+
+	if (ImGui::Shortcut(ImGuiMod_Ctrl | ImGuiMod_Shift | ImGuiKey_F, ImGuiInputFlags_RouteGlobal))
+		saveFlight = true;
+
+	if (saveFlight) {
+		flightRecordingPath = saveFlightRecording(flightRecordingCoveredUs);
+		showFlightRecording = true;
+	}
+
+	if (showFlightRecording) {
+		ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+		ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+		ImGui::OpenPopup("Flight recording");
+
+		if (ImGui::BeginPopupModal("Flight recording", &showFlightRecording, ImGuiWindowFlags_AlwaysAutoResize)) {
+			if (flightRecordingPath.empty()) {
+				ImGui::Text("Failed to save the flight recording");
+			}
+			else {
+				ImGui::Text("Saved the last %.1f seconds of controller input and output to", flightRecordingCoveredUs / 1000000.0);
+				ImGui::TextUnformatted(flightRecordingPath.c_str());
+			}
+			ImGui::Separator();
+
+			if (ImGui::Button("OK", ImVec2(120, 0))) {
+				ImGui::CloseCurrentPopup();
+				showFlightRecording = false;
+			}
+
+			ImGui::EndPopup();
+		}
+	}
 
 	return true;
 }
@@ -189,10 +299,12 @@ bool MainWindow::controllers(int& currentController, s_scePadSettings& scePadSet
 	ImGui::SeparatorText("Controller");
 
 	bool noneConnected = true;
-	for (uint32_t i = 0; i < 4; i++) {
-		s_ScePadData data = {};
-		int result = scePadReadState(g_scePad[i], &data);
-		if (result == SCE_OK) {
+	s_ScePadData data[CONTROLLER_COUNT] = {};
+	uint32_t validMask = 0;
+	scePadReadStateMulti(reinterpret_cast<const int*>(g_scePad), data, CONTROLLER_COUNT, &validMask, nullptr);
+
+	for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
+		if (validMask & (1u << i)) {
 			noneConnected = false;
 			ImGui::RadioButton(std::to_string(i + 1).c_str(), &currentController, i);
 			ImGui::SameLine();
@@ -1074,7 +1186,7 @@ bool MainWindow::emulation(int currentController, s_scePadSettings& scePadSettin
 	return true;
 }
 
-void MainWindow::show(s_scePadSettings scePadSettings[4], float scale) {
+void MainWindow::show(s_scePadSettings scePadSettings[CONTROLLER_COUNT], float scale) {
 	static int c = 0;
 	scale = 100 * (scale * 2.5);
 
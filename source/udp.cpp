@@ -24,6 +24,41 @@ std::string getFormattedDateTime() {
 	return oss.str();
 }
 
+void UDP::handlePacket(const char* buffer) {
+	nlohmann::json packetJson = nlohmann::json::parse(buffer);
+	Packet packet = {};
+	packet.from_json(packetJson);
+
+	for (auto& instr : packet.instructions) {
+		// I don't care enough to implement the rest, if you wanna do it go ahead.
+		switch (instr.type) {
+			case InstructionType::GetDSXStatus:
+				break;
+			case InstructionType::TriggerUpdate:
+				handleTriggerUpdate(instr);
+				break;
+			case InstructionType::RGBUpdate:
+				handleRgbUpdate(instr);
+				break;
+			case InstructionType::PlayerLED:
+				break;
+			case InstructionType::TriggerThreshold:
+				handleTriggerThresholdUpdate(instr);
+				break;
+			case InstructionType::MicLED:
+				break;
+			case InstructionType::PlayerLEDNewRevision:
+				break;
+			case InstructionType::ResetToUserSettings:
+				break;
+		}
+
+		LOGI("[UDP] Instruction type: %d", instr.type);
+	}
+
+	m_lastUpdate = std::chrono::steady_clock::now();
+}
+
 void UDP::listen() {
 	while (m_threadRunning) {
 		char buffer[1024] = {};
@@ -32,45 +67,14 @@ void UDP::listen() {
 			size_t length = m_socket.receive_from(asio::buffer(buffer), senderEndpoint);
 			LOGI("[UDP] Received packet with length %d", length);
 			LOGI("[UDP] Raw packet:\n%s", buffer);
-			nlohmann::json packetJson = nlohmann::json::parse(buffer);
-			Packet packet = {};
-			packet.from_json(packetJson);
-
-			for (auto& instr : packet.instructions) {
-				// I don't care enough to implement the rest, if you wanna do it go ahead.
-				switch (instr.type) {
-					case InstructionType::GetDSXStatus:
-						break;
-					case InstructionType::TriggerUpdate:
-						handleTriggerUpdate(instr);
-						break;
-					case InstructionType::RGBUpdate:
-						handleRgbUpdate(instr);
-						break;
-					case InstructionType::PlayerLED:
-						break;
-					case InstructionType::TriggerThreshold:
-						handleTriggerThresholdUpdate(instr);
-						break;
-					case InstructionType::MicLED:
-						break;
-					case InstructionType::PlayerLEDNewRevision:
-						break;
-					case InstructionType::ResetToUserSettings:
-						break;
-				}
-
-				LOGI("[UDP] Instruction type: %d", instr.type);
-			}
-
-			m_lastUpdate = std::chrono::steady_clock::now();
+			handlePacket(buffer);
 
 			ServerResponse response = {};
 			response.status = "DSX Received UDP Instructions";
 			response.timeReceived = getFormattedDateTime();
 			response.batteryLevel = 100;
 
-			for (uint32_t i = 0; i < 4; i++) {
+			for (uint32_t i = 0; i < CONTROLLER_COUNT; i++) {
 				s_SceControllerType controllerType = {};
 				s_ScePadInfo scePadInfo = {};
 				int busType = 0;
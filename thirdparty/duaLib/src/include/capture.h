@@ -0,0 +1,182 @@
+#ifndef DUALIB_CAPTURE
+#define DUALIB_CAPTURE
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "transport.h"
+
+// Capture file layout: a captureFileHeader followed by records. Every record is a captureRecordHeader
+// followed by its payload, padded so the next record starts 8 byte aligned. Files are only ever
+// appended to and can be mapped and walked in place.
+#define CAPTURE_MAGIC "DUALCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_ALIGNMENT 8
+
+#pragma pack(push, 1)
+struct captureFileHeader {
+	char magic[8];         // CAPTURE_MAGIC
+	uint32_t version;      // CAPTURE_VERSION
+	uint32_t headerSize;   // Records start here
+	uint64_t createdAtNs;  // System clock, only informational
+};
+
+enum class captureRecordType : uint8_t {
+	Device = 1,  // First time a device got opened: vendorID, productID, busType, then path and serial, both 0 terminated
+	Open,
+	Close,
+	Input,       // What a read returned
+	ReadError,   // A read that failed, payload is the return value
+	Output,      // What got written
+	FeatureGet,  // Answer to a get feature report, starts with the report ID
+	FeatureSend,
+	ApiCall      // captureApiCallRecord followed by the arguments, device is always CAPTURE_NO_DEVICE
+};
+
+// scePadSet* call an ApiCall record stands for, see flightRecorder.h
+enum class captureApiCall : uint8_t {
+	SetLightBar = 1,                  // s_SceLightBar
+	ResetLightBar,
+	SetTriggerEffect,                 // ScePadTriggerEffectParam
+	SetTriggerEffectCustom,           // left[11], right[11], triggerBitmask
+	SetVibration,                     // s_ScePadVibrationParam
+	SetVibrationMode,                 // int
+	SetVolumeGain,                    // s_ScePadVolumeGain
+	SetAudioOutPath,                  // int
+	SetPlayerLed,                     // bool
+	SetPlayerLedBrightness,           // int
+	SetMotionSensorState,             // bool
+	SetTiltCorrectionState,           // bool
+	SetAngularVelocityDeadbandState,  // bool
+	ResetOrientation,
+	StartGyroBiasEstimation
+};
+
+struct captureRecordHeader {
+	uint64_t timeNs;  // Steady clock since the recording started
+	uint32_t size;    // Payload bytes without the padding
+	uint16_t device;  // Devices are numbered in order of their Device record
+	uint8_t type;     // captureRecordType
+	uint8_t reserved;
+};
+
+struct captureDeviceRecord {
+	uint16_t vendorID;
+	uint16_t productID;
+	uint8_t busType;
+	// path\0serial\0
+};
+
+struct captureApiCallRecord {
+	int32_t handle;
+	uint8_t function; // captureApiCall
+	uint8_t reserved[3];
+};
+#pragma pack(pop)
+
+#define CAPTURE_NO_DEVICE 0xFFFF
+
+static_assert(sizeof(captureFileHeader) % CAPTURE_ALIGNMENT == 0 && sizeof(captureRecordHeader) % CAPTURE_ALIGNMENT == 0);
+
+captureFileHeader makeCaptureFileHeader();
+// Appends one record with its padding to buffer
+void appendCaptureRecord(std::vector<uint8_t>& buffer, captureRecordType type, uint16_t device, uint64_t timeNs, const void* data, size_t size);
+// Payload of a Device record
+std::vector<uint8_t> captureDevicePayload(const transportDeviceInfo& info);
+
+// Appends records to a capture file. append() only copies into memory, a background thread does
+// the file writes so recording stays off the readers' critical path.
+class captureWriter {
+public:
+	captureWriter() = default;
+	~captureWriter();
+
+	bool open(const std::string& path);
+	// Writes out everything appended so far and closes the file
+	void close();
+	bool isOpen() const;
+
+	void append(captureRecordType type, uint16_t device, uint64_t timeNs, const void* data, size_t size);
+
+private:
+	void flushLoop();
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::vector<uint8_t> m_pending;
+	std::FILE* m_file = nullptr;
+	std::thread m_thread;
+	bool m_stop = false;
+};
+
+// Passes everything through to another transport and records it
+class recordingTransport : public deviceTransport {
+public:
+	explicit recordingTransport(deviceTransport& inner);
+	~recordingTransport() override;
+
+	bool start(const std::string& path);
+	void stop();
+
+	int init() override;
+	std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) override;
+	transportDevice* open(const std::string& path) override;
+	void close(transportDevice* device) override;
+	int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) override;
+	int write(transportDevice* device, const unsigned char* data, size_t length) override;
+	int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) override;
+	int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) override;
+
+private:
+	uint64_t now() const;
+	uint16_t deviceIndex(transportDevice* device);
+
+	deviceTransport& m_inner;
+	captureWriter m_writer;
+	std::chrono::steady_clock::time_point m_start;
+	std::mutex m_lock;
+	std::unordered_map<std::string, transportDeviceInfo> m_enumerated;
+	std::unordered_map<std::string, uint16_t> m_devicesByPath;
+	std::unordered_map<transportDevice*, uint16_t> m_devices;
+};
+
+// Plays a capture file back as if its devices were connected. Input reports come out at their
+// recorded times divided by speed, a speed of 0 hands them out as fast as they're read, which
+// makes every run see exactly the same reports. Feature reports get the recorded answers.
+class replayTransport : public deviceTransport {
+public:
+	replayTransport();
+	~replayTransport() override;
+
+	bool load(const std::string& path, double speed = 1.0);
+	// Every device that got opened has run out of recorded input
+	bool finished() const;
+	uint64_t writesReceived() const;
+
+	int init() override;
+	std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) override;
+	transportDevice* open(const std::string& path) override;
+	void close(transportDevice* device) override;
+	int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) override;
+	int write(transportDevice* device, const unsigned char* data, size_t length) override;
+	int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) override;
+	int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) override;
+
+	struct device; // Defined in capture.cpp
+
+private:
+	std::vector<uint8_t> m_file;
+	std::vector<std::unique_ptr<device>> m_devices; // Indexed like the Device records
+	double m_speed = 1.0;
+	mutable std::mutex m_lock;
+	uint64_t m_writes = 0;
+};
+
+#endif // DUALIB_CAPTURE
@@ -4,7 +4,7 @@
 #include <cstdint>
 #include <cstddef>
 
-const uint32_t hashTable[256] = {
+constexpr uint32_t hashTable[256] = {
 	0xd202ef8d, 0xa505df1b, 0x3c0c8ea1, 0x4b0bbe37, 0xd56f2b94, 0xa2681b02,
 	0x3b614ab8, 0x4c667a2e, 0xdcd967bf, 0xabde5729, 0x32d70693, 0x45d03605,
 	0xdbb4a3a6, 0xacb39330, 0x35bac28a, 0x42bdf21c, 0xcfb5ffe9, 0xb8b2cf7f,
@@ -49,8 +49,19 @@ const uint32_t hashTable[256] = {
 	0x86dcb8a4, 0xf1db8832, 0x616495a3, 0x1663a535, 0x8f6af48f, 0xf86dc419,
 	0x660951ba, 0x110e612c, 0x88073096, 0xff000000 };
 
-const uint32_t crcSeed = 0xeada2d49;
+constexpr uint32_t crcSeed = 0xeada2d49;
 
+// Picks the fastest implementation the CPU supports on first use
 uint32_t compute(unsigned char* buffer, size_t len);
+// Same for reports that aren't output reports, prefix is 0xA1 for input and 0xA3 for feature reports
+uint32_t computeWithPrefix(unsigned char prefix, const unsigned char* buffer, size_t len);
+// Reference implementations, compute() has to match them for every input. seed is the CRC after the
+// report prefix, crcSeed (hashTable[0xA2]) for output reports and hashTable[prefix] for the others.
+uint32_t computeBytewise(unsigned char* buffer, size_t len, uint32_t seed = crcSeed);
+uint32_t computeSliceBy8(unsigned char* buffer, size_t len, uint32_t seed = crcSeed);
+// The carry-less multiply path on its own so it can be checked, falls back to slice-by-8 when
+// crcPclmulSupported() is false
+bool crcPclmulSupported();
+uint32_t computePclmul(unsigned char* buffer, size_t len, uint32_t seed = crcSeed);
 
 #endif // DUALIB_CRC
\ No newline at end of file
@@ -85,6 +85,28 @@ namespace dualsenseData {
 		uint8_t Pad[3]; // Size according to Linux driver
 	};
 
+	struct ReportFeatureInCalibration {
+		uint8_t ReportID; // 0x05
+		int16_t GyroPitchBias;
+		int16_t GyroYawBias;
+		int16_t GyroRollBias;
+		int16_t GyroPitchPlus;
+		int16_t GyroPitchMinus;
+		int16_t GyroYawPlus;
+		int16_t GyroYawMinus;
+		int16_t GyroRollPlus;
+		int16_t GyroRollMinus;
+		int16_t GyroSpeedPlus; // deg/s the plus/minus values were taken at
+		int16_t GyroSpeedMinus;
+		int16_t AccelXPlus; // Raw values at +1g/-1g
+		int16_t AccelXMinus;
+		int16_t AccelYPlus;
+		int16_t AccelYMinus;
+		int16_t AccelZPlus;
+		int16_t AccelZMinus;
+		uint8_t Pad[6]; // Size according to Linux driver
+	};
+
 	struct ReportFeatureInVersion {
 		union {
 			BTCRC<64> CRC;
@@ -634,6 +656,31 @@ namespace dualshock4Data {
 		};
 	};
 
+	struct ReportFeatureInCalibration {
+		uint8_t ReportID; // 0x02 (0x05 for BT)
+		int16_t GyroPitchBias;
+		int16_t GyroYawBias;
+		int16_t GyroRollBias;
+		int16_t GyroRange[6]; // USB: pitch+, pitch-, yaw+, yaw-, roll+, roll-
+		                      // BT and the wireless adaptor: pitch+, yaw+, roll+, pitch-, yaw-, roll-
+		int16_t GyroSpeedPlus; // deg/s the plus/minus values were taken at
+		int16_t GyroSpeedMinus;
+		int16_t AccelXPlus; // Raw values at +1g/-1g
+		int16_t AccelXMinus;
+		int16_t AccelYPlus;
+		int16_t AccelYMinus;
+		int16_t AccelZPlus;
+		int16_t AccelZMinus;
+		uint8_t Pad[2]; // Size according to Linux driver
+	};
+
+	struct ReportFeatureInCalibrationBT {
+		union {
+			BTCRC<41> CRC;
+			ReportFeatureInCalibration Data; // with ReportID 0x05
+		};
+	};
+
 	enum AudioOutput : uint8_t {
 		HeadsetStereo = 0,  // Left and Right to headphones
 		HeadsetMono,        // Left to headphones
@@ -0,0 +1,25 @@
+﻿#ifndef DUALIB_DEVICE_CACHE
+#define DUALIB_DEVICE_CACHE
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "dataStructures.h"
+
+// What a controller tells us about itself through feature reports (and SetupAPI on Windows) when it
+// connects. Kept on disk so a controller that comes back can start streaming before asking again.
+struct deviceMetadata {
+	std::string macAddress;
+	std::string containerId;
+	uint32_t containerIdSize = 0;
+	bool hasVersionReport = false;
+	dualsenseData::ReportFeatureInVersion versionReport = {};
+};
+
+// Entries are keyed by device path and serial number, returns false if there's nothing cached.
+// Paths get reused by other controllers, so devices without a serial number never get cached.
+bool loadDeviceMetadata(const std::string& path, const std::string& serial, deviceMetadata& metadata);
+// Only touches the file when the entry actually changed
+void storeDeviceMetadata(const std::string& path, const std::string& serial, const deviceMetadata& metadata);
+
+#endif // DUALIB_DEVICE_CACHE
@@ -369,6 +369,29 @@ enum s_SceControllerType {
 #define SCE_PAD_BUSTYPE_USB 1
 #define SCE_PAD_BUSTYPE_BT 2
 
+// Link states, see s_ScePadIoStatistics
+#define SCE_PAD_LINK_STATE_CONNECTED 0
+#define SCE_PAD_LINK_STATE_STALLED 1
+#define SCE_PAD_LINK_STATE_RECOVERING 2
+#define SCE_PAD_LINK_STATE_LOST 3
+
+// Reader modes
+#define SCE_PAD_READER_MODE_BLOCKING 0 // One reader per controller, wakes up when a report arrives
+#define SCE_PAD_READER_MODE_POLL 1     // One reader per shard polling its controllers in a loop, see s_ScePadReaderThreadParam
+
+// Gyro bias estimation states, see scePadStartGyroBiasEstimation
+#define SCE_PAD_BIAS_ESTIMATION_IDLE 0
+#define SCE_PAD_BIAS_ESTIMATION_RUNNING 1
+#define SCE_PAD_BIAS_ESTIMATION_DONE 2
+#define SCE_PAD_BIAS_ESTIMATION_FAILED 3 // The controller moved, it has to lie still for the whole measurement
+
+#define SCE_PAD_RAW_STATE_SIZE 64
+
+// Controller slots, see scePadSetControllerCount
+#define SCE_PAD_DEFAULT_CONTROLLER_COUNT 4
+#define SCE_PAD_MAX_CONTROLLER_COUNT 16
+#define SCE_PAD_MAX_READER_THREADS 16
+
 struct s_ScePadInitParam {
 	uint8_t  customAllocAndFree[16]; // Can be left unused
 	uint32_t allowBT;         // Set to 1 to allow Bluetooth connections, 0 to disable
@@ -376,6 +399,54 @@ struct s_ScePadInitParam {
 	uint32_t  padding2;       
 };
 
+struct s_ScePadIoStatistics {
+	uint64_t reportsRead;         // Every input report read from the device
+	uint64_t staleReportsSkipped; // Reports that were drained from the queue without being published
+	uint64_t writesIssued;        // Output and feature reports sent to the device
+	uint64_t writesSuppressed;    // Output reports that got replaced by a newer one before being sent
+	uint64_t readErrors;          // Failed input reads
+	uint64_t foreignReads;        // Input reads done outside the reader threads, these steal reports and should stay at 0
+	int lastReadError;            // Return value of the last failed read
+	int linkState;                // SCE_PAD_LINK_STATE_*
+	uint32_t msSinceLastReport;
+};
+
+struct s_ScePadSample {
+	s_ScePadData data;
+	uint32_t sensorTimestamp; // Device clock, DualSense counts in 0.33us, DualShock 4 in 5.33us and wraps at 16 bits
+	uint64_t receivedAtUs;    // Host steady clock when the report was read
+	uint64_t sequence;        // Goes up by one for every report received from the controller
+};
+
+// Newest input report exactly as the controller sent it, for fields duaLib doesn't decode
+struct s_ScePadRawState {
+	uint64_t sequence;                   // Same numbering as s_ScePadSample::sequence
+	uint64_t receivedAtUs;               // Host steady clock when the report was read
+	uint32_t sensorTimestamp;
+	s_SceControllerType controllerType;  // DUALSENSE: dualsenseData::USBGetStateData, DUALSHOCK_4: dualshock4Data::USBGetStateData
+	uint32_t size;                       // Valid bytes in state, 0 until the first report arrived
+	uint8_t state[SCE_PAD_RAW_STATE_SIZE]; // Cast to the type above, see dataStructures.h
+};
+
+struct s_ScePadMotionSample {
+	s_SceFVector3 acceleration;    // m/s^2
+	s_SceFVector3 angularVelocity; // rad/s, with the estimated gyro bias removed
+	uint32_t sensorTimestamp;      // Same clock as s_ScePadSample::sensorTimestamp
+	bool calibrated;               // false if the controller's calibration data was missing or unusable
+};
+
+struct s_ScePadOutputSchedulerParam {
+	uint32_t coalesceWindowUs;      // How long lightbar/volume/player LED changes wait for other changes before being sent
+	uint32_t usbMinWriteIntervalUs; // Minimum time between two writes over USB
+	uint32_t btMinWriteIntervalUs;  // Minimum time between two writes over Bluetooth
+};
+
+// Controllers are split into threadCount contiguous shards, in poll mode every shard gets its own reader
+struct s_ScePadReaderThreadParam {
+	uint32_t threadCount;                                 // 0 picks one shard per 4 controllers
+	uint64_t cpuAffinityMask[SCE_PAD_MAX_READER_THREADS]; // CPUs the readers of each shard may run on, 0 leaves it to the OS
+};
+
 #if defined(_WIN32) || defined(_WIN64)
 	#ifdef DUALIB_EXPORTS
 		#define DUALIB_API __declspec(dllexport)
@@ -390,6 +461,8 @@ struct s_ScePadInitParam {
 	#endif
 #endif
 
+class deviceTransport; // See transport.h
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -402,6 +475,11 @@ extern "C" {
  int scePadSetParticularMode(bool mode);
  int scePadGetParticularMode();
  int scePadReadState(int handle, s_ScePadData* data);
+/// scePadReadState plus when the returned report was read from the device (steady clock microseconds, 0 before the first report)
+ int scePadReadStateTimed(int handle, s_ScePadData* data, uint64_t* receivedAtUs);
+/// Reads up to 32 controllers at once, bit i of validMask is set when data[i] holds the state of handles[i].
+/// receivedAtUs can be nullptr, otherwise it gets count receive timestamps like scePadReadStateTimed.
+ int scePadReadStateMulti(const int* handles, s_ScePadData* data, int count, uint32_t* validMask, uint64_t* receivedAtUs);
  int scePadGetContainerIdInformation(int handle, s_ScePadContainerIdInfo* containerIdInfo);
  int scePadSetLightBar(int handle, s_SceLightBar* lightbar);
  int scePadGetHandle(int userID, int unk1, int unk2);
@@ -413,7 +491,8 @@ extern "C" {
  int scePadGetJackState(int handle, int* state);
  int scePadGetTriggerEffectState(int handle, int state[2]);
  int scePadIsControllerUpdateRequired(int handle);
-/// Don't use this. Use scePadReadState instead
+/// Returns every report received since the last scePadRead call on this handle (at most count, up to 64), oldest first.
+/// Concurrent callers split the reports between them, use scePadReadSamples if each of them needs to see all of them.
  int scePadRead(int handle, s_ScePadData* data, int count);
  int scePadResetOrientation(int handle);
  int scePadSetAngularVelocityDeadbandState(int handle, bool state);
@@ -431,6 +510,30 @@ extern "C" {
  std::string scePadGetMacAddress(int handle);
  std::string scePadGetPath(int handle);
  int scePadSetTriggerEffectCustom(int handle, uint8_t left[11], uint8_t right[11], uint8_t triggerBitmask);
+/// Has to be called before scePadInit/scePadInit3
+ int scePadSetReaderMode(int mode);
+/// Has to be called before scePadInit/scePadInit3, nullptr goes back to hidapi. The transport has to outlive duaLib. See capture.h for recording and replaying sessions.
+ int scePadSetTransport(deviceTransport* transport);
+/// Has to be called before scePadInit/scePadInit3, user IDs go from 1 to count
+ int scePadSetControllerCount(int count);
+/// Has to be called before scePadInit/scePadInit3
+ int scePadSetReaderThreadParam(s_ScePadReaderThreadParam* param);
+ int scePadGetIoStatistics(int handle, s_ScePadIoStatistics* stats);
+ int scePadSetOutputSchedulerParam(s_ScePadOutputSchedulerParam* param);
+/// Like scePadRead but with timestamps, the caller keeps its own cursor (start with 0) so several consumers can read the same controller
+ int scePadReadSamples(int handle, s_ScePadSample* samples, int count, uint64_t* cursor);
+/// Newest motion sample, calibrated from the controller's factory calibration by the reader thread
+ int scePadGetMotionSample(int handle, s_ScePadMotionSample* sample);
+/// Measures the gyro bias over the next reports, the controller has to lie still until the state leaves RUNNING
+ int scePadStartGyroBiasEstimation(int handle);
+ int scePadGetGyroBiasEstimationState(int handle, int* state);
+/// Snapshot of the newest raw input report, taken straight from the reader's history without decoding anything
+ int scePadGetRawState(int handle, s_ScePadRawState* state);
+/// The flight recorder keeps the most recent device I/O and scePadSet* calls in memory, about 25s per controller, on by default
+ int scePadSetFlightRecorderState(bool state);
+/// Writes the flight recorder's contents to a capture file that replayTransport can play back, see capture.h.
+/// coveredUs (can be nullptr) gets how far back the file has everything from every controller.
+ int scePadDumpFlightRecorder(const char* path, uint64_t* coveredUs);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,92 @@
+#ifndef DUALIB_FLIGHT_RECORDER
+#define DUALIB_FLIGHT_RECORDER
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "capture.h"
+#include "transport.h"
+
+// Every device gets its own ring so a busy controller can't push the others out. 32768 slots of
+// 192 bytes (6MB) per device is about 25s of 1kHz input plus the output reports that go with it.
+#define FLIGHT_RECORDER_DEVICE_SLOT_BITS 15
+// scePadSet* calls only get recorded when they change something, they share a much smaller ring
+#define FLIGHT_RECORDER_API_SLOT_BITS 12
+#define FLIGHT_RECORDER_SLOT_WORDS 24
+#define FLIGHT_RECORDER_API_CALL_SLOTS 256
+
+// Keeps the most recent device I/O and scePadSet* calls in fixed size rings so a glitch can be looked
+// at after the fact. Sits between duaLib and the real transport. Recording a record is a fetch_add and
+// a copy into its slot, nobody ever waits on anyone. dump() writes a capture file that replayTransport
+// plays back like a normal recording, feature report answers from when the devices got opened are
+// kept outside the rings so a dump replays even after they'd have been overwritten.
+class flightRecorder : public deviceTransport {
+public:
+	flightRecorder();
+	~flightRecorder() override;
+
+	// nullptr goes back to hidapi, only change it while no device is open
+	void setTransport(deviceTransport* transport);
+	// Recording is on by default. reserve() or turning recording on allocates the API call ring, a
+	// device's ring gets allocated when it's opened while recording is on.
+	void setEnabled(bool enabled);
+	bool enabled() const;
+	void reserve();
+
+	// Only recorded when the arguments differ from the last call of the same function on the same handle,
+	// the app repeats most of its calls every frame
+	void apiCall(captureApiCall function, int handle, const void* arguments, size_t size);
+	// Writes out what's in the rings without stopping the recording. coveredUs gets how far back the
+	// dump has everything from every ring, a busy device's ring wraps sooner than a quiet one's.
+	bool dump(const std::string& path, uint64_t* coveredUs = nullptr) const;
+
+	int init() override;
+	std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) override;
+	transportDevice* open(const std::string& path) override;
+	void close(transportDevice* device) override;
+	int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) override;
+	int write(transportDevice* device, const unsigned char* data, size_t length) override;
+	int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) override;
+	int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) override;
+
+	struct device;      // Defined in flightRecorder.cpp
+	struct knownDevice; // Defined in flightRecorder.cpp
+
+private:
+	// sequence is 2 * ticket + 1 while the slot is being written and 2 * ticket + 2 once it's done
+	struct alignas(64) slot {
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> words[FLIGHT_RECORDER_SLOT_WORDS - 1]; // timeNs, size | device << 32 | type << 48, payload
+	};
+
+	struct ring {
+		explicit ring(int slotBits);
+
+		std::unique_ptr<slot[]> slots;
+		size_t mask = 0;
+		std::atomic<uint64_t> head = 0;
+	};
+
+	static constexpr size_t payloadCapacity = (FLIGHT_RECORDER_SLOT_WORDS - 3) * sizeof(uint64_t);
+
+	deviceTransport& inner() const;
+	void allocateRings(); // Needs m_lock
+	void record(ring* target, captureRecordType type, uint16_t device, const void* data, size_t size);
+
+	std::atomic<deviceTransport*> m_inner = nullptr;
+	std::atomic<bool> m_enabled = true;
+	std::atomic<ring*> m_apiCalls = nullptr;
+	std::atomic<uint64_t> m_startedNs = 0; // When the API call ring got allocated
+	std::atomic<uint64_t> m_lastApiCalls[FLIGHT_RECORDER_API_CALL_SLOTS] = {};
+
+	mutable std::mutex m_lock; // Everything below, only taken when devices come and go
+	std::unique_ptr<ring> m_apiCallStorage;
+	std::unordered_map<std::string, transportDeviceInfo> m_enumerated;
+	std::vector<std::unique_ptr<knownDevice>> m_known; // Indexed like the Device records of a dump, never shrinks
+};
+
+#endif // DUALIB_FLIGHT_RECORDER
@@ -0,0 +1,126 @@
+#ifndef DUALIB_INPUT_DECODER
+#define DUALIB_INPUT_DECODER
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "duaLib.h"
+#include "dataStructures.h"
+
+// Both report types keep their buttons in three bytes with the same layout: DPad + face buttons,
+// shoulder/stick buttons, PS/touchpad(/mute). Every possible byte value is looked up instead of
+// testing each bit.
+constexpr uint32_t g_dpadButtons[16] = {
+	SCE_BM_N_DPAD, SCE_BM_N_DPAD | SCE_BM_E_DPAD, SCE_BM_E_DPAD, SCE_BM_S_DPAD | SCE_BM_E_DPAD,
+	SCE_BM_S_DPAD, SCE_BM_S_DPAD | SCE_BM_W_DPAD, SCE_BM_W_DPAD, SCE_BM_N_DPAD | SCE_BM_W_DPAD,
+	0, 0, 0, 0, 0, 0, 0, 0 // Direction::None
+};
+
+constexpr std::array<uint32_t, 256> buttonTable(std::array<uint32_t, 8> bits, bool dpad) {
+	std::array<uint32_t, 256> table = {};
+
+	for (int value = 0; value < 256; value++) {
+		uint32_t buttons = dpad ? g_dpadButtons[value & 0x0F] : 0;
+
+		for (int bit = dpad ? 4 : 0; bit < 8; bit++) {
+			if (value & (1 << bit))
+				buttons |= bits[bit];
+		}
+
+		table[value] = buttons;
+	}
+
+	return table;
+}
+
+constexpr auto g_faceButtons = buttonTable({ 0, 0, 0, 0, SCE_BM_SQUARE, SCE_BM_CROSS, SCE_BM_CIRCLE, SCE_BM_TRIANGLE }, true);
+constexpr auto g_shoulderButtons = buttonTable({ SCE_BM_L1, SCE_BM_R1, SCE_BM_L2, SCE_BM_R2, SCE_BM_SHARE, SCE_BM_OPTIONS, SCE_BM_L3, SCE_BM_R3 }, false);
+constexpr auto g_systemButtons = buttonTable({ SCE_BM_PSBTN, SCE_BM_TOUCH, SCE_BM_MICBUTTON, 0, 0, 0, 0, 0 }, false);
+
+// Where the two report types differ
+template <typename T>
+struct reportLayout;
+
+template <>
+struct reportLayout<dualsenseData::USBGetStateData> {
+	static constexpr size_t buttons = 7; // See the offsets in dataStructures.h
+	static constexpr uint8_t systemButtonMask = 0x07; // PS, touchpad, mute
+
+	static uint64_t timestamp(const dualsenseData::USBGetStateData& input) {
+		return input.DeviceTimeStamp;
+	}
+
+	static void touch(const dualsenseData::USBGetStateData& input, s_ScePadTouchData& touchData) {
+		touchData.touchNum = (input.touchData.Finger[0].NotTouching > 0 ? 0 : 1) + (input.touchData.Finger[1].NotTouching > 0 ? 0 : 1);
+
+		for (int i = 0; i < 2; i++) {
+			touchData.touch[i].id = input.touchData.Finger[i].Index;
+			touchData.touch[i].x = input.touchData.Finger[i].FingerX;
+			touchData.touch[i].y = input.touchData.Finger[i].FingerY;
+			touchData.touch[i].reserve[0] = input.touchData.Finger[i].NotTouching;
+		}
+	}
+};
+
+template <>
+struct reportLayout<dualshock4Data::USBGetStateData> {
+	static constexpr size_t buttons = 4;
+	static constexpr uint8_t systemButtonMask = 0x03; // PS, touchpad, the rest is the report counter
+
+	static uint64_t timestamp(const dualshock4Data::USBGetStateData& input) {
+		return input.Timestamp;
+	}
+
+	static void touch(const dualshock4Data::USBGetStateData& input, s_ScePadTouchData& touchData) {
+		touchData.touchNum = (input.Finger1Active > 0 ? 0 : 1) + (input.Finger2Active > 0 ? 0 : 1);
+
+		touchData.touch[0].id = input.Finger1ID;
+		touchData.touch[0].x = input.Finger1X;
+		touchData.touch[0].y = input.Finger1Y;
+		touchData.touch[0].reserve[0] = input.Finger1Active;
+
+		touchData.touch[1].id = input.Finger2ID;
+		touchData.touch[1].x = input.Finger2X;
+		touchData.touch[1].y = input.Finger2Y;
+		touchData.touch[1].reserve[0] = input.Finger2Active;
+	}
+};
+
+// Everything in s_ScePadData that comes straight from the report: buttons, sticks, triggers, touchpad
+// and timestamp. Motion and orientation need the controller's calibration, duaLib fills those in.
+template <typename T>
+inline void decodeReport(const T& input, s_ScePadData& data) {
+	using layout = reportLayout<T>;
+	const uint8_t* buttons = reinterpret_cast<const uint8_t*>(&input) + layout::buttons;
+
+#pragma region buttons
+	data.bitmask_buttons =
+		g_faceButtons[buttons[0]] |
+		g_shoulderButtons[buttons[1]] |
+		g_systemButtons[buttons[2] & layout::systemButtonMask];
+#pragma endregion
+
+#pragma region sticks
+	data.LeftStick.X = input.LeftStickX;
+	data.LeftStick.Y = input.LeftStickY;
+	data.RightStick.X = input.RightStickX;
+	data.RightStick.Y = input.RightStickY;
+#pragma endregion
+
+#pragma region triggers
+	data.L2_Analog = input.TriggerLeft;
+	data.R2_Analog = input.TriggerRight;
+#pragma endregion
+
+#pragma region touchpad
+	layout::touch(input, data.touchData);
+#pragma endregion
+
+#pragma region misc
+	data.timestamp = layout::timestamp(input);
+	data.deviceUniqueDataLen = sizeof(data.deviceUniqueData);
+	data.connected = true;
+#pragma endregion
+}
+
+#endif // DUALIB_INPUT_DECODER
@@ -0,0 +1,63 @@
+#ifndef DUALIB_SEQLOCK
+#define DUALIB_SEQLOCK
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Single writer, many readers. The writer never waits, readers retry until they got a copy
+// that wasn't written to while they were reading it. The payload is stored as relaxed atomic
+// words so a torn read is never undefined behaviour, it just gets thrown away.
+template <typename T>
+class seqlock {
+	static_assert(std::is_trivially_copyable_v<T>, "seqlock payload has to be trivially copyable");
+
+	static constexpr size_t wordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint32_t> sequence = 0;
+	std::atomic<uint64_t> words[wordCount] = {};
+
+public:
+	// Only ever call this from one thread at a time
+	void store(const T& value) {
+		uint64_t buffer[wordCount] = {};
+		std::memcpy(buffer, &value, sizeof(T));
+
+		uint32_t seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < wordCount; i++)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	T load() const {
+		uint64_t buffer[wordCount];
+		uint32_t before, after;
+
+		do {
+			before = sequence.load(std::memory_order_acquire);
+
+			for (size_t i = 0; i < wordCount; i++)
+				buffer[i] = words[i].load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		T value;
+		std::memcpy(&value, buffer, sizeof(T));
+		return value;
+	}
+
+	// Changes every time a new value gets stored
+	uint32_t version() const {
+		return sequence.load(std::memory_order_acquire) >> 1;
+	}
+};
+
+#endif // DUALIB_SEQLOCK
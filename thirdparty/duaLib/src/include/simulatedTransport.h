@@ -0,0 +1,75 @@
+#ifndef DUALIB_SIMULATED_TRANSPORT
+#define DUALIB_SIMULATED_TRANSPORT
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "dataStructures.h"
+#include "transport.h"
+
+struct simulatedDeviceConfig {
+	uint16_t productID = 0x0ce6;  // DualSense, 0x0df2 for an Edge, 0x05c4/0x09cc for a DualShock 4
+	uint8_t busType = 1;          // 1 USB, 2 Bluetooth (HID_API_BUS_*)
+	uint32_t reportRateHz = 250;
+	uint32_t jitterUs = 0;        // Every report interval is off by up to this much in either direction
+	uint8_t macAddress[6] = {};   // Right to left like in the feature reports, all 0 picks one from the device index
+};
+
+// Output or feature report as duaLib wrote it
+struct capturedReport {
+	std::chrono::steady_clock::time_point writtenAt;
+	bool feature = false;
+	std::vector<uint8_t> data;
+};
+
+// Stands in for hidapi with virtual controllers so the reader, decoder and writer can run without
+// hardware. Input reports are generated on demand when they're due, framed like the real device
+// (Bluetooth ones with a valid CRC), and the MAC, version and calibration feature reports get
+// answered. Everything written to a device is captured. Pass it to scePadSetTransport before init.
+class simulatedTransport : public deviceTransport {
+public:
+	simulatedTransport();
+	~simulatedTransport() override;
+
+	// Returns the device index, new devices show up with the next enumeration
+	int addDevice(const simulatedDeviceConfig& config);
+	// A disconnected device fails every read and disappears from enumeration
+	void setConnected(int device, bool connected);
+	// Takes effect with the next report
+	void setReportRate(int device, uint32_t reportRateHz);
+	// Sent with every following report, counters and timestamps are filled in by the device
+	void setInput(int device, const dualsenseData::USBGetStateData& state);
+	void setInput(int device, const dualshock4Data::USBGetStateData& state);
+	// Everything written to the device since the last call, oldest first
+	std::vector<capturedReport> takeOutputReports(int device);
+	// How long every report read since the last call waited after it was due, in microseconds
+	std::vector<uint32_t> takeReadDelays(int device);
+	uint64_t reportsSent(int device) const;
+	// Handles opened to the device and not closed yet
+	int openHandles(int device) const;
+	// Output reports that got thrown away because nobody took them in time
+	uint64_t outputReportsDropped(int device) const;
+	int deviceCount() const;
+
+	int init() override;
+	std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) override;
+	transportDevice* open(const std::string& path) override;
+	void close(transportDevice* device) override;
+	int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) override;
+	int write(transportDevice* device, const unsigned char* data, size_t length) override;
+	int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) override;
+	int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) override;
+
+	struct device; // Defined in simulatedTransport.cpp
+
+private:
+	device* find(int index) const;
+
+	mutable std::mutex m_lock;
+	std::vector<std::unique_ptr<device>> m_devices; // Never shrinks, handed out pointers stay valid
+};
+
+#endif // DUALIB_SIMULATED_TRANSPORT
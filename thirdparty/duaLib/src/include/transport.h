@@ -0,0 +1,41 @@
+#ifndef DUALIB_TRANSPORT
+#define DUALIB_TRANSPORT
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What duaLib needs to know about a device before opening it, mirrors hid_device_info
+struct transportDeviceInfo {
+	std::string path;
+	std::string serial;
+	uint16_t vendorID = 0;
+	uint16_t productID = 0;
+	uint8_t busType = 0; // HID_API_BUS_*, same values as SCE_PAD_BUSTYPE_*
+};
+
+// Whatever a transport hands out from open(), only ever passed back to the same transport
+struct transportDevice;
+
+// Every device access of duaLib goes through one of these. hidTransport() is the default, see
+// scePadSetTransport for swapping in something else. The calls and return values mirror hidapi.
+class deviceTransport {
+public:
+	virtual ~deviceTransport() = default;
+
+	virtual int init() = 0;
+	virtual std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) = 0;
+	virtual transportDevice* open(const std::string& path) = 0;
+	virtual void close(transportDevice* device) = 0;
+	// Returns the number of bytes read, 0 on timeout and -1 on error. A negative timeout blocks.
+	virtual int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) = 0;
+	virtual int write(transportDevice* device, const unsigned char* data, size_t length) = 0;
+	// data[0] holds the report ID
+	virtual int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) = 0;
+	virtual int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) = 0;
+};
+
+deviceTransport& hidTransport();
+
+#endif // DUALIB_TRANSPORT
@@ -0,0 +1,493 @@
+﻿#include "capture.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#define CAPTURE_FLUSH_BYTES (256 * 1024)
+#define CAPTURE_FLUSH_INTERVAL_MS 100
+
+static size_t alignedSize(size_t size) {
+	return (size + CAPTURE_ALIGNMENT - 1) & ~(size_t)(CAPTURE_ALIGNMENT - 1);
+}
+
+captureFileHeader makeCaptureFileHeader() {
+	captureFileHeader header = {};
+	std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+	header.version = CAPTURE_VERSION;
+	header.headerSize = sizeof(captureFileHeader);
+	header.createdAtNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	return header;
+}
+
+void appendCaptureRecord(std::vector<uint8_t>& buffer, captureRecordType type, uint16_t device, uint64_t timeNs, const void* data, size_t size) {
+	captureRecordHeader header = {};
+	header.timeNs = timeNs;
+	header.size = (uint32_t)size;
+	header.device = device;
+	header.type = (uint8_t)type;
+
+	size_t offset = buffer.size();
+	buffer.resize(offset + sizeof(header) + alignedSize(size));
+	std::memcpy(buffer.data() + offset, &header, sizeof(header));
+	if (size > 0) std::memcpy(buffer.data() + offset + sizeof(header), data, size);
+	std::memset(buffer.data() + offset + sizeof(header) + size, 0, alignedSize(size) - size);
+}
+
+std::vector<uint8_t> captureDevicePayload(const transportDeviceInfo& info) {
+	captureDeviceRecord record = {};
+	record.vendorID = info.vendorID;
+	record.productID = info.productID;
+	record.busType = info.busType;
+
+	std::vector<uint8_t> payload(sizeof(record) + info.path.size() + 1 + info.serial.size() + 1);
+	std::memcpy(payload.data(), &record, sizeof(record));
+	std::memcpy(payload.data() + sizeof(record), info.path.c_str(), info.path.size() + 1);
+	std::memcpy(payload.data() + sizeof(record) + info.path.size() + 1, info.serial.c_str(), info.serial.size() + 1);
+	return payload;
+}
+
+#pragma region captureWriter
+captureWriter::~captureWriter() {
+	close();
+}
+
+bool captureWriter::open(const std::string& path) {
+	close();
+
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file) return false;
+
+	captureFileHeader header = makeCaptureFileHeader();
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+		std::fclose(file);
+		return false;
+	}
+
+	std::lock_guard guard(m_lock);
+	m_file = file;
+	m_stop = false;
+	m_pending.clear();
+	m_pending.reserve(CAPTURE_FLUSH_BYTES * 2);
+	m_thread = std::thread(&captureWriter::flushLoop, this);
+	return true;
+}
+
+void captureWriter::close() {
+	{
+		std::lock_guard guard(m_lock);
+		if (!m_file) return;
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+	if (m_thread.joinable()) m_thread.join();
+
+	std::lock_guard guard(m_lock);
+	std::fclose(m_file);
+	m_file = nullptr;
+}
+
+bool captureWriter::isOpen() const {
+	std::lock_guard guard(m_lock);
+	return m_file != nullptr && !m_stop;
+}
+
+void captureWriter::append(captureRecordType type, uint16_t device, uint64_t timeNs, const void* data, size_t size) {
+	std::lock_guard guard(m_lock);
+	if (!m_file || m_stop) return;
+
+	appendCaptureRecord(m_pending, type, device, timeNs, data, size);
+	if (m_pending.size() >= CAPTURE_FLUSH_BYTES) m_wake.notify_one();
+}
+
+void captureWriter::flushLoop() {
+	// Swapped with m_pending so neither side ever has to grow its buffer again
+	std::vector<uint8_t> writing;
+	writing.reserve(CAPTURE_FLUSH_BYTES * 2);
+
+	std::unique_lock guard(m_lock);
+	while (true) {
+		m_wake.wait_for(guard, std::chrono::milliseconds(CAPTURE_FLUSH_INTERVAL_MS), [this] {
+			return m_stop || m_pending.size() >= CAPTURE_FLUSH_BYTES;
+		});
+
+		bool stop = m_stop;
+		writing.swap(m_pending);
+		std::FILE* file = m_file;
+		guard.unlock();
+
+		if (!writing.empty()) {
+			std::fwrite(writing.data(), 1, writing.size(), file);
+			std::fflush(file);
+			writing.clear();
+		}
+
+		if (stop) return;
+		guard.lock();
+	}
+}
+#pragma endregion
+
+#pragma region recordingTransport
+recordingTransport::recordingTransport(deviceTransport& inner) : m_inner(inner), m_start(std::chrono::steady_clock::now()) {}
+
+recordingTransport::~recordingTransport() {
+	stop();
+}
+
+bool recordingTransport::start(const std::string& path) {
+	m_start = std::chrono::steady_clock::now();
+	return m_writer.open(path);
+}
+
+void recordingTransport::stop() {
+	m_writer.close();
+}
+
+uint64_t recordingTransport::now() const {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+uint16_t recordingTransport::deviceIndex(transportDevice* device) {
+	std::lock_guard guard(m_lock);
+	auto it = m_devices.find(device);
+	return it != m_devices.end() ? it->second : CAPTURE_NO_DEVICE;
+}
+
+int recordingTransport::init() {
+	return m_inner.init();
+}
+
+std::vector<transportDeviceInfo> recordingTransport::enumerate(uint16_t vendorID, uint16_t productID) {
+	std::vector<transportDeviceInfo> devices = m_inner.enumerate(vendorID, productID);
+
+	// Only devices that get opened end up in the file
+	std::lock_guard guard(m_lock);
+	for (const transportDeviceInfo& info : devices)
+		m_enumerated[info.path] = info;
+
+	return devices;
+}
+
+transportDevice* recordingTransport::open(const std::string& path) {
+	transportDevice* device = m_inner.open(path);
+	if (!device) return nullptr;
+
+	uint64_t time = now();
+	std::unique_lock guard(m_lock);
+
+	auto known = m_devicesByPath.find(path);
+	uint16_t index = 0;
+
+	if (known != m_devicesByPath.end()) {
+		index = known->second;
+	}
+	else {
+		index = (uint16_t)m_devicesByPath.size();
+		m_devicesByPath[path] = index;
+
+		transportDeviceInfo info = {};
+		info.path = path;
+		auto enumerated = m_enumerated.find(path);
+		if (enumerated != m_enumerated.end()) info = enumerated->second;
+
+		std::vector<uint8_t> payload = captureDevicePayload(info);
+		m_writer.append(captureRecordType::Device, index, time, payload.data(), payload.size());
+	}
+
+	m_devices[device] = index;
+	guard.unlock();
+
+	m_writer.append(captureRecordType::Open, index, time, nullptr, 0);
+	return device;
+}
+
+void recordingTransport::close(transportDevice* device) {
+	uint16_t index = deviceIndex(device);
+	m_inner.close(device);
+
+	{
+		std::lock_guard guard(m_lock);
+		m_devices.erase(device);
+	}
+
+	if (index != CAPTURE_NO_DEVICE) m_writer.append(captureRecordType::Close, index, now(), nullptr, 0);
+}
+
+int recordingTransport::read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) {
+	int res = m_inner.read(device, data, length, timeoutMs);
+	if (res == 0) return res;
+
+	uint64_t time = now();
+	uint16_t index = deviceIndex(device);
+
+	if (res > 0)
+		m_writer.append(captureRecordType::Input, index, time, data, (size_t)res);
+	else
+		m_writer.append(captureRecordType::ReadError, index, time, &res, sizeof(res));
+
+	return res;
+}
+
+int recordingTransport::write(transportDevice* device, const unsigned char* data, size_t length) {
+	m_writer.append(captureRecordType::Output, deviceIndex(device), now(), data, length);
+	return m_inner.write(device, data, length);
+}
+
+int recordingTransport::getFeatureReport(transportDevice* device, unsigned char* data, size_t length) {
+	int res = m_inner.getFeatureReport(device, data, length);
+	if (res > 0) m_writer.append(captureRecordType::FeatureGet, deviceIndex(device), now(), data, (size_t)res);
+	return res;
+}
+
+int recordingTransport::sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) {
+	m_writer.append(captureRecordType::FeatureSend, deviceIndex(device), now(), data, length);
+	return m_inner.sendFeatureReport(device, data, length);
+}
+#pragma endregion
+
+#pragma region replayTransport
+struct replayTransport::device {
+	transportDeviceInfo info = {};
+	std::vector<const captureRecordHeader*> input = {};    // Input and ReadError records in order
+	std::vector<const captureRecordHeader*> features = {}; // FeatureGet records in order
+	std::unordered_map<uint8_t, size_t> featureCursor = {};
+	uint64_t firstOpenNs = 0; // Input times are relative to the first Open record
+	bool recordedOpen = false;
+	std::mutex lock{};
+	std::condition_variable changed{};
+	int openCount = 0;
+	bool started = false;
+	std::chrono::steady_clock::time_point start = {};
+	size_t next = 0;
+};
+
+static const unsigned char* payload(const captureRecordHeader* record) {
+	return reinterpret_cast<const unsigned char*>(record) + sizeof(captureRecordHeader);
+}
+
+static replayTransport::device* replayDevice(transportDevice* handle) {
+	return reinterpret_cast<replayTransport::device*>(handle);
+}
+
+replayTransport::replayTransport() = default;
+replayTransport::~replayTransport() = default;
+
+bool replayTransport::load(const std::string& path, double speed) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) return false;
+
+	std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (file.size() < sizeof(captureFileHeader)) return false;
+
+	const captureFileHeader* header = reinterpret_cast<const captureFileHeader*>(file.data());
+	if (std::memcmp(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 || header->version != CAPTURE_VERSION ||
+		header->headerSize < sizeof(captureFileHeader) || header->headerSize > file.size())
+		return false;
+
+	std::vector<std::unique_ptr<device>> devices;
+	size_t offset = alignedSize(header->headerSize);
+
+	// A recording that got cut off mid record just ends at the last complete one
+	while (offset + sizeof(captureRecordHeader) <= file.size()) {
+		const captureRecordHeader* record = reinterpret_cast<const captureRecordHeader*>(file.data() + offset);
+		if (record->size > file.size() - offset - sizeof(captureRecordHeader)) break;
+		offset += sizeof(captureRecordHeader) + alignedSize(record->size);
+
+		captureRecordType type = (captureRecordType)record->type;
+
+		if (type == captureRecordType::Device) {
+			if (record->device != devices.size() || record->size < sizeof(captureDeviceRecord)) continue;
+
+			captureDeviceRecord info = {};
+			std::memcpy(&info, payload(record), sizeof(info));
+			const char* strings = reinterpret_cast<const char*>(payload(record)) + sizeof(info);
+			const char* end = strings + (record->size - sizeof(info));
+			const char* pathEnd = std::find(strings, end, '\0');
+			const char* serialEnd = pathEnd == end ? end : std::find(pathEnd + 1, end, '\0');
+
+			auto dev = std::make_unique<device>();
+			dev->info.vendorID = info.vendorID;
+			dev->info.productID = info.productID;
+			dev->info.busType = info.busType;
+			dev->info.path.assign(strings, pathEnd);
+			if (pathEnd != end) dev->info.serial.assign(pathEnd + 1, serialEnd);
+			devices.push_back(std::move(dev));
+			continue;
+		}
+
+		if (record->device >= devices.size()) continue;
+		device& dev = *devices[record->device];
+
+		switch (type) {
+			case captureRecordType::Open:
+				if (!dev.recordedOpen) dev.firstOpenNs = record->timeNs;
+				dev.recordedOpen = true;
+				break;
+			case captureRecordType::Input:
+			case captureRecordType::ReadError:
+				dev.input.push_back(record);
+				break;
+			case captureRecordType::FeatureGet:
+				if (record->size > 0) dev.features.push_back(record);
+				break;
+			default:
+				break;
+		}
+	}
+
+	std::lock_guard guard(m_lock);
+	m_file = std::move(file); // Moving keeps the buffer, the record pointers stay valid
+	m_devices = std::move(devices);
+	m_speed = std::max(speed, 0.0);
+	m_writes = 0;
+	return true;
+}
+
+bool replayTransport::finished() const {
+	std::lock_guard guard(m_lock);
+	bool any = false;
+
+	for (const auto& dev : m_devices) {
+		std::lock_guard deviceGuard(dev->lock);
+		if (!dev->started) continue;
+		if (dev->next < dev->input.size()) return false;
+		any = true;
+	}
+
+	return any;
+}
+
+uint64_t replayTransport::writesReceived() const {
+	std::lock_guard guard(m_lock);
+	return m_writes;
+}
+
+int replayTransport::init() {
+	return 0;
+}
+
+std::vector<transportDeviceInfo> replayTransport::enumerate(uint16_t vendorID, uint16_t productID) {
+	std::lock_guard guard(m_lock);
+	std::vector<transportDeviceInfo> devices;
+
+	for (const auto& dev : m_devices) {
+		if (vendorID != 0 && dev->info.vendorID != vendorID) continue;
+		if (productID != 0 && dev->info.productID != productID) continue;
+		devices.push_back(dev->info);
+	}
+
+	return devices;
+}
+
+transportDevice* replayTransport::open(const std::string& path) {
+	std::lock_guard guard(m_lock);
+
+	for (const auto& dev : m_devices) {
+		if (dev->info.path != path) continue;
+
+		// Reopening after a recorded read error carries on where the recording did
+		std::lock_guard deviceGuard(dev->lock);
+		dev->openCount++;
+		if (!dev->started) {
+			dev->started = true;
+			dev->start = std::chrono::steady_clock::now();
+		}
+
+		return reinterpret_cast<transportDevice*>(dev.get());
+	}
+
+	return nullptr;
+}
+
+void replayTransport::close(transportDevice* handle) {
+	device* dev = replayDevice(handle);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->openCount--;
+	dev->changed.notify_all();
+}
+
+int replayTransport::read(transportDevice* handle, unsigned char* data, size_t length, int timeoutMs) {
+	device* dev = replayDevice(handle);
+	if (!dev || !data) return -1;
+
+	std::unique_lock guard(dev->lock);
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = now + std::chrono::milliseconds(std::max(timeoutMs, 0));
+
+	// Out of recorded input, behaves like a controller nobody touches
+	if (dev->next >= dev->input.size()) {
+		if (timeoutMs < 0) dev->changed.wait(guard, [dev] { return dev->openCount <= 0; });
+		else dev->changed.wait_until(guard, deadline, [dev] { return dev->openCount <= 0; });
+		return dev->openCount <= 0 ? -1 : 0;
+	}
+
+	const captureRecordHeader* record = dev->input[dev->next];
+
+	if (m_speed > 0) {
+		uint64_t offsetNs = record->timeNs > dev->firstOpenNs ? record->timeNs - dev->firstOpenNs : 0;
+		auto due = dev->start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::nano>((double)offsetNs / m_speed));
+
+		while (due > now && dev->openCount > 0) {
+			if (timeoutMs >= 0 && now >= deadline) return 0;
+			dev->changed.wait_until(guard, timeoutMs >= 0 ? std::min(due, deadline) : due);
+			now = std::chrono::steady_clock::now();
+		}
+
+		if (dev->openCount <= 0) return -1;
+	}
+
+	dev->next++;
+
+	if ((captureRecordType)record->type == captureRecordType::ReadError) {
+		int res = -1;
+		if (record->size >= sizeof(res)) std::memcpy(&res, payload(record), sizeof(res));
+		return res < 0 ? res : -1;
+	}
+
+	size_t size = std::min(length, (size_t)record->size);
+	std::memcpy(data, payload(record), size);
+	return (int)size;
+}
+
+int replayTransport::write(transportDevice* handle, const unsigned char* data, size_t length) {
+	if (!handle || !data) return -1;
+
+	std::lock_guard guard(m_lock);
+	m_writes++;
+	return (int)length;
+}
+
+int replayTransport::getFeatureReport(transportDevice* handle, unsigned char* data, size_t length) {
+	device* dev = replayDevice(handle);
+	if (!dev || !data || length == 0) return -1;
+
+	std::lock_guard guard(dev->lock);
+
+	// Answers for the same report ID come back in recorded order, the last one repeats
+	std::vector<const captureRecordHeader*> answers;
+	for (const captureRecordHeader* record : dev->features)
+		if (payload(record)[0] == data[0]) answers.push_back(record);
+
+	if (answers.empty()) return -1;
+
+	size_t& cursor = dev->featureCursor[data[0]];
+	const captureRecordHeader* record = answers[std::min(cursor, answers.size() - 1)];
+	cursor++;
+
+	size_t size = std::min(length, (size_t)record->size);
+	std::memcpy(data, payload(record), size);
+	return (int)size;
+}
+
+int replayTransport::sendFeatureReport(transportDevice* handle, const unsigned char* data, size_t length) {
+	if (!handle || !data) return -1;
+
+	std::lock_guard guard(m_lock);
+	m_writes++;
+	return (int)length;
+}
+#pragma endregion
@@ -1,10 +1,227 @@
 ﻿#include "crc.h"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DUALIB_CRC_PCLMUL 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PCLMUL_TARGET
+#else
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#endif
+#endif
+
+// hashTable works on the inverted CRC state, so the report prefix and the final xor are already folded in:
+// hashTable[i] == crcTable[0][i ^ 0xFF] ^ 0xFF000000. Everything below uses the plain reflected CRC32
+// tables and inverts the state once at the start and once at the end instead.
+#define CRC_POLYNOMIAL 0xEDB88320
+
+static constexpr std::array<std::array<uint32_t, 256>, 8> makeSliceTables() {
+	std::array<std::array<uint32_t, 256>, 8> tables = {};
+
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC_POLYNOMIAL : 0);
+		tables[0][i] = crc;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int slice = 1; slice < 8; slice++)
+			tables[slice][i] = (tables[slice - 1][i] >> 8) ^ tables[0][tables[slice - 1][i] & 0xFF];
+	}
+
+	return tables;
+}
+
+static constexpr auto crcTable = makeSliceTables();
+
+static constexpr bool matchesHashTable() {
+	for (uint32_t i = 0; i < 256; i++) {
+		if (hashTable[i] != (crcTable[0][i ^ 0xFF] ^ 0xFF000000))
+			return false;
+	}
+	return true;
+}
+
+static_assert(matchesHashTable(), "slice tables have to produce the same CRC as hashTable");
+
+static uint32_t updateSliceBy8(uint32_t crc, const unsigned char* buffer, size_t len) {
+	while (len >= 8) {
+		uint32_t low, high;
+		std::memcpy(&low, buffer, 4);
+		std::memcpy(&high, buffer + 4, 4);
+		low ^= crc; // The reports are little endian and so is everything we run on
+
+		crc =
+			crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^
+			crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^
+			crcTable[3][high & 0xFF] ^ crcTable[2][(high >> 8) & 0xFF] ^
+			crcTable[1][(high >> 16) & 0xFF] ^ crcTable[0][high >> 24];
+
+		buffer += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = crcTable[0][(crc ^ *buffer++) & 0xFF] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+#ifdef DUALIB_CRC_PCLMUL
+// Folds 16 bytes at a time with carry-less multiplies, see Intel's "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction". Needs at least 64 bytes, leftovers go through slice-by-8.
+PCLMUL_TARGET static uint32_t updatePclmul(uint32_t crc, const unsigned char* buffer, size_t len) {
+	alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+	if (len < 64)
+		return updateSliceBy8(crc, buffer, len);
+
+	__m128i x1 = _mm_loadu_si128((const __m128i*)(buffer + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i*)(buffer + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i*)(buffer + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i*)(buffer + 0x30));
+	__m128i x0 = _mm_load_si128((const __m128i*)k1k2);
+	__m128i x5;
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	buffer += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		__m128i x6, x7, x8;
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buffer + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buffer + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buffer + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buffer + 0x30)));
+
+		buffer += 64;
+		len -= 64;
+	}
+
+	// Fold the four lanes into one
+	x0 = _mm_load_si128((const __m128i*)k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while (len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buffer)), x5);
+
+		buffer += 16;
+		len -= 16;
+	}
+
+	// 128 to 64 bits
+	__m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128((const __m128i*)poly);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	crc = (uint32_t)_mm_extract_epi32(x1, 1);
+	return updateSliceBy8(crc, buffer, len);
+}
+
+static bool hasPclmul() {
+#ifdef _MSC_VER
+	int info[4] = {};
+	__cpuid(info, 1);
+	return (info[2] & (1 << 1)) && (info[2] & (1 << 19)); // PCLMULQDQ, SSE4.1
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+#endif
+
+using crcUpdate = uint32_t(*)(uint32_t, const unsigned char*, size_t);
+
+static crcUpdate selectUpdate() {
+#ifdef DUALIB_CRC_PCLMUL
+	if (crcPclmulSupported())
+		return updatePclmul;
+#endif
+	return updateSliceBy8;
+}
+
+static crcUpdate selectedUpdate() {
+	static const crcUpdate update = selectUpdate();
+	return update;
+}
 
 uint32_t compute(unsigned char* buffer, size_t len) {
-	uint32_t result = crcSeed;
+	return ~selectedUpdate()(~crcSeed, buffer, len);
+}
+
+uint32_t computeWithPrefix(unsigned char prefix, const unsigned char* buffer, size_t len) {
+	crcUpdate update = selectedUpdate();
+	return ~update(update(0xFFFFFFFF, &prefix, 1), buffer, len);
+}
+
+uint32_t computeBytewise(unsigned char* buffer, size_t len, uint32_t seed) {
+	uint32_t result = seed;
 	for (size_t i = 0; i < len; i++) {
 		result = hashTable[((unsigned char)result) ^ ((unsigned char)buffer[i])] ^
 			(result >> 8);
 	}
 	return result;
 }
+
+uint32_t computeSliceBy8(unsigned char* buffer, size_t len, uint32_t seed) {
+	return ~updateSliceBy8(~seed, buffer, len);
+}
+
+bool crcPclmulSupported() {
+#ifdef DUALIB_CRC_PCLMUL
+	static const bool supported = hasPclmul();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+uint32_t computePclmul(unsigned char* buffer, size_t len, uint32_t seed) {
+#ifdef DUALIB_CRC_PCLMUL
+	if (crcPclmulSupported())
+		return ~updatePclmul(~seed, buffer, len);
+#endif
+	return computeSliceBy8(buffer, len, seed);
+}
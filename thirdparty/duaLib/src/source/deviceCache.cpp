@@ -0,0 +1,161 @@
+﻿#include "deviceCache.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+// One entry per line: path, serial, MAC, container ID, container ID size, hex encoded version report.
+// Bump the version whenever the layout changes, files with a different version are ignored.
+#define DEVICE_CACHE_VERSION "duaLib-device-cache 1"
+
+static std::mutex g_cacheLock;
+static std::unordered_map<std::string, deviceMetadata> g_cache;
+static bool g_cacheLoaded = false;
+
+static std::filesystem::path cacheFile() {
+#if defined(_WIN32) || defined(_WIN64)
+	const char* base = std::getenv("LOCALAPPDATA");
+	if (!base || !*base) return {};
+	return std::filesystem::path(base) / "duaLib" / "devices.cache";
+#else
+	const char* xdg = std::getenv("XDG_CACHE_HOME");
+	if (xdg && *xdg) return std::filesystem::path(xdg) / "duaLib" / "devices.cache";
+
+	const char* home = std::getenv("HOME");
+	if (!home || !*home) return {};
+	return std::filesystem::path(home) / ".cache" / "duaLib" / "devices.cache";
+#endif
+}
+
+static std::string cacheKey(const std::string& path, const std::string& serial) {
+	return path + '\t' + serial;
+}
+
+static std::string toHex(const void* data, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	std::string hex;
+	hex.reserve(size * 2);
+
+	for (size_t i = 0; i < size; i++) {
+		hex += digits[bytes[i] >> 4];
+		hex += digits[bytes[i] & 0x0F];
+	}
+
+	return hex;
+}
+
+static bool fromHex(const std::string& hex, void* data, size_t size) {
+	if (hex.size() != size * 2) return false;
+	uint8_t* bytes = static_cast<uint8_t*>(data);
+
+	for (size_t i = 0; i < size; i++) {
+		char pair[3] = { hex[i * 2], hex[i * 2 + 1], 0 };
+		char* end = nullptr;
+		bytes[i] = (uint8_t)std::strtoul(pair, &end, 16);
+		if (end != pair + 2) return false;
+	}
+
+	return true;
+}
+
+static void loadCache() {
+	g_cacheLoaded = true;
+
+	std::filesystem::path file = cacheFile();
+	if (file.empty()) return;
+
+	std::ifstream in(file);
+	std::string line;
+
+	if (!std::getline(in, line) || line != DEVICE_CACHE_VERSION) return;
+
+	while (std::getline(in, line)) {
+		std::stringstream fields(line);
+		std::string path, serial, idSize, version;
+		deviceMetadata metadata = {};
+
+		if (!std::getline(fields, path, '\t') ||
+			!std::getline(fields, serial, '\t') ||
+			!std::getline(fields, metadata.macAddress, '\t') ||
+			!std::getline(fields, metadata.containerId, '\t') ||
+			!std::getline(fields, idSize, '\t')) {
+			continue;
+		}
+
+		std::getline(fields, version, '\t');
+		metadata.containerIdSize = (uint32_t)std::strtoul(idSize.c_str(), nullptr, 10);
+		metadata.hasVersionReport = fromHex(version, &metadata.versionReport, sizeof(metadata.versionReport));
+
+		if (metadata.macAddress.empty()) continue;
+		g_cache[cacheKey(path, serial)] = metadata;
+	}
+}
+
+static void saveCache() {
+	std::filesystem::path file = cacheFile();
+	if (file.empty()) return;
+
+	std::error_code error;
+	std::filesystem::create_directories(file.parent_path(), error);
+
+	// Written next to the real file and moved over it so a crash never leaves half a cache behind
+	std::filesystem::path temporary = file;
+	temporary += ".tmp";
+
+	{
+		std::ofstream out(temporary, std::ios::trunc);
+		if (!out) return;
+
+		out << DEVICE_CACHE_VERSION << '\n';
+
+		for (const auto& [key, metadata] : g_cache) {
+			out << key << '\t' << metadata.macAddress << '\t' << metadata.containerId << '\t' << metadata.containerIdSize << '\t';
+			if (metadata.hasVersionReport)
+				out << toHex(&metadata.versionReport, sizeof(metadata.versionReport));
+			out << '\n';
+		}
+
+		if (!out) return;
+	}
+
+	std::filesystem::rename(temporary, file, error);
+}
+
+static bool sameMetadata(const deviceMetadata& a, const deviceMetadata& b) {
+	return a.macAddress == b.macAddress &&
+		a.containerId == b.containerId &&
+		a.containerIdSize == b.containerIdSize &&
+		a.hasVersionReport == b.hasVersionReport &&
+		(!a.hasVersionReport || std::memcmp(&a.versionReport, &b.versionReport, sizeof(a.versionReport)) == 0);
+}
+
+bool loadDeviceMetadata(const std::string& path, const std::string& serial, deviceMetadata& metadata) {
+	if (serial.empty()) return false;
+
+	std::lock_guard guard(g_cacheLock);
+	if (!g_cacheLoaded) loadCache();
+
+	auto entry = g_cache.find(cacheKey(path, serial));
+	if (entry == g_cache.end()) return false;
+
+	metadata = entry->second;
+	return true;
+}
+
+void storeDeviceMetadata(const std::string& path, const std::string& serial, const deviceMetadata& metadata) {
+	if (metadata.macAddress.empty() || serial.empty()) return;
+
+	std::lock_guard guard(g_cacheLock);
+	if (!g_cacheLoaded) loadCache();
+
+	std::string key = cacheKey(path, serial);
+	auto entry = g_cache.find(key);
+	if (entry != g_cache.end() && sameMetadata(entry->second, metadata)) return;
+
+	g_cache[key] = metadata;
+	saveCache();
+}
@@ -11,8 +11,12 @@
 #include <cstring>    
 #include <cmath>
 #include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
 #include <iomanip> 
+#include <span>
+#include <utility>
 
 #define M_PI 3.14159265358979323846  
 
@@ -32,13 +36,30 @@
 #include <cstdlib>
 #endif
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__linux__) && DUALIB_HAS_UDEV
+#include <libudev.h>
+#include <poll.h>
+#endif
+
 #include "duaLib.h"
 #include "dataStructures.h"
 #include "crc.h"
 #include "triggerFactory.h"
+#include "seqlock.h"
+#include "deviceCache.h"
+#include "transport.h"
+#include "flightRecorder.h"
+#include "inputDecoder.h"
 
 #define DEVICE_COUNT 4
-#define MAX_CONTROLLER_COUNT 4
+#define MAX_CONTROLLER_COUNT SCE_PAD_MAX_CONTROLLER_COUNT
+#define READER_SHARD_SIZE 4
+#define MAX_READER_THREADS SCE_PAD_MAX_READER_THREADS
 #define VENDOR_ID 0x54c
 #define DUALSENSE_DEVICE_ID 0x0ce6
 #define DUALSENSE_EDGE_DEVICE_ID 0x0df2
@@ -49,52 +70,263 @@
 #define DUALSHOCK4 1
 #define DUALSENSE 2
 #define ANGULAR_VELOCITY_DEADBAND_MIN 0.017453292
+#define BLOCKING_READ_TIMEOUT_MS 100
+#define MAX_DRAINED_REPORTS 64
+#define DEFAULT_COALESCE_WINDOW_US 2000
+#define DEFAULT_USB_WRITE_INTERVAL_US 1000
+#define DEFAULT_BT_WRITE_INTERVAL_US 4000
+#define INPUT_HISTORY_SIZE 64
+#define HANDLE_GENERATION_MASK 0x7FFFFF
+#define MAX_MOTION_DT 0.1f
+#define ACCEL_SMOOTHING 0.1f
+#define MAHONY_KP 0.5f
+#define MAHONY_KI 0.005f
+#define CALIBRATION_SHIFT 16
+#define GYRO_RANGE_DEG_S 2000 // 32768 nominal counts
+#define ACCEL_COUNTS_PER_G 8192
+#define GYRO_BIAS_SAMPLES 512
+#define GYRO_BIAS_MAX_SPREAD 64 // Nominal counts, about 4 deg/s
+#define UDEV_SWEEP_INTERVAL_MS 2000
+#define LINK_STALL_TIMEOUT_MS 1000
+#define LINK_LOSS_TIMEOUT_MS 500
+#define MAX_RETRY_DELAY_MS 64
+#define UDEV_RETRY_INTERVAL_MS 20
+#define UDEV_MAX_RETRIES 50
+
+// Wraps whatever got set through scePadSetTransport before init, hidapi otherwise. Never destroyed,
+// the detached reader threads can still be recording while the process exits.
+static flightRecorder& g_flightRecorder = *new flightRecorder();
+
+static deviceTransport& activeTransport() {
+	return g_flightRecorder;
+}
 
 namespace duaLibUtils {
 	struct trigger {
 		uint8_t force[11] = {};
 	};
 
+	// Largest output report that gets sent (ReportOut31/ReportOut11)
+	constexpr size_t MAX_OUTPUT_REPORT_SIZE = 78;
+
+	struct outputReport {
+		uint8_t data[MAX_OUTPUT_REPORT_SIZE] = {};
+		size_t size = 0;
+		bool needsCrc = false; // Bluetooth reports, the last 4 bytes get filled in right before the write
+	};
+
+	// Double buffer between composeOutput, which fills the back reports, and flushOutput
+	// which swaps them to the front and sends them
+	struct outputBuffer {
+		std::mutex lock{};
+		outputReport back = {};
+		outputReport front = {};
+		bool pending = false;
+		outputReport featureBack = {};
+		outputReport featureFront = {};
+		bool featurePending = false;
+		bool urgent = false;
+		std::chrono::steady_clock::time_point queuedAt = {};
+		std::chrono::steady_clock::time_point lastWrite = {};
+	};
+
+	struct inputSample {
+		uint64_t sequence;
+		uint64_t receivedAtUs;
+		uint32_t sensorTimestamp;
+		s_ScePadData data; // Decoded once by the reader
+		uint8_t deviceType;
+		uint8_t state[sizeof(dualsenseData::USBGetStateData)];
+	};
+
+	// Newest decoded report together with when it was read, so consumers can tell how old it is
+	struct publishedState {
+		s_ScePadData data;
+		uint64_t receivedAtUs;
+	};
+
+	static_assert(sizeof(dualshock4Data::USBGetStateData) <= sizeof(dualsenseData::USBGetStateData), "inputSample::state has to fit both report types");
+	static_assert(sizeof(inputSample::state) <= SCE_PAD_RAW_STATE_SIZE, "s_ScePadRawState::state has to fit inputSample::state");
+
+	// nominal = ((raw - bias) * scale) >> CALIBRATION_SHIFT
+	struct axisCalibration {
+		int32_t bias = 0;
+		int64_t scale = 1 << CALIBRATION_SHIFT;
+	};
+
+	// Precomputed from the calibration feature report when the controller connects
+	struct motionCalibration {
+		axisCalibration gyro[3] = {};  // Report order: pitch, yaw, roll
+		axisCalibration accel[3] = {}; // X, Y, Z
+		bool valid = false;
+	};
+
+	// Calibrated sample in nominal counts, 32768 per GYRO_RANGE_DEG_S and ACCEL_COUNTS_PER_G per g
+	struct motionCounts {
+		int32_t gyro[3] = {}; // Report order like motionCalibration
+		int32_t accel[3] = {};
+	};
+
+	struct biasEstimator {
+		int64_t sum[3] = {};
+		int32_t min[3] = {};
+		int32_t max[3] = {};
+		uint32_t samples = 0;
+	};
+
+	// Last INPUT_HISTORY_SIZE reports of a controller. Only the reader thread pushes, readers
+	// check the sequence number of a slot to notice when it got overwritten under them.
+	struct inputHistory {
+		seqlock<inputSample> samples[INPUT_HISTORY_SIZE] = {};
+		std::atomic<uint64_t> head = 0; // Sequence number of the next sample
+		std::atomic<uint64_t> readCursor = 0; // Where scePadRead continues from
+
+		// Returns the receive timestamp the sample got
+		template <typename T>
+		uint64_t push(uint8_t deviceType, const T& state, uint32_t sensorTimestamp, const s_ScePadData& data) {
+			uint64_t sequence = head.load(std::memory_order_relaxed);
+
+			inputSample sample = {};
+			sample.sequence = sequence;
+			sample.receivedAtUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			sample.sensorTimestamp = sensorTimestamp;
+			sample.data = data;
+			sample.deviceType = deviceType;
+			std::memcpy(sample.state, &state, sizeof(T));
+
+			samples[sequence % INPUT_HISTORY_SIZE].store(sample);
+			head.store(sequence + 1, std::memory_order_release);
+			return sample.receivedAtUs;
+		}
+
+		bool get(uint64_t sequence, inputSample& sample) const {
+			sample = samples[sequence % INPUT_HISTORY_SIZE].load();
+			return sample.sequence == sequence;
+		}
+	};
+
+	bool isUrgentOutput(const dualsenseData::SetStateData& current, const dualsenseData::SetStateData& last) {
+		return
+			current.RumbleEmulationLeft != last.RumbleEmulationLeft ||
+			current.RumbleEmulationRight != last.RumbleEmulationRight ||
+			current.UseRumbleNotHaptics != last.UseRumbleNotHaptics ||
+			std::memcmp(current.LeftTriggerFFB, last.LeftTriggerFFB, sizeof(current.LeftTriggerFFB)) != 0 ||
+			std::memcmp(current.RightTriggerFFB, last.RightTriggerFFB, sizeof(current.RightTriggerFFB)) != 0;
+	}
+
+	bool isUrgentOutput(const dualshock4Data::BTSetStateData& current, const dualshock4Data::BTSetStateData& last) {
+		return current.RumbleLeft != last.RumbleLeft || current.RumbleRight != last.RumbleRight;
+	}
+
+	// A report that replaces one which never went out still has to apply everything the old one would have
+	void keepUpdateFlags(dualsenseData::SetStateData& report, const dualsenseData::SetStateData& replaced) {
+		report.AllowRightTriggerFFB |= replaced.AllowRightTriggerFFB;
+		report.AllowLeftTriggerFFB |= replaced.AllowLeftTriggerFFB;
+		report.AllowHeadphoneVolume |= replaced.AllowHeadphoneVolume;
+		report.AllowSpeakerVolume |= replaced.AllowSpeakerVolume;
+		report.AllowMicVolume |= replaced.AllowMicVolume;
+		report.AllowAudioControl |= replaced.AllowAudioControl;
+		report.AllowMuteLight |= replaced.AllowMuteLight;
+		report.AllowAudioMute |= replaced.AllowAudioMute;
+		report.AllowLedColor |= replaced.AllowLedColor;
+		report.AllowPlayerIndicators |= replaced.AllowPlayerIndicators;
+		report.AllowHapticLowPassFilter |= replaced.AllowHapticLowPassFilter;
+		report.AllowMotorPowerLevel |= replaced.AllowMotorPowerLevel;
+		report.AllowAudioControl2 |= replaced.AllowAudioControl2;
+		report.AllowLightBrightnessChange |= replaced.AllowLightBrightnessChange;
+		report.AllowColorLightFadeAnimation |= replaced.AllowColorLightFadeAnimation;
+	}
+
+	void keepUpdateFlags(dualshock4Data::BTSetStateData& report, const dualshock4Data::BTSetStateData& replaced) {
+		report.EnableRumbleUpdate |= replaced.EnableRumbleUpdate;
+		report.EnableLedUpdate |= replaced.EnableLedUpdate;
+		report.EnableLedBlink |= replaced.EnableLedBlink;
+		report.EnableVolumeLeftUpdate |= replaced.EnableVolumeLeftUpdate;
+		report.EnableVolumeRightUpdate |= replaced.EnableVolumeRightUpdate;
+		report.EnableVolumeMicUpdate |= replaced.EnableVolumeMicUpdate;
+		report.EnableVolumeSpeakerUpdate |= replaced.EnableVolumeSpeakerUpdate;
+	}
+
+	enum class LinkState : uint8_t {
+		Connected,
+		Stalled, // No reports for a while but no errors either
+		Recovering, // Reads fail, retrying with backoff
+		Lost
+	};
+
+	static_assert((int)LinkState::Connected == SCE_PAD_LINK_STATE_CONNECTED && (int)LinkState::Lost == SCE_PAD_LINK_STATE_LOST);
+
 	struct controller {
 		std::shared_mutex lock{};
-		hid_device* handle = 0;
+		transportDevice* handle = 0;
+		std::shared_mutex handleLock{}; // Shared while a reader, the writer or the watcher use the handle, exclusive to replace or close it
 		uint32_t sceHandle = 0;
+		uint32_t generation = 0; // Bumped every time the slot gets opened so old handles stop working
 		uint8_t playerIndex = 0;
 		uint8_t deviceType = UNKNOWN;
 		uint16_t productID = 0;
 		uint8_t seqNo = 0;
 		uint8_t connectionType = 0;
-		bool opened = false;
-		bool isMicMuted = false;
-		bool wasDisconnected = false;
-		bool valid = false;
-		uint32_t failedReadCount = 0;
-		dualsenseData::USBGetStateData dualsenseCurInputState = {};
+		std::atomic<bool> opened = false;
+		std::atomic<bool> isMicMuted = false;
+		std::atomic<bool> pendingMuteUpdate = false;
+		std::atomic<bool> outputDirty = false; // Set by the reader, the writer rebuilds the output report from the current state
+		std::atomic<bool> wasDisconnected = false;
+		std::atomic<bool> valid = false;
+		std::atomic<LinkState> linkState = LinkState::Lost;
+		std::atomic<std::chrono::steady_clock::time_point> lastReportAt = {};
+		std::chrono::steady_clock::time_point firstErrorAt = {};
+		std::chrono::steady_clock::time_point retryAt = {};
+		uint32_t retryDelayMs = 0;
+		std::atomic<int> lastReadError = 0;
+		std::atomic<uint64_t> readErrors = 0;
+		std::atomic<uint64_t> foreignReads = 0;
+		std::atomic<uint64_t> reportsRead = 0;
+		std::atomic<uint64_t> staleReportsSkipped = 0;
+		std::atomic<uint64_t> writesIssued = 0;
+		std::atomic<uint64_t> writesSuppressed = 0;
+		dualsenseData::USBGetStateData dualsenseCurInputState = {}; // Reader thread only, everyone else goes through dualsenseInput
+		seqlock<dualsenseData::USBGetStateData> dualsenseInput = {};
 		dualsenseData::SetStateData dualsenseLastOutputState = {};
 		dualsenseData::SetStateData dualsenseCurOutputState = {};
+		dualsenseData::SetStateData dualsenseQueuedOutputState = {}; // Writer thread only, what the last queued report carried
 		dualsenseData::ReportFeatureInVersion versionReport = {};
-		dualshock4Data::USBGetStateData dualshock4CurInputState = {};
+		dualshock4Data::USBGetStateData dualshock4CurInputState = {}; // Reader thread only, everyone else goes through dualshock4Input
+		seqlock<dualshock4Data::USBGetStateData> dualshock4Input = {};
+		seqlock<publishedState> padData = {}; // Newest report decoded by the reader, what scePadReadState hands out
 		dualshock4Data::BTSetStateData dualshock4LastOutputState = {};
 		dualshock4Data::BTSetStateData dualshock4CurOutputState = {};
+		dualshock4Data::BTSetStateData dualshock4QueuedOutputState = {}; // Writer thread only, what the last queued report carried
 		dualshock4Data::ReportFeatureInDongleSetAudio dualshock4CurAudio = { 0xE0, 0, dualshock4Data::AudioOutput::Disabled };
 		dualshock4Data::ReportFeatureInDongleSetAudio dualshock4LastAudio = { 0xE0, 0, dualshock4Data::AudioOutput::Speaker };
 		std::string macAddress = "";
 		std::string systemIdentifier = "";
 		std::string lastPath = "";
+		std::string serialNumber = "";
+		std::atomic<bool> metadataPending = false; // Set up from the metadata cache, the watcher still has to ask the device
 		std::string id = "";
 		uint32_t idSize = 0;
 		trigger L2 = {};
 		trigger R2 = {};
 		uint8_t triggerMask = 0;
+		ScePadTriggerEffectParam lastTriggerEffect = {}; // What L2/R2 were generated from, lets scePadSetTriggerEffect skip repeated calls
+		bool triggerEffectCached = false;
 		uint32_t lastSensorTimestamp = 0;
-		bool velocityDeadband = false;
-		bool motionSensorState = true;
-		bool tiltCorrection = false;
-		s_SceFQuaternion orientation = { 0.0f,0.0f,0.0f,1.0f };
+		std::atomic<bool> velocityDeadband = false;
+		std::atomic<bool> motionSensorState = true;
+		std::atomic<bool> tiltCorrection = false;
+		std::atomic<bool> orientationReset = false;
+		s_SceFQuaternion orientation = { 0.0f,0.0f,0.0f,1.0f }; // Reader thread only, everyone else goes through fusedOrientation
+		motionCalibration calibration = {};
+		motionCounts motion = {}; // Reader thread only, newest calibrated sample
+		seqlock<s_ScePadMotionSample> motionSample = {};
+		int32_t gyroBias[3] = {}; // Reader thread only, measured by scePadStartGyroBiasEstimation
+		biasEstimator biasEstimation = {}; // Reader thread only
+		std::atomic<bool> biasEstimationRestart = false;
+		std::atomic<int> biasEstimationState = SCE_PAD_BIAS_ESTIMATION_IDLE;
 		s_SceFVector3 lastAcceleration = { 0.0f,0.0f,0.0f };
 		float eInt[3] = { 0.0f, 0.0f, 0.0f };
-		std::chrono::steady_clock::time_point lastUpdate = {};
-		float deltaTime = 0.0f;
+		seqlock<s_SceFQuaternion> fusedOrientation = {};
 		uint8_t touch1Count = 0;
 		uint8_t touch2Count = 0;
 		uint8_t touch1LastCount = 0;
@@ -103,6 +335,8 @@ namespace duaLibUtils {
 		uint8_t touch2LastIndex = 0;
 		bool started = false;
 		bool playerLed = true;
+		outputBuffer output = {};
+		inputHistory history = {};
 	};
 
 	void setPlayerLights(duaLibUtils::controller& controller, bool oldStyle) {
@@ -158,7 +392,7 @@ namespace duaLibUtils {
 		}
 	}
 
-	bool letGo(hid_device* handle, uint8_t deviceType, uint8_t connectionType) {
+	bool letGo(transportDevice* handle, uint8_t deviceType, uint8_t connectionType) {
 		if (handle && deviceType == DUALSENSE && (connectionType == HID_API_BUS_USB || connectionType == HID_API_BUS_UNKNOWN)) {
 			dualsenseData::ReportOut02 data = {};
 			data.ReportID = 0x02;
@@ -187,7 +421,7 @@ namespace duaLibUtils {
 			TriggerEffectGenerator::Off(data.State.LeftTriggerFFB, 0);
 			TriggerEffectGenerator::Off(data.State.RightTriggerFFB, 0);
 
-			uint8_t res = hid_write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
+			uint8_t res = activeTransport().write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
 			return true;
 		}
 		else if (handle && deviceType == DUALSENSE && connectionType == HID_API_BUS_BLUETOOTH) {
@@ -198,7 +432,7 @@ namespace duaLibUtils {
 			data.Data.State.ResetLights = true;
 			uint32_t crc = compute(data.CRC.Buff, sizeof(data) - 4);
 			data.CRC.CRC = crc;
-			uint8_t res = hid_write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
+			uint8_t res = activeTransport().write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
 
 			data.Data.State.ResetLights = false;
 			data.Data.State.AllowLedColor = true;
@@ -209,7 +443,7 @@ namespace duaLibUtils {
 			TriggerEffectGenerator::Off(data.Data.State.RightTriggerFFB, 0);
 			crc = compute(data.CRC.Buff, sizeof(data) - 4);
 			data.CRC.CRC = crc;
-			res = hid_write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
+			res = activeTransport().write(handle, reinterpret_cast<unsigned char*>(&data), sizeof(data));
 
 			return true;
 		}
@@ -221,12 +455,12 @@ namespace duaLibUtils {
 			report.State.EnableRumbleUpdate = true;
 			report.State.RumbleLeft = 0;
 			report.State.RumbleRight = 0;
-			hid_write(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
+			activeTransport().write(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
 
 			dualshock4Data::ReportFeatureInDongleSetAudio audioSetting = {};
 			audioSetting.ReportID = 0xE0;
 			audioSetting.Output = dualshock4Data::AudioOutput::Disabled;
-			hid_send_feature_report(handle, reinterpret_cast<unsigned char*>(&audioSetting), sizeof(audioSetting));
+			activeTransport().sendFeatureReport(handle, reinterpret_cast<unsigned char*>(&audioSetting), sizeof(audioSetting));
 
 			return true;
 		}
@@ -249,19 +483,19 @@ namespace duaLibUtils {
 			uint32_t crc = compute(report.CRC.Buff, sizeof(report) - 4);
 			report.CRC.CRC = crc;
 
-			int res = hid_write(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
+			int res = activeTransport().write(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
 			return true;
 		}
 
 		return false;
 	}
 
-	bool getHardwareVersion(hid_device* handle, dualsenseData::ReportFeatureInVersion& report) {
+	bool getHardwareVersion(transportDevice* handle, dualsenseData::ReportFeatureInVersion& report) {
 		if (!handle) return false;
 
 		unsigned char buffer[64] = { };
 		buffer[0] = 0x20;
-		int res = hid_get_feature_report(handle, buffer, sizeof(buffer));
+		int res = activeTransport().getFeatureReport(handle, buffer, sizeof(buffer));
 
 		if (res > 0) {
 			const auto versionReport = *reinterpret_cast<dualsenseData::ReportFeatureInVersion*>(buffer);
@@ -272,13 +506,13 @@ namespace duaLibUtils {
 		return false;
 	}
 
-	bool getMacAddress(hid_device* handle, std::string& outMac, uint32_t deviceId, uint8_t connectionType) {
+	bool getMacAddress(transportDevice* handle, std::string& outMac, uint32_t deviceId, uint8_t connectionType) {
 		if (!handle) return false;
 
 		if (deviceId == DUALSENSE_DEVICE_ID || deviceId == DUALSENSE_EDGE_DEVICE_ID) {
 			unsigned char buffer[20] = {};
 			buffer[0] = 0x09; // Report ID
-			int res = hid_get_feature_report(handle, buffer, sizeof(buffer));
+			int res = activeTransport().getFeatureReport(handle, buffer, sizeof(buffer));
 
 			if (res > 0) {
 				const auto macReport = *reinterpret_cast<dualsenseData::ReportFeatureInMacAll*>(buffer);
@@ -293,7 +527,7 @@ namespace duaLibUtils {
 		else if ((deviceId == DUALSHOCK4_DEVICE_ID || deviceId == DUALSHOCK4V2_DEVICE_ID || deviceId == DUALSHOCK4_WIRELESS_ADAPTOR_ID) && (connectionType == HID_API_BUS_USB || connectionType == HID_API_BUS_UNKNOWN)) {
 			dualshock4Data::ReportFeatureInMacAll macReport = {};
 			macReport.ReportID = 0x12;
-			int res = hid_get_feature_report(handle, reinterpret_cast<unsigned char*>(&macReport), sizeof(macReport));
+			int res = activeTransport().getFeatureReport(handle, reinterpret_cast<unsigned char*>(&macReport), sizeof(macReport));
 
 			if (res > 0) {
 				char tmp[18];
@@ -307,7 +541,7 @@ namespace duaLibUtils {
 		else if ((deviceId == DUALSHOCK4_DEVICE_ID || deviceId == DUALSHOCK4V2_DEVICE_ID || deviceId == DUALSHOCK4_WIRELESS_ADAPTOR_ID) && connectionType == HID_API_BUS_BLUETOOTH) {
 			dualshock4Data::ReportFeatureInMacAllBT macReport = {};
 			macReport.Data.ReportID = 0x09;
-			int res = hid_get_feature_report(handle, reinterpret_cast<unsigned char*>(&macReport), sizeof(macReport));
+			int res = activeTransport().getFeatureReport(handle, reinterpret_cast<unsigned char*>(&macReport), sizeof(macReport));
 
 			if (res > 0) {
 				char tmp[18];
@@ -323,12 +557,6 @@ namespace duaLibUtils {
 		return false;
 	}
 
-	bool isValid(hid_device* handle) {
-		if (!handle) return false;
-		unsigned char buf[1] = {};
-		return hid_read(handle, buf, 1) != -1;
-	}
-
 #if defined(_WIN32) || defined(_WIN64)
 	static std::wstring Utf8ToWide(const char* utf8) {
 		int wlen = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, nullptr, 0);
@@ -339,7 +567,8 @@ namespace duaLibUtils {
 	}
 #endif
 
-	bool GetID(const char* narrowPath, const char** ID, uint32_t* size) {
+	// Probes run on their own threads at the same time, so the ID goes into the caller's buffer
+	bool GetID(const char* narrowPath, char (&ID)[39], uint32_t* size) {
 	#if defined(_WIN32) || defined(_WIN64)
 		GUID hidGuid;
 		GUID outContainerId;
@@ -393,10 +622,9 @@ namespace duaLibUtils {
 						StringFromGUID2(outContainerId, guidStr, _countof(guidStr));
 
 						*size = sizeof(guidStr);
-						static char buffer[39] = {};
-						std::wcstombs(buffer, guidStr, sizeof(buffer));
-						std::transform(buffer, buffer + std::strlen(buffer), buffer, [](unsigned char c) {return std::tolower(c); });
-						*ID = buffer;
+						std::wcstombs(ID, guidStr, sizeof(ID));
+						ID[sizeof(ID) - 1] = '\0';
+						std::transform(ID, ID + std::strlen(ID), ID, [](unsigned char c) {return std::tolower(c); });
 
 						return true;
 					}
@@ -433,7 +661,22 @@ static std::atomic<bool> g_threadRunning = false;
 static std::atomic<bool> g_initialized = false;
 static std::atomic<bool> g_particularMode = false;
 static std::atomic<bool> g_allowBluetooth = false;
-static std::thread g_readThread;
+static std::atomic<int> g_readerMode = SCE_PAD_READER_MODE_BLOCKING;
+static std::atomic<int> g_controllerCount = SCE_PAD_DEFAULT_CONTROLLER_COUNT;
+static std::atomic<int> g_readerThreadCount = 0;
+static uint64_t g_readerAffinity[MAX_READER_THREADS] = {};
+static std::thread g_readThreads[MAX_READER_THREADS];
+static std::thread g_deviceReadThreads[MAX_CONTROLLER_COUNT];
+static std::mutex g_readerWakeLock;
+static std::condition_variable g_readerWake;
+static std::thread g_writeThread;
+static std::mutex g_writerWakeLock;
+static std::condition_variable g_writerWake;
+static bool g_outputPending = false;
+static thread_local bool t_isReaderThread = false;
+static std::atomic<uint32_t> g_coalesceWindowUs = DEFAULT_COALESCE_WINDOW_US;
+static std::atomic<uint32_t> g_usbWriteIntervalUs = DEFAULT_USB_WRITE_INTERVAL_US;
+static std::atomic<uint32_t> g_btWriteIntervalUs = DEFAULT_BT_WRITE_INTERVAL_US;
 static std::thread g_watchThread;
 constexpr std::array<s_SceLightBar, 4> g_playerColors = { {
 	{  0, 0, 255 }, // Player 1 - Blue
@@ -442,588 +685,1516 @@ constexpr std::array<s_SceLightBar, 4> g_playerColors = { {
 	{255, 0, 255 }  // Player 4 - Pink
 } };
 
-int readFunc() {
-#if defined(_WIN32) || defined(_WIN64)
-	SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
-	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-	timeBeginPeriod(1);
-
-	EXECUTION_STATE prevState = SetThreadExecutionState(
-		ES_CONTINUOUS | ES_SYSTEM_REQUIRED | ES_AWAYMODE_REQUIRED
-	);
+// Handles are (generation << 8) | (slot + 1), the generation keeps them positive and unique per open
+static int makeHandle(int slot, uint32_t generation) {
+	return (int)(((generation & HANDLE_GENERATION_MASK) << 8) | (uint32_t)(slot + 1));
+}
 
-	HANDLE hTimer = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
-	LARGE_INTEGER liDueTime;
-	liDueTime.QuadPart = -5000LL;
-#endif
+// Returns the slot a handle points to without locking anything, nullptr if it can't be one of ours.
+// The caller still has to compare sceHandle under the slot's lock, the slot might have been reopened.
+static duaLibUtils::controller* findController(int handle) {
+	if (handle <= 0) return nullptr;
 
-	while (g_threadRunning) {
-		bool allInvalid = true;		
-		
-		for (auto& controller : g_controllers) {
-			if (controller.valid && controller.opened && controller.deviceType == DUALSENSE) {
-				allInvalid = false;
-				bool isBt = controller.connectionType == HID_API_BUS_BLUETOOTH ? true : false;
+	int slot = (handle & 0xFF) - 1;
+	if (slot < 0 || slot >= g_controllerCount) return nullptr;
 
-				dualsenseData::ReportIn01USB  inputUsb = {};
-				dualsenseData::ReportIn31  inputBt = {};
+	return &g_controllers[slot];
+}
 
-				int32_t res = -1;
+// Slots in use, the table itself is always MAX_CONTROLLER_COUNT long so detached threads never see it move
+static std::span<duaLibUtils::controller> activeControllers() {
+	return std::span<duaLibUtils::controller>(g_controllers, g_controllerCount);
+}
 
-				if (isBt) 
-					res = hid_read_timeout(controller.handle, reinterpret_cast<unsigned char*>(&inputBt), sizeof(inputBt), 0);			
-				else 
-					res = hid_read_timeout(controller.handle, reinterpret_cast<unsigned char*>(&inputUsb), sizeof(inputUsb), 0);	
+static void wakeWriter() {
+	std::lock_guard guard(g_writerWakeLock);
+	g_outputPending = true;
+	g_writerWake.notify_one();
+}
 
-				dualsenseData::USBGetStateData inputData = isBt ? inputBt.Data.State.StateData : inputUsb.State;
+// Writer thread only, the report goes out with the flush that follows
+static void queueOutputReport(duaLibUtils::controller& controller, const void* report, size_t size, bool urgent, bool needsCrc) {
+	{
+		std::lock_guard guard(controller.output.lock);
 
-				if (controller.failedReadCount >= 15) {
-					controller.valid = false;
-				}
+		if (controller.output.pending) {
+			// The previous report was never sent, this one replaces it
+			controller.writesSuppressed++;
+			controller.output.urgent = controller.output.urgent || urgent;
+		}
+		else {
+			controller.output.queuedAt = std::chrono::steady_clock::now();
+			controller.output.urgent = urgent;
+		}
 
-				if (res == -1) {
-					controller.failedReadCount++;
-					continue;
-				}
-				else if (res > 0) {
-					controller.failedReadCount = 0;
-
-					if (!inputData.ButtonMute && controller.dualsenseCurInputState.ButtonMute) {
-						controller.dualsenseCurOutputState.AllowAudioMute = true;
-						controller.isMicMuted = !controller.isMicMuted;
-						controller.dualsenseCurOutputState.MuteLightMode = controller.isMicMuted ? dualsenseData::MuteLight::On : dualsenseData::MuteLight::Off;
-						controller.dualsenseCurOutputState.MicMute = controller.isMicMuted;
-						controller.dualsenseCurOutputState.AllowMuteLight = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowAudioMute = false;
-						controller.dualsenseCurOutputState.AllowMuteLight = false;
-					}
+		std::memcpy(controller.output.back.data, report, size);
+		controller.output.back.size = size;
+		controller.output.back.needsCrc = needsCrc;
+		controller.output.pending = true;
+	}
+}
 
-					if (controller.dualsenseCurOutputState.LedRed != controller.dualsenseLastOutputState.LedRed ||
-						controller.dualsenseCurOutputState.LedGreen != controller.dualsenseLastOutputState.LedGreen ||
-						controller.dualsenseCurOutputState.LedBlue != controller.dualsenseLastOutputState.LedBlue ||
-						controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowLedColor = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowLedColor = false;
-					}
+// Writer thread only
+static void queueFeatureReport(duaLibUtils::controller& controller, const void* report, size_t size) {
+	{
+		std::lock_guard guard(controller.output.lock);
 
-					bool oldStyle = ((controller.versionReport.HardwareInfo & 0x00FFFF00) < 0x00000400);
-					duaLibUtils::setPlayerLights(controller, oldStyle);
+		if (controller.output.featurePending) {
+			controller.writesSuppressed++;
+		}
 
-					if (controller.dualsenseCurOutputState.lightBrightness != controller.dualsenseLastOutputState.lightBrightness || controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowLightBrightnessChange = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowLightBrightnessChange = false;
-					}
+		std::memcpy(controller.output.featureBack.data, report, size);
+		controller.output.featureBack.size = size;
+		controller.output.featurePending = true;
+	}
+}
 
-					if ((controller.dualsenseCurOutputState.PlayerLight1 != controller.dualsenseLastOutputState.PlayerLight1 ||
-						controller.dualsenseCurOutputState.PlayerLight2 != controller.dualsenseLastOutputState.PlayerLight2 ||
-						controller.dualsenseCurOutputState.PlayerLight3 != controller.dualsenseLastOutputState.PlayerLight3 ||
-						controller.dualsenseCurOutputState.PlayerLight4 != controller.dualsenseLastOutputState.PlayerLight4) || controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowPlayerIndicators = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowPlayerIndicators = true; // keep on true because it doesn't always light up
-					}
+// The state that goes into the next output report. The update flags of a queued report that is still waiting
+// for the rate cap carry over, the new report replaces it and the device would never see those changes otherwise.
+template <typename T>
+static T nextOutputState(duaLibUtils::controller& controller, const T& current, T& queued) {
+	bool replacing = false;
+	{
+		std::lock_guard guard(controller.output.lock);
+		replacing = controller.output.pending;
+	}
 
-					if (controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.MicMute = controller.isMicMuted;
-						controller.dualsenseCurOutputState.AllowMuteLight = true;
-					}
+	T state = current;
+	if (replacing) duaLibUtils::keepUpdateFlags(state, queued);
 
-					if (controller.dualsenseCurOutputState.OutputPathSelect != controller.dualsenseLastOutputState.OutputPathSelect ||
-						controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowAudioControl = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowAudioControl = false;
-					}
+	queued = state;
+	return state;
+}
 
-					if (controller.dualsenseCurOutputState.VolumeSpeaker != controller.dualsenseLastOutputState.VolumeSpeaker ||
-						controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowSpeakerVolume = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowSpeakerVolume = false;
-					}
+// Lets the writer know the controller's output has to be rebuilt, only wakes it if it doesn't know yet
+static void requestOutput(duaLibUtils::controller& controller) {
+	if (!controller.outputDirty.exchange(true)) wakeWriter();
+}
 
-					if (controller.dualsenseCurOutputState.VolumeMic != controller.dualsenseLastOutputState.VolumeMic ||
-						controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowMicVolume = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowMicVolume = false;
-					}
+static_assert(sizeof(dualsenseData::ReportOut02) <= duaLibUtils::MAX_OUTPUT_REPORT_SIZE);
+static_assert(sizeof(dualsenseData::ReportOut31) <= duaLibUtils::MAX_OUTPUT_REPORT_SIZE);
+static_assert(sizeof(dualshock4Data::ReportIn05) <= duaLibUtils::MAX_OUTPUT_REPORT_SIZE);
+static_assert(sizeof(dualshock4Data::ReportOut11) <= duaLibUtils::MAX_OUTPUT_REPORT_SIZE);
+static_assert(sizeof(dualshock4Data::ReportFeatureInDongleSetAudio) <= duaLibUtils::MAX_OUTPUT_REPORT_SIZE);
 
-					if (controller.dualsenseCurOutputState.VolumeHeadphones != controller.dualsenseLastOutputState.VolumeHeadphones ||
-						controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowHeadphoneVolume = true;
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowHeadphoneVolume = false;
-					}
+static float Vec3Length(const s_SceFVector3& v) {
+	return std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+}
 
-					if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2 || controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowLeftTriggerFFB = true;
-						for (int i = 0; i < 11; i++) {
-							controller.dualsenseCurOutputState.LeftTriggerFFB[i] = controller.L2.force[i];
-						}
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowLeftTriggerFFB = false;
-					}
+static s_SceFVector3 Vec3Normalize(const s_SceFVector3& v) {
+	float len = Vec3Length(v);
+	if (len > 0.0f) {
+		return { v.x / len, v.y / len, v.z / len };
+	}
+	return v;
+}
 
-					if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2 || controller.wasDisconnected) {
-						controller.dualsenseCurOutputState.AllowRightTriggerFFB = true;
-						for (int i = 0; i < 11; i++) {
-							controller.dualsenseCurOutputState.RightTriggerFFB[i] = controller.R2.force[i];
-						}
-					}
-					else {
-						controller.dualsenseCurOutputState.AllowRightTriggerFFB = false;
-					}
+// To m/s^2 from nominal counts
+static float to_mpss(int32_t v) {
+	return v * static_cast<float>(9.80665 / ACCEL_COUNTS_PER_G);
+}
 
-					controller.dualsenseCurOutputState.HostTimestamp = controller.dualsenseCurInputState.SensorTimestamp;
-					res = -1;
+// To rad/s from nominal counts: 32768: 2000 deg/s (BMI055 data sheet Chapter 7.2.1)
+static float to_radps(int32_t v) {
+	return v * static_cast<float>(GYRO_RANGE_DEG_S * M_PI / 180.0 / 32768);
+}
 
-					if (controller.connectionType == HID_API_BUS_USB || controller.connectionType == HID_API_BUS_UNKNOWN) {
-						dualsenseData::ReportOut02 usbOutput = {};
+static int32_t calibrateAxis(const duaLibUtils::axisCalibration& axis, int16_t raw) {
+	return static_cast<int32_t>((static_cast<int64_t>(raw - axis.bias) * axis.scale) >> CALIBRATION_SHIFT);
+}
 
-						usbOutput.ReportID = 0x02;
-						usbOutput.State = controller.dualsenseCurOutputState;
+// Mahony filter, runs on the reader thread once for every report. dt comes from the controller's
+// sensor clock so the result doesn't depend on how often or by how many threads it gets read.
+static void updateOrientation(duaLibUtils::controller& controller, s_SceFVector3 gyro, const s_SceFVector3& accel, float dt) {
+	if (controller.orientationReset.exchange(false)) {
+		controller.orientation = { 0.0f,0.0f,0.0f,1.0f };
+		controller.eInt[0] = controller.eInt[1] = controller.eInt[2] = 0.0f;
+		controller.lastAcceleration = accel;
+	}
 
-						if ((controller.dualsenseCurOutputState != controller.dualsenseLastOutputState) || controller.wasDisconnected) {
-							res = hid_write(controller.handle, reinterpret_cast<unsigned char*>(&usbOutput), sizeof(usbOutput));
-						}
-					}
-					else if (controller.connectionType == HID_API_BUS_BLUETOOTH) {
-						dualsenseData::ReportOut31 btOutput = {};
-
-						btOutput.Data.ReportID = 0x31;
-						btOutput.Data.flag = 2;
-						btOutput.Data.State = controller.dualsenseCurOutputState;
-
-						uint32_t crc = compute(btOutput.CRC.Buff, sizeof(btOutput) - 4);
-						btOutput.CRC.CRC = crc;
-						if ((controller.dualsenseCurOutputState != controller.dualsenseLastOutputState) || controller.wasDisconnected) {
-							res = hid_write(controller.handle, reinterpret_cast<unsigned char*>(&btOutput), sizeof(btOutput));
-						}
-					}
+	if (dt <= 0.0f || dt > MAX_MOTION_DT) return;
 
-					if (res > 0) {
-						std::shared_lock guard(controller.lock);
-						controller.wasDisconnected = false;
-						//std::cout << "Controller idx " << controller.sceHandle << " path=" << controller.macAddress << " connType=" << (int)controller.connectionType << std::endl;
-					}
+	auto& q = controller.orientation;
 
-					{
-						std::shared_lock guard(controller.lock);
-						controller.dualsenseLastOutputState = controller.dualsenseCurOutputState;
-						controller.dualsenseCurInputState = inputData;
-					}
-				}
-			}
-			else if (controller.valid && controller.opened && controller.deviceType == DUALSHOCK4) {
-				allInvalid = false;
-				bool isBt = controller.connectionType == HID_API_BUS_BLUETOOTH ? true : false;
+	// Low pass the accelerometer a bit, it only has to tell where down is
+	controller.lastAcceleration.x += (accel.x - controller.lastAcceleration.x) * ACCEL_SMOOTHING;
+	controller.lastAcceleration.y += (accel.y - controller.lastAcceleration.y) * ACCEL_SMOOTHING;
+	controller.lastAcceleration.z += (accel.z - controller.lastAcceleration.z) * ACCEL_SMOOTHING;
 
-				dualshock4Data::ReportIn01USB inputUsb = {};
-				dualshock4Data::ReportIn01BT inputBt = {};
+	if (controller.tiltCorrection && Vec3Length(controller.lastAcceleration) > 0.0f) {
+		s_SceFVector3 a = Vec3Normalize(controller.lastAcceleration);
 
-				int32_t res = -1;
+		// Where up (+Y, the controller lying flat) should be according to the current orientation
+		s_SceFVector3 v = {
+			2.0f * (q.x * q.y + q.w * q.z),
+			1.0f - 2.0f * (q.x * q.x + q.z * q.z),
+			2.0f * (q.y * q.z - q.w * q.x)
+		};
 
-				if (isBt)
-					res = hid_read_timeout(controller.handle, reinterpret_cast<unsigned char*>(&inputBt), sizeof(inputBt), 0);
-				else
-					res = hid_read_timeout(controller.handle, reinterpret_cast<unsigned char*>(&inputUsb), sizeof(inputUsb), 0);
+		s_SceFVector3 e = {
+			a.y * v.z - a.z * v.y,
+			a.z * v.x - a.x * v.z,
+			a.x * v.y - a.y * v.x
+		};
 
-				if (controller.failedReadCount >= 15) {
-					controller.valid = false;
-				}
+		controller.eInt[0] += MAHONY_KI * e.x * dt;
+		controller.eInt[1] += MAHONY_KI * e.y * dt;
+		controller.eInt[2] += MAHONY_KI * e.z * dt;
 
-				if (res == -1) {
-					controller.failedReadCount++;
-					continue;
-				}
-				else if (res > 0) {
-					controller.failedReadCount = 0;
-
-					if (controller.dualshock4CurOutputState.LedRed != controller.dualshock4LastOutputState.LedRed ||
-					controller.dualshock4CurOutputState.LedGreen != controller.dualshock4LastOutputState.LedGreen ||
-					controller.dualshock4CurOutputState.LedBlue != controller.dualshock4LastOutputState.LedBlue ||
-					controller.wasDisconnected) {
-						controller.dualshock4CurOutputState.EnableLedUpdate = true;
-					}
-					else {
-						controller.dualshock4CurOutputState.EnableLedUpdate = true;
-					}
+		gyro.x += MAHONY_KP * e.x + controller.eInt[0];
+		gyro.y += MAHONY_KP * e.y + controller.eInt[1];
+		gyro.z += MAHONY_KP * e.z + controller.eInt[2];
+	}
 
-					if (controller.dualshock4CurAudio.Output != controller.dualshock4LastAudio.Output || controller.wasDisconnected) {
-						controller.dualshock4CurAudio.ReportID = 0xE0;
-						hid_send_feature_report(controller.handle, reinterpret_cast<unsigned char*>(&controller.dualshock4CurAudio), sizeof(controller.dualshock4CurAudio));
-						controller.dualshock4LastAudio.Output = controller.dualshock4CurAudio.Output;
-					}
+	s_SceFQuaternion qDot = {
+		0.5f * (q.w * gyro.x + q.y * gyro.z - q.z * gyro.y),
+		0.5f * (q.w * gyro.y + q.z * gyro.x - q.x * gyro.z),
+		0.5f * (q.w * gyro.z + q.x * gyro.y - q.y * gyro.x),
+		0.5f * (-q.x * gyro.x - q.y * gyro.y - q.z * gyro.z)
+	};
 
-					if (controller.dualshock4CurOutputState.VolumeSpeaker != controller.dualshock4LastOutputState.VolumeSpeaker || controller.wasDisconnected)
-						controller.dualshock4CurOutputState.EnableVolumeSpeakerUpdate = true;
-					else
-						controller.dualshock4CurOutputState.EnableVolumeSpeakerUpdate = false;
+	q.x += qDot.x * dt;
+	q.y += qDot.y * dt;
+	q.z += qDot.z * dt;
+	q.w += qDot.w * dt;
 
-					if (controller.dualshock4CurOutputState.VolumeMic != controller.dualshock4LastOutputState.VolumeMic || controller.wasDisconnected)
-						controller.dualshock4CurOutputState.EnableVolumeMicUpdate = true;
-					else
-						controller.dualshock4CurOutputState.EnableVolumeMicUpdate = false;
+	float norm = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	q.x /= norm; q.y /= norm; q.z /= norm; q.w /= norm;
+}
 
-					if (controller.dualshock4CurOutputState.VolumeLeft != controller.dualshock4LastOutputState.VolumeLeft || controller.wasDisconnected)
-						controller.dualshock4CurOutputState.EnableVolumeLeftUpdate = true;
-					else
-						controller.dualshock4CurOutputState.EnableVolumeLeftUpdate = false;
+// Averages the calibrated gyro while the controller lies still, gives up as soon as it moves
+static void estimateGyroBias(duaLibUtils::controller& controller) {
+	duaLibUtils::biasEstimator& estimator = controller.biasEstimation;
 
-					if (controller.dualshock4CurOutputState.VolumeRight != controller.dualshock4LastOutputState.VolumeRight || controller.wasDisconnected)
-						controller.dualshock4CurOutputState.EnableVolumeRightUpdate = true;
-					else
-						controller.dualshock4CurOutputState.EnableVolumeRightUpdate = false;
+	if (controller.biasEstimationRestart.exchange(false))
+		estimator = {};
 
-					if ((controller.dualshock4CurOutputState.RumbleLeft != controller.dualshock4LastOutputState.RumbleLeft) || (controller.dualshock4CurOutputState.RumbleRight != controller.dualshock4LastOutputState.RumbleRight) || controller.wasDisconnected)
-						controller.dualshock4CurOutputState.EnableRumbleUpdate = true;
-					else
-						controller.dualshock4CurOutputState.EnableRumbleUpdate = false;
+	if (controller.biasEstimationState != SCE_PAD_BIAS_ESTIMATION_RUNNING) return;
 
-					res = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		int32_t value = controller.motion.gyro[axis];
+		if (estimator.samples == 0 || value < estimator.min[axis]) estimator.min[axis] = value;
+		if (estimator.samples == 0 || value > estimator.max[axis]) estimator.max[axis] = value;
+		estimator.sum[axis] += value;
 
-					if (controller.connectionType == HID_API_BUS_USB || controller.connectionType == HID_API_BUS_UNKNOWN) {
-						dualshock4Data::ReportIn05 usbOutput = {};
+		if (estimator.max[axis] - estimator.min[axis] > GYRO_BIAS_MAX_SPREAD) {
+			estimator = {};
+			controller.biasEstimationState = SCE_PAD_BIAS_ESTIMATION_FAILED;
+			return;
+		}
+	}
 
-						usbOutput.ReportID = 0x05;
-						usbOutput.State = controller.dualshock4CurOutputState;
+	if (++estimator.samples < GYRO_BIAS_SAMPLES) return;
 
-						if ((controller.dualshock4CurOutputState != controller.dualshock4LastOutputState) || controller.wasDisconnected) {
-							res = hid_write(controller.handle, reinterpret_cast<unsigned char*>(&usbOutput), sizeof(usbOutput));
-						}
-					}
-					else if (controller.connectionType == HID_API_BUS_BLUETOOTH) {
-						dualshock4Data::ReportOut11 report = {};
-						report.Data.ReportID = 0x11;
-						report.Data.EnableHID = 1;
-						report.Data.AllowRed = controller.dualshock4CurOutputState.LedRed > 0 ? 1 : 0;
-						report.Data.AllowGreen = controller.dualshock4CurOutputState.LedGreen > 0 ? 1 : 0;
-						report.Data.AllowBlue = controller.dualshock4CurOutputState.LedBlue > 0 ? 1 : 0;
-						report.Data.EnableAudio = 0;
-						report.Data.State = controller.dualshock4CurOutputState;
-
-						uint32_t crc = compute(report.CRC.Buff, sizeof(report) - 4);
-						report.CRC.CRC = crc;
-
-						int res = hid_write(controller.handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
-					}
+	// What's left is on top of the bias measured last time
+	for (int axis = 0; axis < 3; axis++)
+		controller.gyroBias[axis] += static_cast<int32_t>(estimator.sum[axis] / estimator.samples);
 
-					if (res > 0) {
-						controller.wasDisconnected = false;
-						//std::cout << "Controller idx " << controller.sceHandle << " path=" << controller.macAddress << " connType=" << (int)controller.connectionType << std::endl;
-					}
+	estimator = {};
+	controller.biasEstimationState = SCE_PAD_BIAS_ESTIMATION_DONE;
+}
 
-					{
-						std::shared_lock guard(controller.lock);
-						controller.dualshock4LastOutputState = controller.dualshock4CurOutputState;
-						controller.dualshock4CurInputState = isBt ? inputBt.State : inputUsb.State;
-					}
-				}
-			}
-			else if (!controller.valid && controller.opened) {
-				std::shared_lock guard(controller.lock);
-				controller.wasDisconnected = true;
-			}
-		}
+// Calibrates one report worth of motion data in fixed point and feeds it to the orientation filter,
+// gyro and accel are raw values in report order
+static void updateMotion(duaLibUtils::controller& controller, const int16_t gyro[3], const int16_t accel[3], uint32_t sensorTimestamp, float dt) {
+	if (!controller.motionSensorState) return;
 
-		if (allInvalid) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		}
+	const duaLibUtils::motionCalibration& calibration = controller.calibration;
+	duaLibUtils::motionCounts& motion = controller.motion;
 
-	#if defined(_WIN32) || defined(_WIN64)
-		SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, 0);
-		WaitForSingleObject(hTimer, INFINITE);
-	#else
-		std::this_thread::sleep_for(std::chrono::microseconds(100));
-	#endif
+	for (int axis = 0; axis < 3; axis++) {
+		motion.gyro[axis] = calibrateAxis(calibration.gyro[axis], gyro[axis]) - controller.gyroBias[axis];
+		motion.accel[axis] = calibrateAxis(calibration.accel[axis], accel[axis]);
 	}
-	return 0;
-}
 
-int watchFunc() {
-#if defined(_WIN32) || defined(_WIN64)
-	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-#endif
+	estimateGyroBias(controller);
 
-	while (g_threadRunning) {
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+	s_ScePadMotionSample sample = {};
+	sample.angularVelocity = { to_radps(motion.gyro[0]), to_radps(motion.gyro[2]), to_radps(motion.gyro[1]) };
+	sample.acceleration = { to_mpss(motion.accel[0]), to_mpss(motion.accel[1]), to_mpss(motion.accel[2]) };
+	sample.sensorTimestamp = sensorTimestamp;
+	sample.calibrated = calibration.valid;
+	controller.motionSample.store(sample);
 
-		for (int j = 0; j < DEVICE_COUNT; ++j) {
-			hid_device_info* head = hid_enumerate(
-				g_deviceList.devices[j].Vendor,
-				g_deviceList.devices[j].Device
-			);
+	updateOrientation(controller, sample.angularVelocity, sample.acceleration, dt);
+}
+
+static void updateMotion(duaLibUtils::controller& controller, const dualsenseData::USBGetStateData& input) {
+	uint32_t ticks = input.SensorTimestamp - controller.lastSensorTimestamp; // 0.33us units, wraps at 32 bits
+	controller.lastSensorTimestamp = input.SensorTimestamp;
 
-			for (hid_device_info* info = head; info; info = info->next) {
-				std::string newMac;
-				bool already = false;
-				bool invalid = false;
-				bool started = false;
+	const int16_t gyro[3] = { input.AngularVelocityX, input.AngularVelocityZ, input.AngularVelocityY };
+	const int16_t accel[3] = { input.AccelerometerX, input.AccelerometerY, input.AccelerometerZ };
+	updateMotion(controller, gyro, accel, input.SensorTimestamp, ticks / 3000000.0f);
+}
 
-				hid_device* handle = hid_open_path(info->path);
+static void updateMotion(duaLibUtils::controller& controller, const dualshock4Data::USBGetStateData& input) {
+	uint16_t ticks = input.Timestamp - static_cast<uint16_t>(controller.lastSensorTimestamp); // 5.33us units, wraps at 16 bits
+	controller.lastSensorTimestamp = input.Timestamp;
 
-				if (info->bus_type == HID_API_BUS_BLUETOOTH && !g_allowBluetooth) {
-					hid_close(handle);
-					goto skipController;
-				}
+	const int16_t gyro[3] = { input.AngularVelocityX, input.AngularVelocityZ, input.AngularVelocityY };
+	const int16_t accel[3] = { input.AccelerometerX, input.AccelerometerY, input.AccelerometerZ };
+	updateMotion(controller, gyro, accel, input.Timestamp, ticks * 16.0f / 3000000.0f);
+}
 
-				if (!handle) continue;
+// Orientation as reported through s_ScePadData
+static s_SceFQuaternion padOrientation(const s_SceFQuaternion& q) {
+	return { q.x, q.z, q.y, q.w }; // yes this is swapped on purpose don't touch it
+}
 
-				if (duaLibUtils::getMacAddress(handle, newMac, g_deviceList.devices[j].Device, info->bus_type)) {
-					
-					// Ignore ViGEm controllers
-					if (newMac.rfind("C0:13:37") != std::string::npos) {
-						hid_close(handle);
-						continue;
-					}
+#pragma region decoding
+// Only reported in particular mode, masked out when the state is handed out so toggling it doesn't wait for a report
+#define PARTICULAR_MODE_BUTTONS (SCE_BM_SHARE | SCE_BM_PSBTN)
 
-					for (int k = 0; k < MAX_CONTROLLER_COUNT; ++k) {
-						std::shared_lock guard(g_controllers[k].lock);
-						if (g_controllers[k].macAddress == newMac && duaLibUtils::isValid(g_controllers[k].handle)) {
-							already = true;
-							hid_close(handle);
-							break;
-						}
-					}
+static float angularDeadband(float value, bool velocityDeadband) {
+	return velocityDeadband && value < ANGULAR_VELOCITY_DEADBAND_MIN && value > -ANGULAR_VELOCITY_DEADBAND_MIN ? 0 : value;
+}
 
-					// Restore half valid controllers
-					for (auto& controller : g_controllers) {				
-						if (duaLibUtils::isValid(controller.handle) && !controller.valid) {
-							std::shared_lock guard(controller.lock);
-							controller.valid = true;
-						}
-					}
+// Turns a raw report into s_ScePadData, runs once per report on the reader thread. The motion values
+// come from the calibrated counts updateMotion keeps, everything else straight from the report.
+template <typename T>
+static s_ScePadData decodeInput(const duaLibUtils::controller& controller, const T& input) {
+	s_ScePadData data = {};
+	decodeReport(input, data);
 
-					if (!already) {
-						for (auto& controller : g_controllers) {
-							bool valid;
-							{
-								std::shared_lock guard(controller.lock);
-								valid = duaLibUtils::isValid(controller.handle);
-							}
-
-							if (!valid) {
-
-								std::shared_lock guard(controller.lock);
-								controller.started = true;
-								controller.handle = handle;
-								controller.macAddress = newMac;
-								controller.connectionType = info->bus_type;
-								controller.valid = true;
-								controller.failedReadCount = 0;
-								controller.lastPath = info->path;
-								controller.productID = g_deviceList.devices[j].Device;
-
-								const char* id = {};
-								uint32_t size = 0;
-								duaLibUtils::GetID(info->path, &id, &size);
-
-							#if defined(_WIN32) || defined(_WIN64)
-								controller.id = id;
-								controller.idSize = size;
-							#endif
-
-								uint16_t dev = g_deviceList.devices[j].Device;
-
-								if (dev == DUALSENSE_DEVICE_ID || dev == DUALSENSE_EDGE_DEVICE_ID) { controller.deviceType = DUALSENSE; }
-								else if (dev == DUALSHOCK4_DEVICE_ID || dev == DUALSHOCK4V2_DEVICE_ID || dev == DUALSHOCK4_WIRELESS_ADAPTOR_ID) { controller.deviceType = DUALSHOCK4; }
-
-								if (controller.deviceType == DUALSENSE) {
-									duaLibUtils::getHardwareVersion(controller.handle, controller.versionReport);
-								}
-								else if (controller.deviceType == DUALSENSE && info->bus_type == HID_API_BUS_BLUETOOTH) {
-									duaLibUtils::getHardwareVersion(controller.handle, controller.versionReport);
-									dualsenseData::ReportOut31 report = {};
-
-									report.Data.ReportID = 0x31;
-									report.Data.flag = 2;
-									
-									report.Data.State.EnableRumbleEmulation = true;
-									report.Data.State.UseRumbleNotHaptics = true;
-									report.Data.State.AllowRightTriggerFFB = true;
-									report.Data.State.AllowLeftTriggerFFB = true;
-									report.Data.State.AllowLedColor = true;
-									report.Data.State.AllowColorLightFadeAnimation = true;
-									report.Data.State.LeftTriggerFFB[0] = (uint8_t)TriggerEffectType::Off;
-									report.Data.State.RightTriggerFFB[0] = (uint8_t)TriggerEffectType::Off;
-
-									uint32_t crc = compute(report.CRC.Buff, sizeof(report) - 4);
-									report.CRC.CRC = crc;
-
-									hid_write(controller.handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
-								}
-								else if (controller.deviceType == DUALSHOCK4 && info->bus_type == HID_API_BUS_BLUETOOTH) {
-									dualshock4Data::ReportOut11 report = {};
-									report.Data.ReportID = 0x11;
-									report.Data.EnableHID = 1;
-									report.Data.AllowRed = 0;
-									report.Data.AllowGreen = 0;
-									report.Data.AllowBlue = 0;
-									report.Data.EnableAudio = 0;
-									report.Data.State.LedRed = 0;
-									report.Data.State.LedGreen = 0;
-									report.Data.State.LedBlue = 0;
-									report.Data.State.EnableLedUpdate = true;
-
-									uint32_t crc = compute(report.CRC.Buff, sizeof(report) - 4);
-									report.CRC.CRC = crc;
-
-									int res = hid_write(controller.handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
-
-									unsigned char fullReportFeature[78];
-									fullReportFeature[0] = 0x05;
-									hid_get_feature_report(controller.handle, fullReportFeature, sizeof(fullReportFeature)); // <-- send this to receive full report
-								}
-
-								break;
-							}
-						}
-					}
+#pragma region gyro
+	if (controller.motionSensorState) {
+		bool velocityDeadband = controller.velocityDeadband;
+		const duaLibUtils::motionCounts& motion = controller.motion; // Calibrated by updateMotion, same scale as the raw values
 
-				skipController:
-					{}
-				}
-			}
+		data.acceleration.x = (float)motion.accel[0];
+		data.acceleration.y = (float)motion.accel[1];
+		data.acceleration.z = (float)motion.accel[2];
 
-			hid_free_enumeration(head);
-		}
+		data.angularVelocity.x = angularDeadband((float)motion.gyro[0], velocityDeadband);
+		data.angularVelocity.y = angularDeadband((float)motion.gyro[2], velocityDeadband);
+		data.angularVelocity.z = angularDeadband((float)motion.gyro[1], velocityDeadband);
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		data.orientation = padOrientation(controller.orientation);
 	}
+#pragma endregion
 
-	return 0;
+	return data;
 }
 
-int scePadInit() {
-	s_ScePadInitParam param = {};
-	param.allowBT = false;
+// Applies what can change between two reports to a decoded state before it's handed out
+static void finishPadData(const duaLibUtils::controller& controller, s_ScePadData& data) {
+	if (!g_particularMode)
+		data.bitmask_buttons &= ~PARTICULAR_MODE_BUTTONS;
 
-	return scePadInit3(&param);
+	data.connected = controller.valid;
 }
+#pragma endregion
 
-int scePadInit3(s_ScePadInitParam* param) {
-	if (!param) return SCE_PAD_ERROR_INVALID_ARG;
+// Every input read goes through here so reads from outside the reader threads, which would steal
+// reports from them, show up in the statistics
+static int readInputReport(duaLibUtils::controller& controller, void* data, size_t size, int timeoutMs) {
+	if (!t_isReaderThread) controller.foreignReads++;
 
-	if (!g_initialized) {
-		int res = hid_init();
+	// The watcher waits for a blocking read to return before it closes or replaces the handle,
+	// a slot caught in between just has nothing to read yet
+	std::shared_lock guard(controller.handleLock);
+	if (!controller.handle) return 0;
 
-		if (res)
-			return res;
+	return activeTransport().read(controller.handle, reinterpret_cast<unsigned char*>(data), size, timeoutMs);
+}
 
-		for (auto& controller : g_controllers) {
-			controller.dualsenseLastOutputState.OutputPathSelect = 10; // Set it to something bigger than 4 so the audio path can reset back to 0 on first write
-		}
+static void readSucceeded(duaLibUtils::controller& controller) {
+	controller.linkState = duaLibUtils::LinkState::Connected;
+	controller.lastReportAt = std::chrono::steady_clock::now();
+	controller.retryDelayMs = 0;
+}
 
-		g_allowBluetooth = param->allowBT;
-		g_threadRunning = true;
-		g_readThread = std::thread(readFunc);
-		g_watchThread = std::thread(watchFunc);
-		g_readThread.detach();
-		g_watchThread.detach();
-		g_initialized = true;
+// Closes the slot's device and forgets it once nobody is using it anymore. Never call it while holding handleLock.
+static void releaseHandle(duaLibUtils::controller& controller) {
+	transportDevice* handle = nullptr;
+	{
+		std::unique_lock guard(controller.handleLock);
+		handle = std::exchange(controller.handle, nullptr);
 	}
 
-	return SCE_OK;
+	if (handle) activeTransport().close(handle);
 }
 
-int scePadTerminate(void) {
-	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	g_threadRunning = false;
-	g_initialized = false;
-
-	for (auto& controller : g_controllers) {
-		// release controller here
+// Reads that fail get retried with a growing delay, the slot is only given up once they
+// kept failing for LINK_LOSS_TIMEOUT_MS
+static void readFailed(duaLibUtils::controller& controller, int error) {
+	auto now = std::chrono::steady_clock::now();
+	controller.readErrors++;
+	controller.lastReadError = error;
+
+	if (controller.linkState != duaLibUtils::LinkState::Recovering) {
+		controller.linkState = duaLibUtils::LinkState::Recovering;
+		controller.firstErrorAt = now;
+		controller.retryDelayMs = 1;
+	}
+	else if (now - controller.firstErrorAt > std::chrono::milliseconds(LINK_LOSS_TIMEOUT_MS)) {
+		controller.linkState = duaLibUtils::LinkState::Lost;
 		controller.valid = false;
-		controller.sceHandle = 0;
-		controller.lastPath = "";
-		controller.productID = 0;
-		controller.wasDisconnected = true;
-		controller.macAddress = "";
-
-		duaLibUtils::letGo(controller.handle, controller.deviceType, controller.connectionType);
+		releaseHandle(controller);
+		return;
+	}
+	else {
+		controller.retryDelayMs = std::min(controller.retryDelayMs * 2, (uint32_t)MAX_RETRY_DELAY_MS);
 	}
-	g_particularMode = false;
 
-	//if (g_readThread.joinable()) {
-	//	g_readThread.join();
-	//}
-	//if (g_watchThread.joinable()) {
-	//	g_watchThread.join();
-	//}
-	return SCE_OK;
+	controller.retryAt = now + std::chrono::milliseconds(controller.retryDelayMs);
 }
 
-int scePadOpen(int userID, int unk1, int unk2) {
-	volatile int preventOptim1 = unk1;
-	volatile int preventOptim2 = unk2;
-	(void)preventOptim1;
-	(void)preventOptim2;
+static void readDualsense(duaLibUtils::controller& controller, int timeoutMs) {
+	bool isBt = controller.connectionType == HID_API_BUS_BLUETOOTH ? true : false;
 
-	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	if (userID > MAX_CONTROLLER_COUNT || userID < 1) return SCE_PAD_ERROR_INVALID_ARG;
+	dualsenseData::ReportIn01USB  inputUsb = {};
+	dualsenseData::ReportIn31  inputBt = {};
 
-	int index = userID - 1;
-	bool wasAlreadyOpened = false;
-	int lastUnused = 0;
-	int firstUnused = -1;
-	int occupiedCount = 0;
-	int count = 0;
+	int32_t res = -1;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	if (isBt) 
+		res = readInputReport(controller, &inputBt, sizeof(inputBt), timeoutMs);
+	else 
+		res = readInputReport(controller, &inputUsb, sizeof(inputUsb), timeoutMs);
 
-		if (controller.sceHandle == 0 && controller.playerIndex != userID) {
-			if (firstUnused == -1)
-				firstUnused = count;
+	dualsenseData::USBGetStateData inputData = isBt ? inputBt.Data.State.StateData : inputUsb.State;
 
-			lastUnused++;
-		}
-		else if (controller.sceHandle == sizeof(controller) * (occupiedCount + 1) || controller.playerIndex == userID) {
-			if (occupiedCount > DEVICE_COUNT) {
-				wasAlreadyOpened = true;
-				return SCE_PAD_ERROR_ALREADY_OPENED;
+	if (res < 0) {
+		readFailed(controller, res);
+		return;
+	}
+	else if (res > 0) {
+		readSucceeded(controller);
+		controller.reportsRead++;
+
+		// Drain everything that queued up since the last wakeup and only publish the newest report,
+		// the mute button still has to see every report or a short press could get lost
+		dualsenseData::USBGetStateData previousData = controller.dualsenseCurInputState;
+		s_ScePadData decoded = {};
+		uint64_t receivedAtUs = 0;
+		bool muteToggled = false;
+
+		for (int i = 0; i <= MAX_DRAINED_REPORTS; i++) {
+			if (!inputData.ButtonMute && previousData.ButtonMute) {
+				controller.isMicMuted = !controller.isMicMuted;
+				muteToggled = true;
 			}
+			previousData = inputData;
+			updateMotion(controller, inputData);
+			decoded = decodeInput(controller, inputData);
+			receivedAtUs = controller.history.push(DUALSENSE, inputData, inputData.SensorTimestamp, decoded);
+
+			if (i == MAX_DRAINED_REPORTS) break;
+
+			if (isBt)
+				res = readInputReport(controller, &inputBt, sizeof(inputBt), 0);
+			else
+				res = readInputReport(controller, &inputUsb, sizeof(inputUsb), 0);
+
+			if (res <= 0) break;
+
+			inputData = isBt ? inputBt.Data.State.StateData : inputUsb.State;
+			controller.reportsRead++;
+			controller.staleReportsSkipped++;
 		}
-		else {
-			occupiedCount++;
+
+		controller.dualsenseCurInputState = inputData;
+		controller.dualsenseInput.store(inputData);
+		controller.padData.store({ decoded, receivedAtUs });
+		controller.fusedOrientation.store(controller.orientation);
+
+		if (muteToggled) {
+			controller.pendingMuteUpdate = true;
 		}
 
-		count++;
+		requestOutput(controller);
 	}
+}
 
-	if (!wasAlreadyOpened) {
-		int handle = sizeof(duaLibUtils::controller) * (firstUnused + 1);
-		g_controllers[firstUnused].sceHandle = handle;
-		g_controllers[firstUnused].opened = true;
-		g_controllers[firstUnused].playerIndex = userID;
+static void readDualshock4(duaLibUtils::controller& controller, int timeoutMs) {
+	bool isBt = controller.connectionType == HID_API_BUS_BLUETOOTH ? true : false;
 
-		g_controllers[firstUnused].dualshock4CurOutputState.LedRed = g_playerColors[userID - 1].r;
-		g_controllers[firstUnused].dualshock4CurOutputState.LedGreen = g_playerColors[userID - 1].g;
-		g_controllers[firstUnused].dualshock4CurOutputState.LedBlue = g_playerColors[userID - 1].b;
+	dualshock4Data::ReportIn01USB inputUsb = {};
+	dualshock4Data::ReportIn01BT inputBt = {};
 
-		return handle;
+	int32_t res = -1;
+
+	if (isBt)
+		res = readInputReport(controller, &inputBt, sizeof(inputBt), timeoutMs);
+	else
+		res = readInputReport(controller, &inputUsb, sizeof(inputUsb), timeoutMs);
+
+	if (res < 0) {
+		readFailed(controller, res);
+		return;
 	}
+	else if (res > 0) {
+		readSucceeded(controller);
+		controller.reportsRead++;
+
+		const dualshock4Data::USBGetStateData& first = isBt ? inputBt.State : inputUsb.State;
+		updateMotion(controller, first);
+		s_ScePadData decoded = decodeInput(controller, first);
+		uint64_t receivedAtUs = controller.history.push(DUALSHOCK4, first, first.Timestamp, decoded);
+
+		// Drain everything that queued up since the last wakeup and only publish the newest report,
+		// the history still gets every one of them
+		for (int i = 0; i < MAX_DRAINED_REPORTS; i++) {
+			dualshock4Data::ReportIn01USB nextUsb = {};
+			dualshock4Data::ReportIn01BT nextBt = {};
+			int32_t next = -1;
+
+			if (isBt)
+				next = readInputReport(controller, &nextBt, sizeof(nextBt), 0);
+			else
+				next = readInputReport(controller, &nextUsb, sizeof(nextUsb), 0);
+
+			if (next <= 0) break;
+
+			inputUsb = nextUsb;
+			inputBt = nextBt;
+			controller.reportsRead++;
+
+			const dualshock4Data::USBGetStateData& latest = isBt ? inputBt.State : inputUsb.State;
+			updateMotion(controller, latest);
+			decoded = decodeInput(controller, latest);
+			receivedAtUs = controller.history.push(DUALSHOCK4, latest, latest.Timestamp, decoded);
+			controller.staleReportsSkipped++;
+		}
 
-	return SCE_PAD_ERROR_NO_HANDLE;
-}
+		controller.dualshock4CurInputState = isBt ? inputBt.State : inputUsb.State;
+		controller.dualshock4Input.store(controller.dualshock4CurInputState);
+		controller.padData.store({ decoded, receivedAtUs });
+		controller.fusedOrientation.store(controller.orientation);
 
-int scePadSetParticularMode(bool mode) {
-	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	g_particularMode = mode;
-	return SCE_OK;
+		requestOutput(controller);
+	}
+}
+
+static void queryContainerId(const char* path, deviceMetadata& metadata) {
+	char id[39] = {};
+	uint32_t size = 0;
+
+	if (duaLibUtils::GetID(path, id, &size)) {
+		metadata.containerId = id;
+		metadata.containerIdSize = size;
+	}
+}
+
+// Caller holds the controller's lock exclusively
+static void applyMetadata(duaLibUtils::controller& controller, const deviceMetadata& metadata) {
+	controller.macAddress = metadata.macAddress;
+
+	if (metadata.hasVersionReport)
+		controller.versionReport = metadata.versionReport;
+
+#if defined(_WIN32) || defined(_WIN64)
+	controller.id = metadata.containerId;
+	controller.idSize = metadata.containerIdSize;
+#endif
+}
+
+// Controllers set up from the metadata cache ask the device for the real thing after they started streaming.
+// Runs on the watcher so the feature report round trips never hold up a reader. A device that doesn't answer
+// keeps the cached data.
+static void verifyMetadata(duaLibUtils::controller& controller) {
+	controller.metadataPending = false;
+
+	std::string path;
+	std::string serial;
+	uint16_t productID = 0;
+	uint8_t connectionType = 0;
+	uint8_t deviceType = UNKNOWN;
+	{
+		std::shared_lock guard(controller.lock);
+		path = controller.lastPath;
+		serial = controller.serialNumber;
+		productID = controller.productID;
+		connectionType = controller.connectionType;
+		deviceType = controller.deviceType;
+	}
+
+	deviceMetadata metadata = {};
+	{
+		// The reader can lose the device meanwhile, it waits with closing the handle until this is done
+		std::shared_lock guard(controller.handleLock);
+		if (!controller.valid || !duaLibUtils::getMacAddress(controller.handle, metadata.macAddress, productID, connectionType)) return;
+
+		if (deviceType == DUALSENSE)
+			metadata.hasVersionReport = duaLibUtils::getHardwareVersion(controller.handle, metadata.versionReport);
+	}
+
+	queryContainerId(path.c_str(), metadata);
+
+	{
+		std::unique_lock guard(controller.lock);
+		if (!controller.valid || controller.lastPath != path) return;
+		applyMetadata(controller, metadata);
+	}
+
+	storeDeviceMetadata(path, serial, metadata);
+}
+
+static void verifyPendingMetadata() {
+	for (auto& controller : activeControllers()) {
+		if (controller.metadataPending && controller.valid) verifyMetadata(controller);
+	}
+}
+
+// Reads and processes one report from the controller, returns true if the controller is active
+static bool readController(duaLibUtils::controller& controller, int timeoutMs) {
+	if (controller.valid && controller.opened && controller.linkState == duaLibUtils::LinkState::Recovering) {
+		auto now = std::chrono::steady_clock::now();
+
+		if (now < controller.retryAt) {
+			// The poll reader has other controllers to take care of, the blocking one can just wait
+			if (timeoutMs == 0) return true;
+			std::this_thread::sleep_until(controller.retryAt);
+		}
+	}
+	else if (controller.valid && controller.opened && controller.linkState == duaLibUtils::LinkState::Connected &&
+		std::chrono::steady_clock::now() - controller.lastReportAt.load() > std::chrono::milliseconds(LINK_STALL_TIMEOUT_MS)) {
+		controller.linkState = duaLibUtils::LinkState::Stalled;
+	}
+
+	if (controller.valid && controller.opened && controller.deviceType == DUALSENSE) {
+		readDualsense(controller, timeoutMs);
+		return true;
+	}
+	else if (controller.valid && controller.opened && controller.deviceType == DUALSHOCK4) {
+		readDualshock4(controller, timeoutMs);
+		return true;
+	}
+	else if (!controller.valid && controller.opened) {
+		controller.wasDisconnected = true;
+	}
+
+	return false;
+}
+
+// Restricts the calling thread to the CPUs in mask, 0 leaves scheduling to the OS
+static void pinCurrentThread(uint64_t mask) {
+	if (!mask) return;
+
+#if defined(_WIN32) || defined(_WIN64)
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	for (int cpu = 0; cpu < 64; cpu++) {
+		if (mask & (1ULL << cpu))
+			CPU_SET(cpu, &set);
+	}
+
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// Slots are split into contiguous shards, each one served by its own reader (poll mode)
+// or by readers sharing the shard's CPUs (blocking mode)
+static int readerShardCount() {
+	int controllers = g_controllerCount;
+	int threads = g_readerThreadCount;
+
+	if (threads <= 0)
+		threads = (controllers + READER_SHARD_SIZE - 1) / READER_SHARD_SIZE;
+
+	return std::clamp(threads, 1, std::min(controllers, MAX_READER_THREADS));
+}
+
+static int shardFirstSlot(int shard, int shards) {
+	return shard * g_controllerCount / shards;
+}
+
+static void prepareReaderThread(int shard) {
+	t_isReaderThread = true;
+	pinCurrentThread(g_readerAffinity[shard]);
+
+#if defined(_WIN32) || defined(_WIN64)
+	SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+	SetThreadExecutionState(
+		ES_CONTINUOUS | ES_SYSTEM_REQUIRED | ES_AWAYMODE_REQUIRED
+	);
+#endif
+}
+
+static void wakeReaders() {
+	std::lock_guard guard(g_readerWakeLock);
+	g_readerWake.notify_all();
+}
+
+// Fallback reader, polls the slots [first, first + count) in a loop
+int readFunc(int shard, int first, int count) {
+	prepareReaderThread(shard);
+
+#if defined(_WIN32) || defined(_WIN64)
+	timeBeginPeriod(1);
+
+	HANDLE hTimer = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	LARGE_INTEGER liDueTime;
+	liDueTime.QuadPart = -5000LL;
+#endif
+
+	while (g_threadRunning) {
+		bool allInvalid = true;		
+		
+		for (auto& controller : std::span<duaLibUtils::controller>(g_controllers + first, count)) {
+			if (readController(controller, 0)) {
+				allInvalid = false;
+			}
+		}
+
+		if (allInvalid) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+	#if defined(_WIN32) || defined(_WIN64)
+		SetWaitableTimer(hTimer, &liDueTime, 0, NULL, NULL, 0);
+		WaitForSingleObject(hTimer, INFINITE);
+	#else
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	#endif
+	}
+	return 0;
+}
+
+// Blocking reader, one per controller slot. Sleeps until the slot has a device and then
+// blocks in its read, so it wakes up as soon as a report arrives.
+int deviceReadFunc(int index, int shard) {
+	prepareReaderThread(shard);
+
+	duaLibUtils::controller& controller = g_controllers[index];
+
+	while (g_threadRunning) {
+		if (!controller.valid || !controller.opened) {
+			if (controller.opened) {
+				controller.wasDisconnected = true;
+			}
+
+			std::unique_lock lock(g_readerWakeLock);
+			g_readerWake.wait(lock, [&controller] {
+				return !g_threadRunning || (controller.valid && controller.opened);
+			});
+			continue;
+		}
+
+		readController(controller, BLOCKING_READ_TIMEOUT_MS);
+	}
+	return 0;
+}
+
+// Builds the output report from what the setters and the reader left behind and queues it if anything changed.
+// Caller holds the controller's lock exclusively.
+static void composeDualsenseOutput(duaLibUtils::controller& controller) {
+	if (controller.pendingMuteUpdate.exchange(false)) {
+		controller.dualsenseCurOutputState.AllowAudioMute = true;
+		controller.dualsenseCurOutputState.MuteLightMode = controller.isMicMuted ? dualsenseData::MuteLight::On : dualsenseData::MuteLight::Off;
+		controller.dualsenseCurOutputState.MicMute = controller.isMicMuted;
+		controller.dualsenseCurOutputState.AllowMuteLight = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowAudioMute = false;
+		controller.dualsenseCurOutputState.AllowMuteLight = false;
+	}
+
+	if (controller.dualsenseCurOutputState.LedRed != controller.dualsenseLastOutputState.LedRed ||
+		controller.dualsenseCurOutputState.LedGreen != controller.dualsenseLastOutputState.LedGreen ||
+		controller.dualsenseCurOutputState.LedBlue != controller.dualsenseLastOutputState.LedBlue ||
+		controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowLedColor = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowLedColor = false;
+	}
+
+	bool oldStyle = ((controller.versionReport.HardwareInfo & 0x00FFFF00) < 0x00000400);
+	duaLibUtils::setPlayerLights(controller, oldStyle);
+
+	if (controller.dualsenseCurOutputState.lightBrightness != controller.dualsenseLastOutputState.lightBrightness || controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowLightBrightnessChange = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowLightBrightnessChange = false;
+	}
+
+	if ((controller.dualsenseCurOutputState.PlayerLight1 != controller.dualsenseLastOutputState.PlayerLight1 ||
+		controller.dualsenseCurOutputState.PlayerLight2 != controller.dualsenseLastOutputState.PlayerLight2 ||
+		controller.dualsenseCurOutputState.PlayerLight3 != controller.dualsenseLastOutputState.PlayerLight3 ||
+		controller.dualsenseCurOutputState.PlayerLight4 != controller.dualsenseLastOutputState.PlayerLight4) || controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowPlayerIndicators = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowPlayerIndicators = true; // keep on true because it doesn't always light up
+	}
+
+	if (controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.MicMute = controller.isMicMuted;
+		controller.dualsenseCurOutputState.AllowMuteLight = true;
+	}
+
+	if (controller.dualsenseCurOutputState.OutputPathSelect != controller.dualsenseLastOutputState.OutputPathSelect ||
+		controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowAudioControl = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowAudioControl = false;
+	}
+
+	if (controller.dualsenseCurOutputState.VolumeSpeaker != controller.dualsenseLastOutputState.VolumeSpeaker ||
+		controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowSpeakerVolume = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowSpeakerVolume = false;
+	}
+
+	if (controller.dualsenseCurOutputState.VolumeMic != controller.dualsenseLastOutputState.VolumeMic ||
+		controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowMicVolume = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowMicVolume = false;
+	}
+
+	if (controller.dualsenseCurOutputState.VolumeHeadphones != controller.dualsenseLastOutputState.VolumeHeadphones ||
+		controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowHeadphoneVolume = true;
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowHeadphoneVolume = false;
+	}
+
+	if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2 || controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowLeftTriggerFFB = true;
+		for (int i = 0; i < 11; i++) {
+			controller.dualsenseCurOutputState.LeftTriggerFFB[i] = controller.L2.force[i];
+		}
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowLeftTriggerFFB = false;
+	}
+
+	if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2 || controller.wasDisconnected) {
+		controller.dualsenseCurOutputState.AllowRightTriggerFFB = true;
+		for (int i = 0; i < 11; i++) {
+			controller.dualsenseCurOutputState.RightTriggerFFB[i] = controller.R2.force[i];
+		}
+	}
+	else {
+		controller.dualsenseCurOutputState.AllowRightTriggerFFB = false;
+	}
+
+	controller.dualsenseCurOutputState.HostTimestamp = controller.dualsenseInput.load().SensorTimestamp;
+
+	bool outputChanged = (controller.dualsenseCurOutputState != controller.dualsenseLastOutputState) || controller.wasDisconnected;
+	bool urgent = controller.wasDisconnected || duaLibUtils::isUrgentOutput(controller.dualsenseCurOutputState, controller.dualsenseLastOutputState);
+
+	if (outputChanged && (controller.connectionType == HID_API_BUS_USB || controller.connectionType == HID_API_BUS_UNKNOWN)) {
+		dualsenseData::ReportOut02 usbOutput = {};
+
+		usbOutput.ReportID = 0x02;
+		usbOutput.State = nextOutputState(controller, controller.dualsenseCurOutputState, controller.dualsenseQueuedOutputState);
+
+		queueOutputReport(controller, &usbOutput, sizeof(usbOutput), urgent, false);
+	}
+	else if (outputChanged && controller.connectionType == HID_API_BUS_BLUETOOTH) {
+		dualsenseData::ReportOut31 btOutput = {};
+
+		btOutput.Data.ReportID = 0x31;
+		btOutput.Data.flag = 2;
+		btOutput.Data.State = nextOutputState(controller, controller.dualsenseCurOutputState, controller.dualsenseQueuedOutputState);
+
+		queueOutputReport(controller, &btOutput, sizeof(btOutput), urgent, true);
+	}
+
+	controller.dualsenseLastOutputState = controller.dualsenseCurOutputState;
+}
+
+// Caller holds the controller's lock exclusively
+static void composeDualshock4Output(duaLibUtils::controller& controller) {
+	if (controller.dualshock4CurOutputState.LedRed != controller.dualshock4LastOutputState.LedRed ||
+	controller.dualshock4CurOutputState.LedGreen != controller.dualshock4LastOutputState.LedGreen ||
+	controller.dualshock4CurOutputState.LedBlue != controller.dualshock4LastOutputState.LedBlue ||
+	controller.wasDisconnected) {
+		controller.dualshock4CurOutputState.EnableLedUpdate = true;
+	}
+	else {
+		controller.dualshock4CurOutputState.EnableLedUpdate = true;
+	}
+
+	if (controller.dualshock4CurAudio.Output != controller.dualshock4LastAudio.Output || controller.wasDisconnected) {
+		controller.dualshock4CurAudio.ReportID = 0xE0;
+		queueFeatureReport(controller, &controller.dualshock4CurAudio, sizeof(controller.dualshock4CurAudio));
+		controller.dualshock4LastAudio.Output = controller.dualshock4CurAudio.Output;
+	}
+
+	if (controller.dualshock4CurOutputState.VolumeSpeaker != controller.dualshock4LastOutputState.VolumeSpeaker || controller.wasDisconnected)
+		controller.dualshock4CurOutputState.EnableVolumeSpeakerUpdate = true;
+	else
+		controller.dualshock4CurOutputState.EnableVolumeSpeakerUpdate = false;
+
+	if (controller.dualshock4CurOutputState.VolumeMic != controller.dualshock4LastOutputState.VolumeMic || controller.wasDisconnected)
+		controller.dualshock4CurOutputState.EnableVolumeMicUpdate = true;
+	else
+		controller.dualshock4CurOutputState.EnableVolumeMicUpdate = false;
+
+	if (controller.dualshock4CurOutputState.VolumeLeft != controller.dualshock4LastOutputState.VolumeLeft || controller.wasDisconnected)
+		controller.dualshock4CurOutputState.EnableVolumeLeftUpdate = true;
+	else
+		controller.dualshock4CurOutputState.EnableVolumeLeftUpdate = false;
+
+	if (controller.dualshock4CurOutputState.VolumeRight != controller.dualshock4LastOutputState.VolumeRight || controller.wasDisconnected)
+		controller.dualshock4CurOutputState.EnableVolumeRightUpdate = true;
+	else
+		controller.dualshock4CurOutputState.EnableVolumeRightUpdate = false;
+
+	if ((controller.dualshock4CurOutputState.RumbleLeft != controller.dualshock4LastOutputState.RumbleLeft) || (controller.dualshock4CurOutputState.RumbleRight != controller.dualshock4LastOutputState.RumbleRight) || controller.wasDisconnected)
+		controller.dualshock4CurOutputState.EnableRumbleUpdate = true;
+	else
+		controller.dualshock4CurOutputState.EnableRumbleUpdate = false;
+
+	bool outputChanged = (controller.dualshock4CurOutputState != controller.dualshock4LastOutputState) || controller.wasDisconnected;
+	bool urgent = controller.wasDisconnected || duaLibUtils::isUrgentOutput(controller.dualshock4CurOutputState, controller.dualshock4LastOutputState);
+
+	if (outputChanged && (controller.connectionType == HID_API_BUS_USB || controller.connectionType == HID_API_BUS_UNKNOWN)) {
+		dualshock4Data::ReportIn05 usbOutput = {};
+
+		usbOutput.ReportID = 0x05;
+		usbOutput.State = nextOutputState(controller, controller.dualshock4CurOutputState, controller.dualshock4QueuedOutputState);
+
+		queueOutputReport(controller, &usbOutput, sizeof(usbOutput), urgent, false);
+	}
+	else if (outputChanged && controller.connectionType == HID_API_BUS_BLUETOOTH) {
+		dualshock4Data::ReportOut11 report = {};
+		report.Data.ReportID = 0x11;
+		report.Data.EnableHID = 1;
+		report.Data.AllowRed = controller.dualshock4CurOutputState.LedRed > 0 ? 1 : 0;
+		report.Data.AllowGreen = controller.dualshock4CurOutputState.LedGreen > 0 ? 1 : 0;
+		report.Data.AllowBlue = controller.dualshock4CurOutputState.LedBlue > 0 ? 1 : 0;
+		report.Data.EnableAudio = 0;
+		report.Data.State = nextOutputState(controller, controller.dualshock4CurOutputState, controller.dualshock4QueuedOutputState);
+
+		queueOutputReport(controller, &report, sizeof(report), urgent, true);
+	}
+
+	controller.dualshock4LastOutputState = controller.dualshock4CurOutputState;
+}
+
+// Writer thread only, the readers just flag the controller so they never touch the output state themselves
+static void composeOutput(duaLibUtils::controller& controller) {
+	std::unique_lock guard(controller.lock);
+	if (!controller.valid || !controller.opened) return;
+
+	if (controller.deviceType == DUALSENSE)
+		composeDualsenseOutput(controller);
+	else if (controller.deviceType == DUALSHOCK4)
+		composeDualshock4Output(controller);
+}
+
+// Sends whatever is due for the controller and returns when the next pending report will be due.
+// Rumble and trigger changes only wait for the transport's rate cap, everything else is also held
+// back for the coalescing window so multiple setters end up in the same report.
+static std::chrono::steady_clock::time_point flushOutput(duaLibUtils::controller& controller, std::chrono::steady_clock::time_point now, bool urgentOnly) {
+	duaLibUtils::outputBuffer& buffer = controller.output;
+	auto nextDue = std::chrono::steady_clock::time_point::max();
+	bool sendReport = false;
+	bool sendFeature = false;
+
+	{
+		std::lock_guard guard(buffer.lock);
+
+		if (buffer.pending && (buffer.urgent || !urgentOnly)) {
+			auto minInterval = std::chrono::microseconds(controller.connectionType == HID_API_BUS_BLUETOOTH ? g_btWriteIntervalUs.load() : g_usbWriteIntervalUs.load());
+			auto due = buffer.lastWrite + minInterval;
+
+			if (!buffer.urgent) {
+				due = std::max(due, buffer.queuedAt + std::chrono::microseconds(g_coalesceWindowUs.load()));
+			}
+
+			if (due <= now) {
+				buffer.front = buffer.back;
+				buffer.pending = false;
+				buffer.lastWrite = now;
+				sendReport = true;
+			}
+			else {
+				nextDue = due;
+			}
+		}
+
+		if (buffer.featurePending) {
+			buffer.featureFront = buffer.featureBack;
+			buffer.featurePending = false;
+			sendFeature = true;
+		}
+	}
+
+	// Keeps the handle from being closed or replaced halfway through
+	std::shared_lock guard(controller.handleLock);
+	if (!controller.valid || !controller.handle) return nextDue;
+
+	if (sendFeature) {
+		activeTransport().sendFeatureReport(controller.handle, buffer.featureFront.data, buffer.featureFront.size);
+		controller.writesIssued++;
+	}
+
+	if (sendReport) {
+		// Reports replaced while they waited for the rate cap never need one
+		if (buffer.front.needsCrc) {
+			uint32_t crc = compute(buffer.front.data, buffer.front.size - 4);
+			std::memcpy(buffer.front.data + buffer.front.size - 4, &crc, sizeof(crc));
+		}
+
+		int res = activeTransport().write(controller.handle, buffer.front.data, buffer.front.size);
+		controller.writesIssued++;
+
+		if (res > 0) {
+			controller.wasDisconnected = false;
+		}
+	}
+
+	return nextDue;
+}
+
+// Builds and sends the output reports the readers asked for, so neither a slow write nor a setter holding
+// the slot lock ever holds up input
+int writeFunc() {
+#if defined(_WIN32) || defined(_WIN64)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+	timeBeginPeriod(1);
+#endif
+
+	auto nextDue = std::chrono::steady_clock::time_point::max();
+
+	while (g_threadRunning) {
+		{
+			std::unique_lock lock(g_writerWakeLock);
+			auto ready = [] { return !g_threadRunning || g_outputPending; };
+
+			if (nextDue == std::chrono::steady_clock::time_point::max())
+				g_writerWake.wait(lock, ready);
+			else
+				g_writerWake.wait_until(lock, nextDue, ready);
+
+			g_outputPending = false;
+		}
+
+		for (auto& controller : activeControllers()) {
+			if (controller.outputDirty.exchange(false)) composeOutput(controller);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		nextDue = std::chrono::steady_clock::time_point::max();
+
+		// Rumble/trigger changes of every controller go out before any lightbar/volume change
+		for (auto& controller : activeControllers()) {
+			nextDue = std::min(nextDue, flushOutput(controller, now, true));
+		}
+
+		for (auto& controller : activeControllers()) {
+			nextDue = std::min(nextDue, flushOutput(controller, now, false));
+		}
+	}
+	return 0;
+}
+
+static bool isKnownPath(const char* path) {
+	for (auto& controller : activeControllers()) {
+		std::shared_lock guard(controller.lock);
+		if (controller.valid && controller.lastPath == path) return true;
+	}
+	return false;
+}
+
+// Everything enumerateControllers learns about a device before it gets a slot
+struct controllerProbe {
+	std::string path;
+	std::string serial;
+	uint16_t productID = 0;
+	uint8_t busType = 0;
+	uint8_t deviceType = UNKNOWN;
+	transportDevice* handle = nullptr;
+	deviceMetadata metadata = {};
+	duaLibUtils::motionCalibration calibration = {};
+	bool fromCache = false;
+	bool usable = false;
+};
+
+// Bluetooth controllers start out in a reduced report mode, this and reading the calibration
+// report afterwards gets them to send full reports
+static void startBluetoothReports(transportDevice* handle, uint8_t deviceType) {
+	if (deviceType != DUALSHOCK4) return;
+
+	dualshock4Data::ReportOut11 report = {};
+	report.Data.ReportID = 0x11;
+	report.Data.EnableHID = 1;
+	report.Data.AllowRed = 0;
+	report.Data.AllowGreen = 0;
+	report.Data.AllowBlue = 0;
+	report.Data.EnableAudio = 0;
+	report.Data.State.LedRed = 0;
+	report.Data.State.LedGreen = 0;
+	report.Data.State.LedBlue = 0;
+	report.Data.State.EnableLedUpdate = true;
+
+	uint32_t crc = compute(report.CRC.Buff, sizeof(report) - 4);
+	report.CRC.CRC = crc;
+
+	activeTransport().write(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report));
+}
+
+// speed2x deg/s over the raw distance between plus and minus, scaled to nominal counts
+static bool gyroCalibration(duaLibUtils::axisCalibration& axis, int bias, int plus, int minus, int speed2x) {
+	int64_t denom = std::abs(plus - bias) + std::abs(minus - bias);
+	if (denom == 0 || speed2x <= 0) return false;
+
+	axis.bias = bias;
+	axis.scale = ((static_cast<int64_t>(speed2x) * 32768 << CALIBRATION_SHIFT) + denom * GYRO_RANGE_DEG_S / 2) / (denom * GYRO_RANGE_DEG_S);
+	return true;
+}
+
+// plus and minus are the raw values at +1g and -1g
+static bool accelCalibration(duaLibUtils::axisCalibration& axis, int plus, int minus) {
+	int64_t range2g = plus - minus;
+	if (range2g <= 0) return false;
+
+	axis.bias = plus - static_cast<int32_t>(range2g / 2);
+	axis.scale = ((static_cast<int64_t>(2 * ACCEL_COUNTS_PER_G) << CALIBRATION_SHIFT) + range2g / 2) / range2g;
+	return true;
+}
+
+// Garbage in the report would do more harm than the uncalibrated values
+static bool plausibleCalibration(const duaLibUtils::axisCalibration& axis) {
+	return axis.scale >= (1 << CALIBRATION_SHIFT) / 2 && axis.scale <= (2 << CALIBRATION_SHIFT);
+}
+
+template <typename T>
+static bool parseCalibration(const T& report, const int16_t gyroPlus[3], const int16_t gyroMinus[3], duaLibUtils::motionCalibration& calibration) {
+	const int16_t gyroBias[3] = { report.GyroPitchBias, report.GyroYawBias, report.GyroRollBias };
+	const int16_t accelPlus[3] = { report.AccelXPlus, report.AccelYPlus, report.AccelZPlus };
+	const int16_t accelMinus[3] = { report.AccelXMinus, report.AccelYMinus, report.AccelZMinus };
+	int speed2x = report.GyroSpeedPlus + report.GyroSpeedMinus;
+
+	duaLibUtils::motionCalibration parsed = {};
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (!gyroCalibration(parsed.gyro[axis], gyroBias[axis], gyroPlus[axis], gyroMinus[axis], speed2x) || !plausibleCalibration(parsed.gyro[axis]))
+			return false;
+		if (!accelCalibration(parsed.accel[axis], accelPlus[axis], accelMinus[axis]) || !plausibleCalibration(parsed.accel[axis]))
+			return false;
+	}
+
+	parsed.valid = true;
+	calibration = parsed;
+	return true;
+}
+
+// Reads the factory calibration of the motion sensors, on failure the raw values are used as they are
+static bool readCalibration(transportDevice* handle, uint16_t productID, uint8_t deviceType, uint8_t busType, duaLibUtils::motionCalibration& calibration) {
+	if (deviceType == DUALSENSE) {
+		dualsenseData::ReportFeatureInCalibration report = {};
+		report.ReportID = 0x05;
+		if (activeTransport().getFeatureReport(handle, reinterpret_cast<unsigned char*>(&report), sizeof(report)) < (int)offsetof(dualsenseData::ReportFeatureInCalibration, Pad))
+			return false;
+
+		const int16_t gyroPlus[3] = { report.GyroPitchPlus, report.GyroYawPlus, report.GyroRollPlus };
+		const int16_t gyroMinus[3] = { report.GyroPitchMinus, report.GyroYawMinus, report.GyroRollMinus };
+		return parseCalibration(report, gyroPlus, gyroMinus, calibration);
+	}
+
+	if (deviceType != DUALSHOCK4) return false;
+
+	dualshock4Data::ReportFeatureInCalibrationBT buffer = {};
+	dualshock4Data::ReportFeatureInCalibration& report = buffer.Data;
+	bool bluetooth = busType == HID_API_BUS_BLUETOOTH;
+	report.ReportID = bluetooth ? 0x05 : 0x02;
+	if (activeTransport().getFeatureReport(handle, reinterpret_cast<unsigned char*>(&buffer), bluetooth ? sizeof(buffer) : sizeof(report)) < (int)offsetof(dualshock4Data::ReportFeatureInCalibration, Pad))
+		return false;
+
+	const int16_t* range = report.GyroRange;
+	if (bluetooth || productID == DUALSHOCK4_WIRELESS_ADAPTOR_ID) {
+		const int16_t gyroPlus[3] = { range[0], range[1], range[2] };
+		const int16_t gyroMinus[3] = { range[3], range[4], range[5] };
+		return parseCalibration(report, gyroPlus, gyroMinus, calibration);
+	}
+
+	const int16_t gyroPlus[3] = { range[0], range[2], range[4] };
+	const int16_t gyroMinus[3] = { range[1], range[3], range[5] };
+	return parseCalibration(report, gyroPlus, gyroMinus, calibration);
+}
+
+// Asks the device itself for what the metadata cache would have had, false if it doesn't tell its MAC address
+static bool askDeviceMetadata(controllerProbe& probe) {
+	probe.metadata = {};
+	if (!duaLibUtils::getMacAddress(probe.handle, probe.metadata.macAddress, probe.productID, probe.busType))
+		return false;
+
+	if (probe.deviceType == DUALSENSE)
+		probe.metadata.hasVersionReport = duaLibUtils::getHardwareVersion(probe.handle, probe.metadata.versionReport);
+
+	queryContainerId(probe.path.c_str(), probe.metadata);
+	probe.fromCache = false;
+	return true;
+}
+
+static bool isVirtualController(const std::string& macAddress) {
+	return macAddress.rfind("C0:13:37") != std::string::npos;
+}
+
+// Opens a device and asks it everything it needs before it can stream. Every probe runs on its own
+// thread so the feature report round trips of several controllers overlap.
+static void probeController(controllerProbe& probe) {
+	probe.handle = activeTransport().open(probe.path);
+	if (!probe.handle) return;
+
+	// A controller we've seen before starts streaming right away, the watcher checks the cached data later
+	probe.fromCache = loadDeviceMetadata(probe.path, probe.serial, probe.metadata);
+
+	if (!probe.fromCache && !askDeviceMetadata(probe))
+		return;
+
+	// Ignore ViGEm controllers
+	if (isVirtualController(probe.metadata.macAddress))
+		return;
+
+	if (probe.busType == HID_API_BUS_BLUETOOTH)
+		startBluetoothReports(probe.handle, probe.deviceType);
+
+	readCalibration(probe.handle, probe.productID, probe.deviceType, probe.busType, probe.calibration);
+
+	probe.usable = true;
+}
+
+static bool isConnectedMac(const std::string& macAddress) {
+	for (auto& controller : activeControllers()) {
+		std::shared_lock guard(controller.lock);
+		if (controller.macAddress == macAddress && controller.valid) return true;
+	}
+	return false;
+}
+
+static bool assignSlot(controllerProbe& probe) {
+	// A cached MAC address that's already connected is more likely a stale entry for a reused path
+	// than the same controller twice, only the device itself can tell
+	if (probe.fromCache && isConnectedMac(probe.metadata.macAddress)) {
+		if (!askDeviceMetadata(probe) || isVirtualController(probe.metadata.macAddress)) return false;
+	}
+
+	if (isConnectedMac(probe.metadata.macAddress)) return false;
+
+	for (auto& controller : activeControllers()) {
+		std::unique_lock guard(controller.lock);
+		if (controller.valid) continue;
+
+		// Slots closed by scePadClose still hold their old device
+		releaseHandle(controller);
+
+		controller.started = true;
+		{
+			std::unique_lock handleGuard(controller.handleLock);
+			controller.handle = probe.handle;
+		}
+		controller.connectionType = probe.busType;
+		controller.valid = true;
+		controller.linkState = duaLibUtils::LinkState::Connected;
+		controller.lastReportAt = std::chrono::steady_clock::now();
+		controller.retryDelayMs = 0;
+		controller.lastPath = probe.path;
+		controller.serialNumber = probe.serial;
+		controller.productID = probe.productID;
+		controller.deviceType = probe.deviceType;
+
+		applyMetadata(controller, probe.metadata);
+		controller.metadataPending = probe.fromCache;
+		controller.calibration = probe.calibration;
+		std::fill(std::begin(controller.gyroBias), std::end(controller.gyroBias), 0);
+		controller.biasEstimationState = SCE_PAD_BIAS_ESTIMATION_IDLE;
+		guard.unlock();
+		wakeReaders();
+
+		if (!probe.fromCache)
+			storeDeviceMetadata(probe.path, probe.serial, probe.metadata);
+		return true;
+	}
+
+	return false;
+}
+
+// Opens every supported controller that isn't in a slot yet, returns how many devices couldn't be opened
+static int enumerateControllers() {
+	std::vector<controllerProbe> probes;
+
+	for (int j = 0; j < DEVICE_COUNT; ++j) {
+		std::vector<transportDeviceInfo> devices = activeTransport().enumerate(
+			g_deviceList.devices[j].Vendor,
+			g_deviceList.devices[j].Device
+		);
+
+		for (const transportDeviceInfo& info : devices) {
+			// Already ours, don't open it again just to ask for the MAC address
+			if (isKnownPath(info.path.c_str())) continue;
+			if (info.busType == HID_API_BUS_BLUETOOTH && !g_allowBluetooth) continue;
+
+			controllerProbe probe = {};
+			probe.path = info.path;
+			probe.serial = info.serial;
+			probe.productID = g_deviceList.devices[j].Device;
+			probe.busType = info.busType;
+
+			uint16_t dev = probe.productID;
+			if (dev == DUALSENSE_DEVICE_ID || dev == DUALSENSE_EDGE_DEVICE_ID) { probe.deviceType = DUALSENSE; }
+			else if (dev == DUALSHOCK4_DEVICE_ID || dev == DUALSHOCK4V2_DEVICE_ID || dev == DUALSHOCK4_WIRELESS_ADAPTOR_ID) { probe.deviceType = DUALSHOCK4; }
+
+			probes.push_back(probe);
+		}
+	}
+
+	if (probes.size() == 1) {
+		probeController(probes[0]);
+	}
+	else if (probes.size() > 1) {
+		std::vector<std::thread> workers;
+		workers.reserve(probes.size());
+
+		for (auto& probe : probes)
+			workers.emplace_back(probeController, std::ref(probe));
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	// Slots are handed out in enumeration order no matter which probe finished first
+	int failedOpens = 0;
+
+	for (auto& probe : probes) {
+		if (!probe.handle) {
+			failedOpens++;
+			continue;
+		}
+
+		if (!probe.usable || !assignSlot(probe))
+			activeTransport().close(probe.handle);
+	}
+
+	return failedOpens;
+}
+
+#if defined(__linux__) && DUALIB_HAS_UDEV
+// Hotplug through a udev monitor, enumerates as soon as a hidraw node shows up instead of polling.
+// Returns false if udev isn't usable so the caller can fall back to polling.
+static bool watchUdev() {
+	udev* context = udev_new();
+	if (!context) return false;
+
+	udev_monitor* monitor = udev_monitor_new_from_netlink(context, "udev");
+
+	if (!monitor ||
+		udev_monitor_filter_add_match_subsystem_devtype(monitor, "hidraw", nullptr) < 0 ||
+		udev_monitor_enable_receiving(monitor) < 0) {
+		if (monitor) udev_monitor_unref(monitor);
+		udev_unref(context);
+		return false;
+	}
+
+	pollfd fd = { udev_monitor_get_fd(monitor), POLLIN, 0 };
+	int retries = 0;
+
+	enumerateControllers();
+	verifyPendingMetadata();
+
+	while (g_threadRunning) {
+		// A freshly added node can still be owned by root for a moment, retry quickly in that case
+		int res = poll(&fd, 1, retries > 0 ? UDEV_RETRY_INTERVAL_MS : UDEV_SWEEP_INTERVAL_MS);
+
+		bool added = false;
+		if (res > 0 && (fd.revents & POLLIN)) {
+			while (udev_device* device = udev_monitor_receive_device(monitor)) {
+				const char* action = udev_device_get_action(device);
+				if (action && std::strcmp(action, "add") == 0) added = true;
+				udev_device_unref(device);
+			}
+
+			// Removals are noticed by the readers
+			if (!added) continue;
+		}
+
+		int failedOpens = enumerateControllers();
+		verifyPendingMetadata();
+
+		if (added && failedOpens > 0) retries = UDEV_MAX_RETRIES;
+		else if (retries > 0) retries = failedOpens > 0 ? retries - 1 : 0;
+	}
+
+	udev_monitor_unref(monitor);
+	udev_unref(context);
+	return true;
+}
+#endif
+
+int watchFunc() {
+#if defined(_WIN32) || defined(_WIN64)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#endif
+
+#if defined(__linux__) && DUALIB_HAS_UDEV
+	if (watchUdev()) return 0;
+#endif
+
+	// Polling fallback, the first pass runs right away so controllers that are already plugged in show up at startup
+	while (g_threadRunning) {
+		enumerateControllers();
+		verifyPendingMetadata();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+	}
+
+	return 0;
+}
+
+int scePadInit() {
+	s_ScePadInitParam param = {};
+	param.allowBT = false;
+
+	return scePadInit3(&param);
+}
+
+int scePadInit3(s_ScePadInitParam* param) {
+	if (!param) return SCE_PAD_ERROR_INVALID_ARG;
+
+	if (!g_initialized) {
+		g_flightRecorder.reserve();
+		int res = activeTransport().init();
+
+		if (res)
+			return res;
+
+		for (auto& controller : activeControllers()) {
+			controller.dualsenseLastOutputState.OutputPathSelect = 10; // Set it to something bigger than 4 so the audio path can reset back to 0 on first write
+		}
+
+		g_allowBluetooth = param->allowBT;
+		g_threadRunning = true;
+
+		int shards = readerShardCount();
+
+		for (int shard = 0; shard < shards; shard++) {
+			int first = shardFirstSlot(shard, shards);
+			int last = shardFirstSlot(shard + 1, shards);
+
+			if (g_readerMode == SCE_PAD_READER_MODE_POLL) {
+				// A poll loop only ever waits on the devices of its own shard
+				g_readThreads[shard] = std::thread(readFunc, shard, first, last - first);
+				g_readThreads[shard].detach();
+				continue;
+			}
+
+			for (int i = first; i < last; i++) {
+				g_deviceReadThreads[i] = std::thread(deviceReadFunc, i, shard);
+				g_deviceReadThreads[i].detach();
+			}
+		}
+
+		g_writeThread = std::thread(writeFunc);
+		g_writeThread.detach();
+		g_watchThread = std::thread(watchFunc);
+		g_watchThread.detach();
+		g_initialized = true;
+	}
+
+	return SCE_OK;
+}
+
+int scePadTerminate(void) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	g_threadRunning = false;
+	g_initialized = false;
+
+	for (auto& controller : activeControllers()) {
+		// release controller here
+		controller.valid = false;
+		controller.sceHandle = 0;
+		controller.lastPath = "";
+		controller.productID = 0;
+		controller.wasDisconnected = true;
+		controller.macAddress = "";
+
+		std::shared_lock guard(controller.handleLock);
+		duaLibUtils::letGo(controller.handle, controller.deviceType, controller.connectionType);
+	}
+	g_particularMode = false;
+	wakeReaders();
+	wakeWriter();
+
+	//if (g_readThreads[0].joinable()) {
+	//	g_readThreads[0].join();
+	//}
+	//if (g_watchThread.joinable()) {
+	//	g_watchThread.join();
+	//}
+	return SCE_OK;
+}
+
+int scePadOpen(int userID, int unk1, int unk2) {
+	volatile int preventOptim1 = unk1;
+	volatile int preventOptim2 = unk2;
+	(void)preventOptim1;
+	(void)preventOptim2;
+
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (userID > g_controllerCount || userID < 1) return SCE_PAD_ERROR_INVALID_ARG;
+
+	int index = userID - 1;
+	bool wasAlreadyOpened = false;
+	int lastUnused = 0;
+	int firstUnused = -1;
+	int occupiedCount = 0;
+	int count = 0;
+
+	for (auto& controller : activeControllers()) {
+		std::shared_lock guard(controller.lock);
+
+		if (controller.sceHandle == 0 && controller.playerIndex != userID) {
+			if (firstUnused == -1)
+				firstUnused = count;
+
+			lastUnused++;
+		}
+		else if ((int)(controller.sceHandle & 0xFF) == occupiedCount + 1 || controller.playerIndex == userID) {
+			if (occupiedCount > g_controllerCount) {
+				wasAlreadyOpened = true;
+				return SCE_PAD_ERROR_ALREADY_OPENED;
+			}
+		}
+		else {
+			occupiedCount++;
+		}
+
+		count++;
+	}
+
+	if (!wasAlreadyOpened && firstUnused != -1) {
+		std::unique_lock guard(g_controllers[firstUnused].lock);
+		int handle = makeHandle(firstUnused, ++g_controllers[firstUnused].generation);
+		g_controllers[firstUnused].sceHandle = handle;
+		g_controllers[firstUnused].opened = true;
+		g_controllers[firstUnused].playerIndex = userID;
+
+		g_controllers[firstUnused].dualshock4CurOutputState.LedRed = g_playerColors[(userID - 1) % g_playerColors.size()].r;
+		g_controllers[firstUnused].dualshock4CurOutputState.LedGreen = g_playerColors[(userID - 1) % g_playerColors.size()].g;
+		g_controllers[firstUnused].dualshock4CurOutputState.LedBlue = g_playerColors[(userID - 1) % g_playerColors.size()].b;
+		guard.unlock();
+		wakeReaders();
+
+		return handle;
+	}
+
+	return SCE_PAD_ERROR_NO_HANDLE;
+}
+
+int scePadSetParticularMode(bool mode) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	g_particularMode = mode;
+	return SCE_OK;
 }
 
 int scePadGetParticularMode() {
@@ -1031,946 +2202,1032 @@ int scePadGetParticularMode() {
 	return g_particularMode;
 }
 
-static float Vec3Length(const s_SceFVector3& v) {
-	return std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+int scePadGetIoStatistics(int handle, s_ScePadIoStatistics* stats) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!stats) return SCE_PAD_ERROR_INVALID_ARG;
+
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	s_ScePadIoStatistics _stats = {};
+	_stats.reportsRead = controller.reportsRead;
+	_stats.staleReportsSkipped = controller.staleReportsSkipped;
+	_stats.writesIssued = controller.writesIssued;
+	_stats.writesSuppressed = controller.writesSuppressed;
+	_stats.readErrors = controller.readErrors;
+	_stats.foreignReads = controller.foreignReads;
+	_stats.lastReadError = controller.lastReadError;
+	_stats.linkState = (int)controller.linkState.load();
+	_stats.msSinceLastReport = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - controller.lastReportAt.load()).count();
+
+	*stats = _stats;
+	return SCE_OK;
 }
 
-static s_SceFVector3 Vec3Normalize(const s_SceFVector3& v) {
-	float len = Vec3Length(v);
-	if (len > 0.0f) {
-		return { v.x / len, v.y / len, v.z / len };
-	}
-	return v;
+int scePadSetOutputSchedulerParam(s_ScePadOutputSchedulerParam* param) {
+	if (!param) return SCE_PAD_ERROR_INVALID_ARG;
+
+	g_coalesceWindowUs = param->coalesceWindowUs;
+	g_usbWriteIntervalUs = param->usbMinWriteIntervalUs;
+	g_btWriteIntervalUs = param->btMinWriteIntervalUs;
+	wakeWriter();
+	return SCE_OK;
+}
+
+int scePadSetReaderThreadParam(s_ScePadReaderThreadParam* param) {
+	if (g_initialized) return SCE_PAD_ERROR_NOT_PERMITTED;
+	if (!param || param->threadCount > MAX_READER_THREADS) return SCE_PAD_ERROR_INVALID_ARG;
+
+	g_readerThreadCount = (int)param->threadCount;
+	std::copy(std::begin(param->cpuAffinityMask), std::end(param->cpuAffinityMask), g_readerAffinity);
+	return SCE_OK;
+}
+
+int scePadSetControllerCount(int count) {
+	if (g_initialized) return SCE_PAD_ERROR_NOT_PERMITTED;
+	if (count < 1 || count > MAX_CONTROLLER_COUNT) return SCE_PAD_ERROR_INVALID_ARG;
+	g_controllerCount = count;
+	return SCE_OK;
 }
 
-constexpr float angVelScale = 50.0f / 32767.0f;
-constexpr float angVelScaleDS4 = 40.0f / 32767.0f;
-// To m/s^2: 0.98 mg/LSB (BMI055 data sheet Chapter 5.2.1)
-static double to_mpss(int v) {
-	return static_cast<double>(v) / (pow(2, 13) - 1) * 9.80665 * 0.098;
+int scePadSetTransport(deviceTransport* transport) {
+	if (g_initialized) return SCE_PAD_ERROR_NOT_PERMITTED;
+	g_flightRecorder.setTransport(transport);
+	return SCE_OK;
+}
+
+int scePadSetFlightRecorderState(bool state) {
+	g_flightRecorder.setEnabled(state);
+	return SCE_OK;
 }
 
-// To rad/s: 32767: 2000 deg/s (BMI055 data sheet Chapter 7.2.1)
-static double to_radps(int v) {
-	return static_cast<double>(v) / (pow(2, 15) - 1) * M_PI / 180.0 * 2000;
+int scePadDumpFlightRecorder(const char* path, uint64_t* coveredUs) {
+	if (!path || !*path) return SCE_PAD_ERROR_INVALID_ARG;
+	return g_flightRecorder.dump(path, coveredUs) ? SCE_OK : SCE_PAD_ERROR_FATAL;
+}
+
+int scePadSetReaderMode(int mode) {
+	if (g_initialized) return SCE_PAD_ERROR_NOT_PERMITTED;
+	if (mode != SCE_PAD_READER_MODE_BLOCKING && mode != SCE_PAD_READER_MODE_POLL) return SCE_PAD_ERROR_INVALID_ARG;
+	g_readerMode = mode;
+	return SCE_OK;
 }
 
 int scePadReadState(int handle, s_ScePadData* data) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 	if (!data) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	if (controller.deviceType != DUALSENSE && controller.deviceType != DUALSHOCK4) return SCE_OK;
+
+	*data = controller.padData.load().data;
+	finishPadData(controller, *data);
+	return SCE_OK;
+}
+
+int scePadReadStateTimed(int handle, s_ScePadData* data, uint64_t* receivedAtUs) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!data || !receivedAtUs) return SCE_PAD_ERROR_INVALID_ARG;
+
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	*receivedAtUs = 0;
+	if (controller.deviceType != DUALSENSE && controller.deviceType != DUALSHOCK4) return SCE_OK;
+
+	duaLibUtils::publishedState published = controller.padData.load();
+	*data = published.data;
+	*receivedAtUs = published.receivedAtUs;
+	finishPadData(controller, *data);
+	return SCE_OK;
+}
+
+int scePadReadStateMulti(const int* handles, s_ScePadData* data, int count, uint32_t* validMask, uint64_t* receivedAtUs) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!handles || !data || !validMask || count < 1 || count > 32) return SCE_PAD_ERROR_INVALID_ARG;
+
+	uint32_t mask = 0;
+
+	for (int i = 0; i < count; i++) {
+		// Only cleared when there's nothing to copy, the copy overwrites all of it anyway
+		duaLibUtils::controller* slot = findController(handles[i]);
+		if (slot) {
+			duaLibUtils::controller& controller = *slot;
+			std::shared_lock guard(controller.lock);
+
+			if (controller.sceHandle == handles[i] && controller.valid && (controller.deviceType == DUALSENSE || controller.deviceType == DUALSHOCK4)) {
+				duaLibUtils::publishedState published = controller.padData.load();
+				data[i] = published.data;
+				if (receivedAtUs) receivedAtUs[i] = published.receivedAtUs;
+				finishPadData(controller, data[i]);
+				mask |= 1u << i;
+				continue;
+			}
+		}
+
+		data[i] = {};
+		if (receivedAtUs) receivedAtUs[i] = 0;
+	}
+
+	*validMask = mask;
+	return SCE_OK;
+}
+
+int scePadGetContainerIdInformation(int handle, s_ScePadContainerIdInfo* containerIdInfo) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!containerIdInfo) return SCE_PAD_ERROR_INVALID_ARG;
+
+#if defined(_WIN32) || defined(_WIN64) // Windows only for now
+	if (duaLibUtils::controller* slot = findController(handle)) {
+		duaLibUtils::controller& controller = *slot;
+		std::shared_lock guard(controller.lock);
+		if (controller.sceHandle == handle && controller.id != "" && controller.idSize != 0) {
+			if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+			s_ScePadContainerIdInfo info = {};
+			info.size = controller.idSize;
+			strncpy_s(info.id, controller.id.c_str(), sizeof(info.id) - 1);
+			info.id[sizeof(info.id) - 1] = '\0';
+			*containerIdInfo = info;
+			return SCE_OK;
+		}
+	}
+	containerIdInfo->size = 0;
+	containerIdInfo->id[0] = '\0';
+	return SCE_OK;
+#else
+	return SCE_PAD_ERROR_NOT_PERMITTED;
+#endif
+}
+
+int scePadSetLightBar(int handle, s_SceLightBar* lightbar) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	g_flightRecorder.apiCall(captureApiCall::SetLightBar, handle, lightbar, sizeof(s_SceLightBar));
+
+	if (controller.deviceType == DUALSENSE) {
+		controller.dualsenseCurOutputState.LedRed = lightbar->r;
+		controller.dualsenseCurOutputState.LedGreen = lightbar->g;
+		controller.dualsenseCurOutputState.LedBlue = lightbar->b;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		controller.dualshock4CurOutputState.LedRed = lightbar->r;
+		controller.dualshock4CurOutputState.LedGreen = lightbar->g;
+		controller.dualshock4CurOutputState.LedBlue = lightbar->b;
+	}
+
+	return SCE_OK;
+}
+
+int scePadGetHandle(int userID, int unk1, int unk2) {
+	volatile int preventOptim1 = unk1;
+	volatile int preventOptim2 = unk2;
+	(void)preventOptim1;
+	(void)preventOptim2;
+
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (userID > g_controllerCount || userID < 1) return SCE_PAD_ERROR_INVALID_PORT;
+
+	for (auto& controller : activeControllers()) {
 		std::shared_lock guard(controller.lock);
 
-		if (controller.sceHandle != handle) continue;
+		if (controller.playerIndex != userID) continue;
+		return controller.sceHandle;
+	}
+
+	return SCE_PAD_ERROR_NO_HANDLE;
+}
+
+int scePadResetLightBar(int handle) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-		#pragma region buttons
-			uint32_t bitmaskButtons = 0;
-			if (controller.dualsenseCurInputState.ButtonCross) bitmaskButtons |= SCE_BM_CROSS;
-			if (controller.dualsenseCurInputState.ButtonCircle) bitmaskButtons |= SCE_BM_CIRCLE;
-			if (controller.dualsenseCurInputState.ButtonTriangle) bitmaskButtons |= SCE_BM_TRIANGLE;
-			if (controller.dualsenseCurInputState.ButtonSquare) bitmaskButtons |= SCE_BM_SQUARE;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-			if (controller.dualsenseCurInputState.ButtonL1) bitmaskButtons |= SCE_BM_L1;
-			if (controller.dualsenseCurInputState.ButtonL2) bitmaskButtons |= SCE_BM_L2;
-			if (controller.dualsenseCurInputState.ButtonR1) bitmaskButtons |= SCE_BM_R1;
-			if (controller.dualsenseCurInputState.ButtonR2) bitmaskButtons |= SCE_BM_R2;
+	g_flightRecorder.apiCall(captureApiCall::ResetLightBar, handle, nullptr, 0);
 
-			if (controller.dualsenseCurInputState.ButtonL3) bitmaskButtons |= SCE_BM_L3;
-			if (controller.dualsenseCurInputState.ButtonR3) bitmaskButtons |= SCE_BM_R3;
+	if (controller.deviceType == DUALSENSE) {
+		controller.dualsenseCurOutputState.LedRed = 0;
+		controller.dualsenseCurOutputState.LedGreen = 0;
+		controller.dualsenseCurOutputState.LedBlue = 0;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		controller.dualshock4CurOutputState.LedRed = 0;
+		controller.dualshock4CurOutputState.LedGreen = 0;
+		controller.dualshock4CurOutputState.LedBlue = 0;
+	}
+	return SCE_OK;
+}
+
+static void generateTriggerForce(ScePadTriggerEffectCommand& command, uint8_t force[11]) {
+	uint8_t generated[11] = {};
+
+	if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_OFF) {
+		TriggerEffectGenerator::Off(generated, 0);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_FEEDBACK) {
+		TriggerEffectGenerator::Feedback(generated, 0, command.commandData.feedbackParam.position, command.commandData.feedbackParam.strength);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_WEAPON) {
+		TriggerEffectGenerator::Weapon(generated, 0, command.commandData.weaponParam.startPosition, command.commandData.weaponParam.endPosition, command.commandData.weaponParam.strength);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_VIBRATION) {
+		TriggerEffectGenerator::Vibration(generated, 0, command.commandData.vibrationParam.position, command.commandData.vibrationParam.amplitude, command.commandData.vibrationParam.frequency);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_SLOPE_FEEDBACK) {
+		TriggerEffectGenerator::SlopeFeedback(generated, 0, command.commandData.slopeFeedbackParam.startPosition, command.commandData.slopeFeedbackParam.endPosition, command.commandData.slopeFeedbackParam.startStrength, command.commandData.slopeFeedbackParam.endStrength);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_MULTIPLE_POSITION_FEEDBACK) {
+		TriggerEffectGenerator::MultiplePositionFeedback(generated, 0, command.commandData.multiplePositionFeedbackParam.strength);
+	}
+	else if (command.mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_MULTIPLE_POSITION_VIBRATION) {
+		TriggerEffectGenerator::MultiplePositionVibration(generated, 0, command.commandData.multiplePositionVibrationParam.frequency, command.commandData.multiplePositionVibrationParam.amplitude);
+	}
 
-			if (controller.dualsenseCurInputState.DPad == Direction::NorthEast) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_E_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::NorthWest) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_W_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::SouthEast) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_E_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::SouthWest) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_W_DPAD;
+	std::memcpy(force, generated, sizeof(generated));
+}
 
-			if (controller.dualsenseCurInputState.DPad == Direction::North) bitmaskButtons |= SCE_BM_N_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::South) bitmaskButtons |= SCE_BM_S_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::East) bitmaskButtons |= SCE_BM_E_DPAD;
-			if (controller.dualsenseCurInputState.DPad == Direction::West) bitmaskButtons |= SCE_BM_W_DPAD;
+int scePadSetTriggerEffect(int handle, ScePadTriggerEffectParam* triggerEffect) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-			if (controller.dualsenseCurInputState.ButtonOptions) bitmaskButtons |= SCE_BM_OPTIONS;
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-			if (controller.dualsenseCurInputState.ButtonPad) bitmaskButtons |= SCE_BM_TOUCH;
-			if (controller.dualsenseCurInputState.ButtonMute) bitmaskButtons |= SCE_BM_MICBUTTON;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-			if (g_particularMode) {
-				if (controller.dualsenseCurInputState.ButtonCreate) bitmaskButtons |= SCE_BM_SHARE;
-				if (controller.dualsenseCurInputState.ButtonHome) bitmaskButtons |= SCE_BM_PSBTN;
-			}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	if (controller.deviceType != DUALSENSE) return SCE_PAD_ERROR_NOT_PERMITTED;
 
-			data->bitmask_buttons = bitmaskButtons;
-		#pragma endregion
-
-		#pragma region sticks
-			data->LeftStick.X = controller.dualsenseCurInputState.LeftStickX;
-			data->LeftStick.Y = controller.dualsenseCurInputState.LeftStickY;
-			data->RightStick.X = controller.dualsenseCurInputState.RightStickX;
-			data->RightStick.Y = controller.dualsenseCurInputState.RightStickY;
-		#pragma endregion
-
-		#pragma region triggers
-			data->L2_Analog = controller.dualsenseCurInputState.TriggerLeft;
-			data->R2_Analog = controller.dualsenseCurInputState.TriggerRight;
-		#pragma endregion
-
-		#pragma region gyro		
-			if (controller.motionSensorState) {
-				auto now = std::chrono::steady_clock::now();
-				controller.deltaTime = std::chrono::duration_cast<std::chrono::microseconds>(now - controller.lastUpdate).count() / 1000000.0f;
-				controller.lastUpdate = now;
-
-				data->acceleration.x = (float)controller.dualsenseCurInputState.AccelerometerX;
-				data->acceleration.y = (float)controller.dualsenseCurInputState.AccelerometerY;
-				data->acceleration.z = (float)controller.dualsenseCurInputState.AccelerometerZ;
-
-				data->angularVelocity.x = (float)controller.dualsenseCurInputState.AngularVelocityX;
-				data->angularVelocity.y = (float)controller.dualsenseCurInputState.AngularVelocityY;
-				data->angularVelocity.z = (float)controller.dualsenseCurInputState.AngularVelocityZ;
-
-				data->angularVelocity.x = controller.velocityDeadband == true && (data->angularVelocity.x < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.x > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.x;
-				data->angularVelocity.y = controller.velocityDeadband == true && (data->angularVelocity.y < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.y > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.y;
-				data->angularVelocity.z = controller.velocityDeadband == true && (data->angularVelocity.z < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.z > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.z;
-
-				auto& q = controller.orientation;
-				s_SceFQuaternion w = {
-					data->angularVelocity.x,
-					data->angularVelocity.y,
-					data->angularVelocity.z,
-					0.0f
-				};
-
-				s_SceFQuaternion qw = {
-				  q.w * w.x + q.x * w.w + q.y * w.z - q.z * w.y,
-				  q.w * w.y + q.y * w.w + q.z * w.x - q.x * w.z,
-				  q.w * w.z + q.z * w.w + q.x * w.y - q.y * w.x,
-				  q.w * w.w - q.x * w.x - q.y * w.y - q.z * w.z
-				};
-
-				s_SceFQuaternion qDot = { 0.5f * qw.x, 0.5f * qw.y, 0.5f * qw.z, 0.5f * qw.w };
-
-				q.x += qDot.x * controller.deltaTime;
-				q.y += qDot.y * controller.deltaTime;
-				q.z += qDot.z * controller.deltaTime;
-				q.w += qDot.w * controller.deltaTime;
-
-				float norm = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
-				q.x /= norm; q.y /= norm; q.z /= norm; q.w /= norm;
-
-				data->orientation.x = q.x;
-				data->orientation.y = q.z;
-				data->orientation.z = q.y; // yes this is swapped on purpose don't touch it
-				data->orientation.w = q.w;
-			}
-		#pragma endregion
-
-		#pragma region touchpad
-			data->touchData.touchNum = (controller.dualsenseCurInputState.touchData.Finger[0].NotTouching > 0 ? 0 : 1) + (controller.dualsenseCurInputState.touchData.Finger[1].NotTouching > 0 ? 0 : 1);
-
-			data->touchData.touch[0].id = controller.dualsenseCurInputState.touchData.Finger[0].Index;
-			data->touchData.touch[0].x = controller.dualsenseCurInputState.touchData.Finger[0].FingerX;
-			data->touchData.touch[0].y = controller.dualsenseCurInputState.touchData.Finger[0].FingerY;
-			data->touchData.touch[0].reserve[0] = controller.dualsenseCurInputState.touchData.Finger[0].NotTouching;
-
-			data->touchData.touch[1].id = controller.dualsenseCurInputState.touchData.Finger[1].Index;
-			data->touchData.touch[1].x = controller.dualsenseCurInputState.touchData.Finger[1].FingerX;
-			data->touchData.touch[1].y = controller.dualsenseCurInputState.touchData.Finger[1].FingerY;
-			data->touchData.touch[1].reserve[0] = controller.dualsenseCurInputState.touchData.Finger[1].NotTouching;
-		#pragma endregion
-
-		#pragma region misc
-			data->connected = controller.valid;
-			data->timestamp = controller.dualsenseCurInputState.DeviceTimeStamp;
-			data->extUnitData = {};
-			data->connectionCount = 0;
-			for (int j = 0; j < 12; j++)
-				data->deviceUniqueData[j] = {};
-			data->deviceUniqueDataLen = sizeof(data->deviceUniqueData);
-		#pragma endregion
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-		#pragma region buttons
-			uint32_t bitmaskButtons = 0;
-			if (controller.dualshock4CurInputState.ButtonCross) bitmaskButtons |= SCE_BM_CROSS;
-			if (controller.dualshock4CurInputState.ButtonCircle) bitmaskButtons |= SCE_BM_CIRCLE;
-			if (controller.dualshock4CurInputState.ButtonTriangle) bitmaskButtons |= SCE_BM_TRIANGLE;
-			if (controller.dualshock4CurInputState.ButtonSquare) bitmaskButtons |= SCE_BM_SQUARE;
-
-			if (controller.dualshock4CurInputState.ButtonL1) bitmaskButtons |= SCE_BM_L1;
-			if (controller.dualshock4CurInputState.ButtonL2) bitmaskButtons |= SCE_BM_L2;
-			if (controller.dualshock4CurInputState.ButtonR1) bitmaskButtons |= SCE_BM_R1;
-			if (controller.dualshock4CurInputState.ButtonR2) bitmaskButtons |= SCE_BM_R2;
-
-			if (controller.dualshock4CurInputState.ButtonL3) bitmaskButtons |= SCE_BM_L3;
-			if (controller.dualshock4CurInputState.ButtonR3) bitmaskButtons |= SCE_BM_R3;
-
-			if (controller.dualshock4CurInputState.DPad == Direction::NorthEast) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_E_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::NorthWest) bitmaskButtons |= SCE_BM_N_DPAD + SCE_BM_W_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::SouthEast) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_E_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::SouthWest) bitmaskButtons |= SCE_BM_S_DPAD + SCE_BM_W_DPAD;
-
-			if (controller.dualshock4CurInputState.DPad == Direction::North) bitmaskButtons |= SCE_BM_N_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::South) bitmaskButtons |= SCE_BM_S_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::East) bitmaskButtons |= SCE_BM_E_DPAD;
-			if (controller.dualshock4CurInputState.DPad == Direction::West) bitmaskButtons |= SCE_BM_W_DPAD;
-
-			if (controller.dualshock4CurInputState.ButtonOptions) bitmaskButtons |= SCE_BM_OPTIONS;
-
-			if (controller.dualshock4CurInputState.ButtonPad) bitmaskButtons |= SCE_BM_TOUCH;
-
-			if (g_particularMode) {
-				if (controller.dualshock4CurInputState.ButtonShare) bitmaskButtons |= SCE_BM_SHARE;
-				if (controller.dualshock4CurInputState.ButtonHome) bitmaskButtons |= SCE_BM_PSBTN;
-			}
+	g_flightRecorder.apiCall(captureApiCall::SetTriggerEffect, handle, triggerEffect, sizeof(ScePadTriggerEffectParam));
 
-			data->bitmask_buttons = bitmaskButtons;
-		#pragma endregion
-
-		#pragma region sticks
-			data->LeftStick.X = controller.dualshock4CurInputState.LeftStickX;
-			data->LeftStick.Y = controller.dualshock4CurInputState.LeftStickY;
-			data->RightStick.X = controller.dualshock4CurInputState.RightStickX;
-			data->RightStick.Y = controller.dualshock4CurInputState.RightStickY;
-		#pragma endregion
-
-		#pragma region triggers
-			data->L2_Analog = controller.dualshock4CurInputState.TriggerLeft;
-			data->R2_Analog = controller.dualshock4CurInputState.TriggerRight;
-		#pragma endregion
-
-		#pragma region gyro		
-			if (controller.motionSensorState) {
-				auto now = std::chrono::steady_clock::now();
-				controller.deltaTime = std::chrono::duration_cast<std::chrono::microseconds>(now - controller.lastUpdate).count() / 1000000.0f;
-				controller.lastUpdate = now;
-
-				data->acceleration.x = (float)controller.dualshock4CurInputState.AccelerometerX;
-				data->acceleration.y = (float)controller.dualshock4CurInputState.AccelerometerY;
-				data->acceleration.z = (float)controller.dualshock4CurInputState.AccelerometerZ;
-
-				data->angularVelocity.x = (float)controller.dualshock4CurInputState.AngularVelocityX;
-				data->angularVelocity.y = (float)controller.dualshock4CurInputState.AngularVelocityY;
-				data->angularVelocity.z = (float)controller.dualshock4CurInputState.AngularVelocityZ;
-
-				data->angularVelocity.x = controller.velocityDeadband == true && (data->angularVelocity.x < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.x > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.x;
-				data->angularVelocity.y = controller.velocityDeadband == true && (data->angularVelocity.y < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.y > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.y;
-				data->angularVelocity.z = controller.velocityDeadband == true && (data->angularVelocity.z < ANGULAR_VELOCITY_DEADBAND_MIN && data->angularVelocity.z > -ANGULAR_VELOCITY_DEADBAND_MIN) ? 0 : data->angularVelocity.z;
-
-				auto& q = controller.orientation;
-				s_SceFQuaternion w = { data->angularVelocity.x,
-						   data->angularVelocity.y,
-						   data->angularVelocity.z,
-						   0.0f };
-
-				s_SceFQuaternion qw = {
-				  q.w * w.x + q.x * w.w + q.y * w.z - q.z * w.y,
-				  q.w * w.y + q.y * w.w + q.z * w.x - q.x * w.z,
-				  q.w * w.z + q.z * w.w + q.x * w.y - q.y * w.x,
-				  q.w * w.w - q.x * w.x - q.y * w.y - q.z * w.z
-				};
-
-				s_SceFQuaternion qDot = { 0.5f * qw.x, 0.5f * qw.y, 0.5f * qw.z, 0.5f * qw.w };
-
-				q.x += qDot.x * controller.deltaTime;
-				q.y += qDot.y * controller.deltaTime;
-				q.z += qDot.z * controller.deltaTime;
-				q.w += qDot.w * controller.deltaTime;
-
-				float norm = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
-				q.x /= norm; q.y /= norm; q.z /= norm; q.w /= norm;
-
-				data->orientation.x = q.x;
-				data->orientation.y = q.z;
-				data->orientation.z = q.y;  // yes this is swapped on purpose don't touch it
-				data->orientation.w = q.w;
-			}
-		#pragma endregion
-
-		#pragma region touchpad
-			data->touchData.touchNum = (controller.dualshock4CurInputState.Finger1Active > 0 ? 0 : 1) + (controller.dualshock4CurInputState.Finger2Active > 0 ? 0 : 1);
-
-			data->touchData.touch[0].id = controller.dualshock4CurInputState.Finger1ID;
-			data->touchData.touch[0].x = controller.dualshock4CurInputState.Finger1X;
-			data->touchData.touch[0].y = controller.dualshock4CurInputState.Finger1Y;
-			data->touchData.touch[0].reserve[0] = controller.dualshock4CurInputState.Finger1Active;
-
-			data->touchData.touch[1].id = controller.dualshock4CurInputState.Finger2ID;
-			data->touchData.touch[1].x = controller.dualshock4CurInputState.Finger2X;
-			data->touchData.touch[1].y = controller.dualshock4CurInputState.Finger2Y;
-			data->touchData.touch[1].reserve[0] = controller.dualshock4CurInputState.Finger2Active;
-		#pragma endregion
-
-		#pragma region misc
-			data->connected = controller.valid;
-			data->timestamp = controller.dualshock4CurInputState.Timestamp;
-			data->extUnitData = {};
-			data->connectionCount = 0;
-			for (int j = 0; j < 12; j++)
-				data->deviceUniqueData[j] = {};
-			data->deviceUniqueDataLen = sizeof(data->deviceUniqueData);
-		#pragma endregion
+	// The app sends the same effect every frame, only regenerate the forces when it actually changed
+	if (controller.triggerEffectCached && std::memcmp(&controller.lastTriggerEffect, triggerEffect, sizeof(ScePadTriggerEffectParam)) == 0)
+		return SCE_OK;
 
-		}
+	controller.lastTriggerEffect = *triggerEffect;
+	controller.triggerEffectCached = true;
+	controller.triggerMask = triggerEffect->triggerMask;
 
-		return SCE_OK;
+	if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2) {
+		generateTriggerForce(triggerEffect->command[SCE_PAD_TRIGGER_EFFECT_PARAM_INDEX_FOR_L2], controller.L2.force);
+	}
+	if (controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2) {
+		generateTriggerForce(triggerEffect->command[SCE_PAD_TRIGGER_EFFECT_PARAM_INDEX_FOR_R2], controller.R2.force);
 	}
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
-int scePadGetContainerIdInformation(int handle, s_ScePadContainerIdInfo* containerIdInfo) {
+int scePadGetControllerBusType(int handle, int* busType) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	if (!containerIdInfo) return SCE_PAD_ERROR_INVALID_ARG;
 
-#if defined(_WIN32) || defined(_WIN64) // Windows only for now
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
-		if (controller.sceHandle == handle && controller.id != "" && controller.idSize != 0) {
-			if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	*busType = controller.connectionType;
 
-			s_ScePadContainerIdInfo info = {};
-			info.size = controller.idSize;
-			strncpy_s(info.id, controller.id.c_str(), sizeof(info.id) - 1);
-			info.id[sizeof(info.id) - 1] = '\0';
-			*containerIdInfo = info;
-			return SCE_OK;
-		}
-	}
-	containerIdInfo->size = 0;
-	containerIdInfo->id[0] = '\0';
 	return SCE_OK;
-#else
-	return SCE_PAD_ERROR_NOT_PERMITTED;
-#endif
 }
 
-int scePadSetLightBar(int handle, s_SceLightBar* lightbar) {
+int scePadGetControllerInformation(int handle, s_ScePadInfo* info) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			controller.dualsenseCurOutputState.LedRed = lightbar->r;
-			controller.dualsenseCurOutputState.LedGreen = lightbar->g;
-			controller.dualsenseCurOutputState.LedBlue = lightbar->b;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			controller.dualshock4CurOutputState.LedRed = lightbar->r;
-			controller.dualshock4CurOutputState.LedGreen = lightbar->g;
-			controller.dualshock4CurOutputState.LedBlue = lightbar->b;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
+	s_ScePadInfo _info = {};
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
-}
+	_info.touchPadInfo.resolution.x = controller.deviceType == DUALSENSE ? 1920 : 1920;
+	_info.touchPadInfo.resolution.y = controller.deviceType == DUALSENSE ? 1080 : 943;
+	_info.touchPadInfo.pixelDensity = controller.deviceType == DUALSENSE ? 44.86 : 44;
+	_info.stickInfo.deadZoneLeft = controller.deviceType == DUALSENSE ? 13 : 13;
+	_info.stickInfo.deadZoneRight = controller.deviceType == DUALSENSE ? 13 : 13;
+	_info.connectionType = SCE_PAD_CONNECTION_TYPE_LOCAL;
+	_info.connectedCount = 1;
+	_info.connected = controller.valid;
+	_info.deviceClass = SCE_PAD_DEVICE_CLASS_STANDARD;
 
-int scePadGetHandle(int userID, int unk1, int unk2) {
-	volatile int preventOptim1 = unk1;
-	volatile int preventOptim2 = unk2;
-	(void)preventOptim1;
-	(void)preventOptim2;
+	*info = _info;
+	return SCE_OK;
+}
 
+int scePadGetControllerType(int handle, s_SceControllerType* controllerType) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	if (userID > MAX_CONTROLLER_COUNT || userID < 1) return SCE_PAD_ERROR_INVALID_PORT;
 
-	for (int i = 0; i < MAX_CONTROLLER_COUNT - 1; i++) {
-		std::shared_lock guard(g_controllers[i].lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (g_controllers[i].playerIndex != userID) continue;
-		return g_controllers[i].sceHandle;
-	}
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-	return SCE_PAD_ERROR_NO_HANDLE;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	*controllerType = (s_SceControllerType)controller.deviceType;
+
+	return SCE_OK;
 }
 
-int scePadResetLightBar(int handle) {
+int scePadGetJackState(int handle, int* state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			controller.dualsenseCurOutputState.LedRed = 0;
-			controller.dualsenseCurOutputState.LedGreen = 0;
-			controller.dualsenseCurOutputState.LedBlue = 0;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			controller.dualshock4CurOutputState.LedRed = 0;
-			controller.dualshock4CurOutputState.LedGreen = 0;
-			controller.dualshock4CurOutputState.LedBlue = 0;
-		}
-		return SCE_OK;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	if (controller.deviceType == DUALSENSE) {
+		dualsenseData::USBGetStateData input = controller.dualsenseInput.load();
+		*state = input.PluggedHeadphones + input.PluggedMic;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		dualshock4Data::USBGetStateData input = controller.dualshock4Input.load();
+		*state = input.PluggedHeadphones + input.PluggedMic;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_OK;
 }
 
-int scePadSetTriggerEffect(int handle, ScePadTriggerEffectParam* triggerEffect) {
+int scePadGetTriggerEffectState(int handle, int state[2]) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
-		if (controller.deviceType != DUALSENSE) return SCE_PAD_ERROR_NOT_PERMITTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		controller.triggerMask = triggerEffect->triggerMask;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	if (controller.deviceType != DUALSENSE) return SCE_PAD_ERROR_NOT_PERMITTED;
 
-		for (int i = 0; i <= 1; i++) {
-			duaLibUtils::trigger _trigger = {};
+	dualsenseData::USBGetStateData input = controller.dualsenseInput.load();
 
-			if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_OFF) {
-				TriggerEffectGenerator::Off(_trigger.force, 0);
-			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_FEEDBACK) {
-				TriggerEffectGenerator::Feedback(_trigger.force, 0, triggerEffect->command[i].commandData.feedbackParam.position, triggerEffect->command[i].commandData.feedbackParam.strength);
+	switch (input.TriggerLeftEffect) {
+		case 1:
+			switch (input.TriggerLeftStatus) {
+				case 0:
+					state[0] = SCE_PAD_TRIGGER_STATE_FEEDBACK_NO_FORCE;
+					break;
+				case 1:
+					state[0] = SCE_PAD_TRIGGER_STATE_FEEDBACK_IS_PUSHING;
+					break;
 			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_WEAPON) {
-				TriggerEffectGenerator::Weapon(_trigger.force, 0, triggerEffect->command[i].commandData.weaponParam.startPosition, triggerEffect->command[i].commandData.weaponParam.endPosition, triggerEffect->command[i].commandData.weaponParam.strength);
+			break;
+		case 2:
+			switch (input.TriggerLeftStatus) {
+				case 0:
+					state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_NOT_PRESSED;
+					break;
+				case 1:
+					state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_ALMOST_PRESSED;
+					break;
+				case 2:
+					state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_FULLY_PRESSED;
+					break;
 			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_VIBRATION) {
-				TriggerEffectGenerator::Vibration(_trigger.force, 0, triggerEffect->command[i].commandData.vibrationParam.position, triggerEffect->command[i].commandData.vibrationParam.amplitude, triggerEffect->command[i].commandData.vibrationParam.frequency);
+			break;
+		case 3:
+			switch (input.TriggerLeftStatus) {
+				case 0:
+					state[0] = SCE_PAD_TRIGGER_STATE_VIBRATION_NOT_FIRING;
+					break;
+				case 1:
+					state[0] = SCE_PAD_TRIGGER_STATE_VIBRATION_IS_FIRING;
+					break;
 			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_SLOPE_FEEDBACK) {
-				TriggerEffectGenerator::SlopeFeedback(_trigger.force, 0, triggerEffect->command[i].commandData.slopeFeedbackParam.startPosition, triggerEffect->command[i].commandData.slopeFeedbackParam.endPosition, triggerEffect->command[i].commandData.slopeFeedbackParam.startStrength, triggerEffect->command[i].commandData.slopeFeedbackParam.endStrength);
+			break;
+	}
+
+	switch (input.TriggerRightEffect) {
+		case 1:
+			switch (input.TriggerRightStatus) {
+				case 0:
+					state[1] = SCE_PAD_TRIGGER_STATE_FEEDBACK_NO_FORCE;
+					break;
+				case 1:
+					state[1] = SCE_PAD_TRIGGER_STATE_FEEDBACK_IS_PUSHING;
+					break;
 			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_MULTIPLE_POSITION_FEEDBACK) {
-				TriggerEffectGenerator::MultiplePositionFeedback(_trigger.force, 0, triggerEffect->command[i].commandData.multiplePositionFeedbackParam.strength);
+			break;
+		case 2:
+			switch (input.TriggerRightStatus) {
+				case 0:
+					state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_NOT_PRESSED;
+					break;
+				case 1:
+					state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_ALMOST_PRESSED;
+					break;
+				case 2:
+					state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_FULLY_PRESSED;
+					break;
 			}
-			else if (triggerEffect->command[i].mode == ScePadTriggerEffectMode::SCE_PAD_TRIGGER_EFFECT_MODE_MULTIPLE_POSITION_VIBRATION) {
-				TriggerEffectGenerator::MultiplePositionVibration(_trigger.force, 0, triggerEffect->command[i].commandData.multiplePositionVibrationParam.frequency, triggerEffect->command[i].commandData.multiplePositionVibrationParam.amplitude);
+			break;
+		case 3:
+			switch (input.TriggerRightStatus) {
+				case 0:
+					state[1] = SCE_PAD_TRIGGER_STATE_VIBRATION_NOT_FIRING;
+					break;
+				case 1:
+					state[1] = SCE_PAD_TRIGGER_STATE_VIBRATION_IS_FIRING;
+					break;
 			}
+			break;
+	}
 
-			if (i == SCE_PAD_TRIGGER_EFFECT_PARAM_INDEX_FOR_L2 && controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2) {
-				for (int i = 0; i < 11; i++) {
-					controller.L2.force[i] = _trigger.force[i];
-				}
-			}
-			else if (i == SCE_PAD_TRIGGER_EFFECT_PARAM_INDEX_FOR_R2 && controller.triggerMask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2) {
-				for (int i = 0; i < 11; i++) {
-					controller.R2.force[i] = _trigger.force[i];
-				}
-			}
-		}
 
-		return SCE_OK;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
-int scePadGetControllerBusType(int handle, int* busType) {
+int scePadIsControllerUpdateRequired(int handle) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		*busType = controller.connectionType;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	if (controller.productID != DUALSENSE_DEVICE_ID && controller.productID != DUALSENSE_EDGE_DEVICE_ID) return -2137915385LL; // undocumented error
 
-		return SCE_OK;
+	if (controller.productID == DUALSENSE_DEVICE_ID && controller.versionReport.UpdateVersion < 0x390u) {
+		return SCE_PAD_UPDATE_REQUIRED;
+	}
+
+	if (controller.productID == DUALSENSE_EDGE_DEVICE_ID && controller.versionReport.UpdateVersion < 0x150u) {
+		return SCE_PAD_UPDATE_REQUIRED;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_PAD_UPDATE_NOT_REQUIRED;
 }
 
-int scePadGetControllerInformation(int handle, s_ScePadInfo* info) {
-	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+// Copies up to count samples starting at cursor from the controller's history and moves the cursor
+// past them. Samples that already got overwritten are skipped.
+static int readHistory(duaLibUtils::controller& controller, uint64_t& cursor, s_ScePadSample* samples, int count) {
+	uint64_t head = controller.history.head.load(std::memory_order_acquire);
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	if (cursor > head || head - cursor > INPUT_HISTORY_SIZE) {
+		cursor = head > INPUT_HISTORY_SIZE ? head - INPUT_HISTORY_SIZE : 0;
+	}
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	int read = 0;
+	while (read < count && cursor < head) {
+		duaLibUtils::inputSample sample = {};
 
-		s_ScePadInfo _info = {};
+		if (!controller.history.get(cursor, sample)) {
+			// The reader lapped us while copying, jump to the oldest sample that is still there
+			head = controller.history.head.load(std::memory_order_acquire);
+			cursor = head - INPUT_HISTORY_SIZE;
+			continue;
+		}
 
-		_info.touchPadInfo.resolution.x = controller.deviceType == DUALSENSE ? 1920 : 1920;
-		_info.touchPadInfo.resolution.y = controller.deviceType == DUALSENSE ? 1080 : 943;
-		_info.touchPadInfo.pixelDensity = controller.deviceType == DUALSENSE ? 44.86 : 44;
-		_info.stickInfo.deadZoneLeft = controller.deviceType == DUALSENSE ? 13 : 13;
-		_info.stickInfo.deadZoneRight = controller.deviceType == DUALSENSE ? 13 : 13;
-		_info.connectionType = SCE_PAD_CONNECTION_TYPE_LOCAL;
-		_info.connectedCount = 1;
-		_info.connected = controller.valid;
-		_info.deviceClass = SCE_PAD_DEVICE_CLASS_STANDARD;
+		s_ScePadSample& out = samples[read];
+		out = {};
+		out.data = sample.data;
+		finishPadData(controller, out.data);
+		out.sensorTimestamp = sample.sensorTimestamp;
+		out.receivedAtUs = sample.receivedAtUs;
+		out.sequence = sample.sequence;
 
-		*info = _info;
-		return SCE_OK;
+		cursor++;
+		read++;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return read;
 }
 
-int scePadGetControllerType(int handle, s_SceControllerType* controllerType) {
+int scePadGetRawState(int handle, s_ScePadRawState* state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!state) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		*controllerType = (s_SceControllerType)controller.deviceType;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	*state = {};
+	duaLibUtils::inputSample sample = {};
+
+	// The newest sample only gets overwritten once the history wrapped around, in that case just take the new newest one
+	for (;;) {
+		uint64_t head = controller.history.head.load(std::memory_order_acquire);
+		if (head == 0) return SCE_OK;
+		if (controller.history.get(head - 1, sample)) break;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	state->sequence = sample.sequence;
+	state->receivedAtUs = sample.receivedAtUs;
+	state->sensorTimestamp = sample.sensorTimestamp;
+	state->controllerType = static_cast<s_SceControllerType>(sample.deviceType);
+	state->size = sample.deviceType == DUALSENSE ? sizeof(dualsenseData::USBGetStateData) : sizeof(dualshock4Data::USBGetStateData);
+	std::memcpy(state->state, sample.state, state->size);
+
+	return SCE_OK;
 }
 
-int scePadGetJackState(int handle, int* state) {
+int scePadRead(int handle, s_ScePadData* data, int count) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!data || count < 1 || count > INPUT_HISTORY_SIZE) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			*state = controller.dualsenseCurInputState.PluggedHeadphones + controller.dualsenseCurInputState.PluggedMic;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			*state = controller.dualshock4CurInputState.PluggedHeadphones + controller.dualshock4CurInputState.PluggedMic;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	// Callers share the cursor, so only the one that moves it from where it started gets to keep what it read
+	s_ScePadSample samples[INPUT_HISTORY_SIZE];
+	uint64_t start = controller.history.readCursor.load();
+	int read = 0;
+	for (;;) {
+		uint64_t cursor = start;
+		read = readHistory(controller, cursor, samples, count);
+		if (controller.history.readCursor.compare_exchange_weak(start, cursor)) break;
+	}
+
+	for (int i = 0; i < read; i++) {
+		data[i] = samples[i].data;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return read;
 }
 
-int scePadGetTriggerEffectState(int handle, int state[2]) {
+int scePadReadSamples(int handle, s_ScePadSample* samples, int count, uint64_t* cursor) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!samples || !cursor || count < 1) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
-		if (controller.deviceType != DUALSENSE) return SCE_PAD_ERROR_NOT_PERMITTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		switch (controller.dualsenseCurInputState.TriggerLeftEffect) {
-			case 1:
-				switch (controller.dualsenseCurInputState.TriggerLeftStatus) {
-					case 0:
-						state[0] = SCE_PAD_TRIGGER_STATE_FEEDBACK_NO_FORCE;
-						break;
-					case 1:
-						state[0] = SCE_PAD_TRIGGER_STATE_FEEDBACK_IS_PUSHING;
-						break;
-				}
-				break;
-			case 2:
-				switch (controller.dualsenseCurInputState.TriggerLeftStatus) {
-					case 0:
-						state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_NOT_PRESSED;
-						break;
-					case 1:
-						state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_ALMOST_PRESSED;
-						break;
-					case 2:
-						state[0] = SCE_PAD_TRIGGER_STATE_WEAPON_FULLY_PRESSED;
-						break;
-				}
-				break;
-			case 3:
-				switch (controller.dualsenseCurInputState.TriggerLeftStatus) {
-					case 0:
-						state[0] = SCE_PAD_TRIGGER_STATE_VIBRATION_NOT_FIRING;
-						break;
-					case 1:
-						state[0] = SCE_PAD_TRIGGER_STATE_VIBRATION_IS_FIRING;
-						break;
-				}
-				break;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		switch (controller.dualsenseCurInputState.TriggerRightEffect) {
-			case 1:
-				switch (controller.dualsenseCurInputState.TriggerRightStatus) {
-					case 0:
-						state[1] = SCE_PAD_TRIGGER_STATE_FEEDBACK_NO_FORCE;
-						break;
-					case 1:
-						state[1] = SCE_PAD_TRIGGER_STATE_FEEDBACK_IS_PUSHING;
-						break;
-				}
-				break;
-			case 2:
-				switch (controller.dualsenseCurInputState.TriggerRightStatus) {
-					case 0:
-						state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_NOT_PRESSED;
-						break;
-					case 1:
-						state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_ALMOST_PRESSED;
-						break;
-					case 2:
-						state[1] = SCE_PAD_TRIGGER_STATE_WEAPON_FULLY_PRESSED;
-						break;
-				}
-				break;
-			case 3:
-				switch (controller.dualsenseCurInputState.TriggerRightStatus) {
-					case 0:
-						state[1] = SCE_PAD_TRIGGER_STATE_VIBRATION_NOT_FIRING;
-						break;
-					case 1:
-						state[1] = SCE_PAD_TRIGGER_STATE_VIBRATION_IS_FIRING;
-						break;
-				}
-				break;
-		}
+	return readHistory(controller, *cursor, samples, count);
+}
 
+int scePadGetMotionSample(int handle, s_ScePadMotionSample* sample) {
+	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+	if (!sample) return SCE_PAD_ERROR_INVALID_ARG;
 
-		return SCE_OK;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+
+	*sample = controller.motionSample.load();
+
+	return SCE_OK;
 }
 
-int scePadIsControllerUpdateRequired(int handle) {
+int scePadStartGyroBiasEstimation(int handle) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
-		if (controller.productID != DUALSENSE_DEVICE_ID && controller.productID != DUALSENSE_EDGE_DEVICE_ID) return -2137915385LL; // undocumented error
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.productID == DUALSENSE_DEVICE_ID && controller.versionReport.UpdateVersion < 0x390u) {
-			return SCE_PAD_UPDATE_REQUIRED;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		if (controller.productID == DUALSENSE_EDGE_DEVICE_ID && controller.versionReport.UpdateVersion < 0x150u) {
-			return SCE_PAD_UPDATE_REQUIRED;
-		}
+	g_flightRecorder.apiCall(captureApiCall::StartGyroBiasEstimation, handle, nullptr, 0);
 
-		return SCE_PAD_UPDATE_NOT_REQUIRED;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
-}
+	// The reader starts over with the next report
+	controller.biasEstimationRestart = true;
+	controller.biasEstimationState = SCE_PAD_BIAS_ESTIMATION_RUNNING;
 
-int scePadRead(int handle, s_ScePadData* data, int count) {
-	// No idea what's the purpose of this, in the original library it does literally the same thing as scePadReadState but the program crashes when count is bigger than 20
+	return SCE_OK;
+}
 
+int scePadGetGyroBiasEstimationState(int handle, int* state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
-	if ((count - 1) > 63) return SCE_PAD_ERROR_INVALID_ARG;
+	if (!state) return SCE_PAD_ERROR_INVALID_ARG;
+
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
+
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-	s_ScePadData thisData = {};
-	int res = scePadReadState(handle, &thisData);
-	std::memcpy(data, &thisData, sizeof(thisData));
-	return res;
+	*state = controller.biasEstimationState;
+
+	return SCE_OK;
 }
 
 int scePadResetOrientation(int handle) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.orientation = { 0.0f,0.0f,0.0f,1.0f };
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
+	g_flightRecorder.apiCall(captureApiCall::ResetOrientation, handle, nullptr, 0);
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	controller.orientationReset = true;
+
+	return SCE_OK;
 }
 
 int scePadSetAngularVelocityDeadbandState(int handle, bool state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.velocityDeadband = state;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
+	g_flightRecorder.apiCall(captureApiCall::SetAngularVelocityDeadbandState, handle, &state, sizeof(state));
+
+	controller.velocityDeadband = state;
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
 int scePadSetAudioOutPath(int handle, int path) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+
 	if (path > 4) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			controller.dualsenseCurOutputState.OutputPathSelect = path;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			controller.dualshock4CurAudio.Output = (dualshock4Data::AudioOutput)path;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	g_flightRecorder.apiCall(captureApiCall::SetAudioOutPath, handle, &path, sizeof(path));
+
+	if (controller.deviceType == DUALSENSE) {
+		controller.dualsenseCurOutputState.OutputPathSelect = path;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		controller.dualshock4CurAudio.Output = (dualshock4Data::AudioOutput)path;
 	}
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
 int scePadSetMotionSensorState(int handle, bool state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) { return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED; }
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.motionSensorState = state;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) { return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED; }
 
-		return SCE_OK;
-	}
+	g_flightRecorder.apiCall(captureApiCall::SetMotionSensorState, handle, &state, sizeof(state));
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	controller.motionSensorState = state;
+
+	return SCE_OK;
 }
 
 int scePadSetTiltCorrectionState(int handle, bool state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.tiltCorrection = state;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
+	g_flightRecorder.apiCall(captureApiCall::SetTiltCorrectionState, handle, &state, sizeof(state));
+
+	controller.tiltCorrection = state;
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
 int scePadSetVibration(int handle, s_ScePadVibrationParam* vibration) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			controller.dualsenseCurOutputState.RumbleEmulationLeft = vibration->largeMotor;
-			controller.dualsenseCurOutputState.RumbleEmulationRight = vibration->smallMotor;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			controller.dualshock4CurOutputState.RumbleLeft = vibration->largeMotor;
-			controller.dualshock4CurOutputState.RumbleRight = vibration->smallMotor;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	g_flightRecorder.apiCall(captureApiCall::SetVibration, handle, vibration, sizeof(s_ScePadVibrationParam));
+
+	if (controller.deviceType == DUALSENSE) {
+		controller.dualsenseCurOutputState.RumbleEmulationLeft = vibration->largeMotor;
+		controller.dualsenseCurOutputState.RumbleEmulationRight = vibration->smallMotor;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		controller.dualshock4CurOutputState.RumbleLeft = vibration->largeMotor;
+		controller.dualshock4CurOutputState.RumbleRight = vibration->smallMotor;
 	}
 
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	return SCE_OK;
 }
 
 int scePadSetVibrationMode(int handle, int mode) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+
 	if (mode <= 0) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			if (mode == SCE_PAD_HAPTICS_MODE) {
-				controller.dualsenseCurOutputState.UseRumbleNotHaptics = false;
-				controller.dualsenseCurOutputState.EnableRumbleEmulation = false;
-				controller.dualsenseCurOutputState.EnableImprovedRumbleEmulation = false;
-			}
-			else if (mode == SCE_PAD_RUMBLE_MODE) {
-				controller.dualsenseCurOutputState.UseRumbleNotHaptics = true;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-				if (controller.versionReport.FirmwareVersion >= 0x220) {
-					controller.dualsenseCurOutputState.EnableImprovedRumbleEmulation = true;
-				}
-				else {
-					controller.dualsenseCurOutputState.EnableRumbleEmulation = true;
-				}
-			}
+	g_flightRecorder.apiCall(captureApiCall::SetVibrationMode, handle, &mode, sizeof(mode));
+
+	if (controller.deviceType == DUALSENSE) {
+		if (mode == SCE_PAD_HAPTICS_MODE) {
+			controller.dualsenseCurOutputState.UseRumbleNotHaptics = false;
+			controller.dualsenseCurOutputState.EnableRumbleEmulation = false;
+			controller.dualsenseCurOutputState.EnableImprovedRumbleEmulation = false;
 		}
+		else if (mode == SCE_PAD_RUMBLE_MODE) {
+			controller.dualsenseCurOutputState.UseRumbleNotHaptics = true;
 
-		return SCE_OK;
+			if (controller.versionReport.FirmwareVersion >= 0x220) {
+				controller.dualsenseCurOutputState.EnableImprovedRumbleEmulation = true;
+			}
+			else {
+				controller.dualsenseCurOutputState.EnableRumbleEmulation = true;
+			}
+		}
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_OK;
 }
 
 int scePadSetVolumeGain(int handle, s_ScePadVolumeGain* gainSettings) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
+
 	if (!gainSettings || ((gainSettings->speakerVolume + 128) <= 126 || (gainSettings->micGain + 128) <= 126 || (gainSettings->headsetVolume + 128) <= 126)) return SCE_PAD_ERROR_INVALID_ARG;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if (controller.deviceType == DUALSENSE) {
-			controller.dualsenseCurOutputState.VolumeSpeaker = gainSettings->speakerVolume + 64;
-			controller.dualsenseCurOutputState.VolumeMic = gainSettings->micGain;
-			controller.dualsenseCurOutputState.VolumeHeadphones = gainSettings->headsetVolume + 64;
-		}
-		else if (controller.deviceType == DUALSHOCK4) {
-			controller.dualshock4CurOutputState.VolumeSpeaker = 40 + (int)((gainSettings->speakerVolume / 126.0) * 79);
-			controller.dualshock4CurOutputState.VolumeMic = 40 + (int)((gainSettings->micGain / 100.0) * 79);
-			controller.dualshock4CurOutputState.VolumeLeft = 40 + (int)((gainSettings->headsetVolume / 100.0) * 79);
-			controller.dualshock4CurOutputState.VolumeRight = 40 + (int)((gainSettings->headsetVolume / 100.0) * 79);
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	g_flightRecorder.apiCall(captureApiCall::SetVolumeGain, handle, gainSettings, sizeof(s_ScePadVolumeGain));
+
+	if (controller.deviceType == DUALSENSE) {
+		controller.dualsenseCurOutputState.VolumeSpeaker = gainSettings->speakerVolume + 64;
+		controller.dualsenseCurOutputState.VolumeMic = gainSettings->micGain;
+		controller.dualsenseCurOutputState.VolumeHeadphones = gainSettings->headsetVolume + 64;
+	}
+	else if (controller.deviceType == DUALSHOCK4) {
+		controller.dualshock4CurOutputState.VolumeSpeaker = 40 + (int)((gainSettings->speakerVolume / 126.0) * 79);
+		controller.dualshock4CurOutputState.VolumeMic = 40 + (int)((gainSettings->micGain / 100.0) * 79);
+		controller.dualshock4CurOutputState.VolumeLeft = 40 + (int)((gainSettings->headsetVolume / 100.0) * 79);
+		controller.dualshock4CurOutputState.VolumeRight = 40 + (int)((gainSettings->headsetVolume / 100.0) * 79);
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_OK;
 }
 
 int scePadIsSupportedAudioFunction(int handle) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		// The original function doesn't include DualShock 4 v1 for some reason.
-		if (controller.productID == DUALSHOCK4_DEVICE_ID || controller.productID == DUALSHOCK4V2_DEVICE_ID || controller.productID == DUALSHOCK4_WIRELESS_ADAPTOR_ID || controller.productID == DUALSENSE_DEVICE_ID || controller.productID == DUALSENSE_EDGE_DEVICE_ID) {
-			return 1;
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	// The original function doesn't include DualShock 4 v1 for some reason.
+	if (controller.productID == DUALSHOCK4_DEVICE_ID || controller.productID == DUALSHOCK4V2_DEVICE_ID || controller.productID == DUALSHOCK4_WIRELESS_ADAPTOR_ID || controller.productID == DUALSENSE_DEVICE_ID || controller.productID == DUALSENSE_EDGE_DEVICE_ID) {
+		return 1;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_OK;
 }
 
 int scePadClose(int handle) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.opened = false;
-		controller.valid = false;
-		controller.sceHandle = 0;
-		controller.lastPath = "";
-		controller.productID = 0;
-		controller.wasDisconnected = true;
-		controller.macAddress = "";
-		duaLibUtils::letGo(controller.handle, controller.deviceType, controller.connectionType);
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	controller.opened = false;
+	controller.valid = false;
+	controller.sceHandle = 0;
+	controller.lastPath = "";
+	controller.productID = 0;
+	controller.wasDisconnected = true;
+	controller.macAddress = "";
+
+	std::shared_lock handleGuard(controller.handleLock);
+	duaLibUtils::letGo(controller.handle, controller.deviceType, controller.connectionType);
+
+	return SCE_OK;
 }
 
 int scePadSetPlayerLedBrightness(int handle, int brightness) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.dualsenseCurOutputState.lightBrightness = (dualsenseData::LightBrightness)brightness;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	g_flightRecorder.apiCall(captureApiCall::SetPlayerLedBrightness, handle, &brightness, sizeof(brightness));
+
+	controller.dualsenseCurOutputState.lightBrightness = (dualsenseData::LightBrightness)brightness;
+
+	return SCE_OK;
 }
 
 int scePadSetPlayerLed(int handle, bool state) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		controller.playerLed = state;
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
-	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+	g_flightRecorder.apiCall(captureApiCall::SetPlayerLed, handle, &state, sizeof(state));
+
+	controller.playerLed = state;
+
+	return SCE_OK;
 }
 
 std::string scePadGetMacAddress(int handle) {
 	if (!g_initialized) return "";
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return "";
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return "";
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		return controller.macAddress;
-	}
-	return "";
+	if (controller.sceHandle != handle) return "";
+	if (!controller.valid) return "";
+
+	return controller.macAddress;
 }
 
 std::string scePadGetPath(int handle) {
 	if (!g_initialized) return "";
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return "";
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return "";
+	duaLibUtils::controller& controller = *slot;
+	std::shared_lock guard(controller.lock);
 
-		return controller.lastPath;
-	}
-	return "";
+	if (controller.sceHandle != handle) return "";
+	if (!controller.valid) return "";
+
+	return controller.lastPath;
 }
 
 int scePadSetTriggerEffectCustom(int handle, uint8_t left[11], uint8_t right[11], uint8_t triggerBitmask) {
 	if (!g_initialized) return SCE_PAD_ERROR_NOT_INITIALIZED;
 
-	for (auto& controller : g_controllers) {
-		std::shared_lock guard(controller.lock);
+	duaLibUtils::controller* slot = findController(handle);
+	if (!slot) return SCE_PAD_ERROR_INVALID_HANDLE;
 
-		if (controller.sceHandle != handle) continue;
-		if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
+	duaLibUtils::controller& controller = *slot;
+	std::unique_lock guard(controller.lock);
 
-		if(left != nullptr && triggerBitmask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2) {
-			controller.triggerMask |= SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2;
-			std::memcpy(controller.L2.force, left, sizeof(controller.L2.force));
-		}
-		if(right != nullptr && triggerBitmask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2) {
-			controller.triggerMask |= SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2;
-			std::memcpy(controller.R2.force, right, sizeof(controller.R2.force));
-		}
+	if (controller.sceHandle != handle) return SCE_PAD_ERROR_INVALID_HANDLE;
+	if (!controller.valid) return SCE_PAD_ERROR_DEVICE_NOT_CONNECTED;
 
-		return SCE_OK;
+	uint8_t recorded[23] = {};
+	if (left) std::memcpy(recorded, left, 11);
+	if (right) std::memcpy(recorded + 11, right, 11);
+	recorded[22] = triggerBitmask;
+	g_flightRecorder.apiCall(captureApiCall::SetTriggerEffectCustom, handle, recorded, sizeof(recorded));
+
+	if(left != nullptr && triggerBitmask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2) {
+		controller.triggerMask |= SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_L2;
+		std::memcpy(controller.L2.force, left, sizeof(controller.L2.force));
+		controller.triggerEffectCached = false;
+	}
+	if(right != nullptr && triggerBitmask & SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2) {
+		controller.triggerMask |= SCE_PAD_TRIGGER_EFFECT_TRIGGER_MASK_R2;
+		std::memcpy(controller.R2.force, right, sizeof(controller.R2.force));
+		controller.triggerEffectCached = false;
 	}
-	return SCE_PAD_ERROR_INVALID_HANDLE;
+
+	return SCE_OK;
 }
 
 #if COMPILE_TO_EXE
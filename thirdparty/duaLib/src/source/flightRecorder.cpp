@@ -0,0 +1,326 @@
+﻿#include "flightRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+struct flightRecorder::knownDevice {
+	transportDeviceInfo info = {};
+	std::map<uint8_t, std::vector<uint8_t>> features = {}; // Newest answer per report ID
+	std::unique_ptr<ring> storage;
+	std::atomic<ring*> history = nullptr;
+};
+
+struct flightRecorder::device {
+	transportDevice* inner = nullptr;
+	uint16_t index = 0;
+	knownDevice* known = nullptr; // Owned by m_known, which never shrinks
+};
+
+// One record as copied out of the ring
+struct flightRecord {
+	uint64_t timeNs = 0;
+	uint32_t size = 0;
+	uint16_t device = 0;
+	uint8_t type = 0;
+	const uint8_t* payload = nullptr;
+};
+
+static uint64_t steadyNanoseconds() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static flightRecorder::device* recorderDevice(transportDevice* handle) {
+	return reinterpret_cast<flightRecorder::device*>(handle);
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+flightRecorder::flightRecorder() = default;
+flightRecorder::~flightRecorder() = default;
+
+flightRecorder::ring::ring(int slotBits) : slots(std::make_unique<slot[]>((size_t)1 << slotBits)), mask(((size_t)1 << slotBits) - 1) {}
+
+#pragma region Ring
+void flightRecorder::setTransport(deviceTransport* transport) {
+	m_inner.store(transport, std::memory_order_release);
+}
+
+deviceTransport& flightRecorder::inner() const {
+	deviceTransport* transport = m_inner.load(std::memory_order_acquire);
+	return transport ? *transport : hidTransport();
+}
+
+void flightRecorder::setEnabled(bool enabled) {
+	m_enabled.store(enabled, std::memory_order_relaxed);
+	if (enabled) reserve();
+}
+
+bool flightRecorder::enabled() const {
+	return m_enabled.load(std::memory_order_relaxed);
+}
+
+void flightRecorder::reserve() {
+	if (!enabled()) return;
+
+	std::lock_guard guard(m_lock);
+	allocateRings();
+}
+
+void flightRecorder::allocateRings() {
+	if (!m_apiCallStorage) {
+		m_apiCallStorage = std::make_unique<ring>(FLIGHT_RECORDER_API_SLOT_BITS);
+		m_startedNs.store(steadyNanoseconds(), std::memory_order_relaxed);
+		m_apiCalls.store(m_apiCallStorage.get(), std::memory_order_release);
+	}
+
+	// Devices that got opened while recording was off
+	for (const auto& known : m_known) {
+		if (known->storage) continue;
+		known->storage = std::make_unique<ring>(FLIGHT_RECORDER_DEVICE_SLOT_BITS);
+		known->history.store(known->storage.get(), std::memory_order_release);
+	}
+}
+
+void flightRecorder::record(ring* target, captureRecordType type, uint16_t device, const void* data, size_t size) {
+	if (!target || !m_enabled.load(std::memory_order_relaxed)) return;
+
+	// Anything bigger than a slot gets cut off, input and output reports all fit
+	size = std::min(size, payloadCapacity);
+
+	uint64_t buffer[FLIGHT_RECORDER_SLOT_WORDS - 1] = {};
+	buffer[0] = steadyNanoseconds();
+	buffer[1] = (uint64_t)size | ((uint64_t)device << 32) | ((uint64_t)type << 48);
+	if (size > 0) std::memcpy(&buffer[2], data, size);
+
+	// Two writers only ever share a slot if the whole ring wraps around while one of them is copying
+	uint64_t ticket = target->head.fetch_add(1, std::memory_order_relaxed);
+	slot& entry = target->slots[ticket & target->mask];
+
+	entry.sequence.store(ticket * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	size_t words = 2 + (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	for (size_t i = 0; i < words; i++)
+		entry.words[i].store(buffer[i], std::memory_order_relaxed);
+
+	entry.sequence.store(ticket * 2 + 2, std::memory_order_release);
+}
+
+void flightRecorder::apiCall(captureApiCall function, int handle, const void* arguments, size_t size) {
+	ring* target = m_apiCalls.load(std::memory_order_acquire);
+	if (!target || !m_enabled.load(std::memory_order_relaxed)) return;
+	if (!arguments) size = 0;
+
+	uint8_t payload[sizeof(captureApiCallRecord) + payloadCapacity] = {};
+	size = std::min(size, payloadCapacity - sizeof(captureApiCallRecord));
+
+	captureApiCallRecord call = {};
+	call.handle = handle;
+	call.function = (uint8_t)function;
+	std::memcpy(payload, &call, sizeof(call));
+	if (size > 0) std::memcpy(payload + sizeof(call), arguments, size);
+
+	uint64_t hash = fnv1a(0xcbf29ce484222325ull, payload, sizeof(call) + size);
+	size_t index = ((size_t)function * 31 + (uint32_t)handle) & (FLIGHT_RECORDER_API_CALL_SLOTS - 1);
+	if (m_lastApiCalls[index].exchange(hash, std::memory_order_relaxed) == hash) return;
+
+	record(target, captureRecordType::ApiCall, CAPTURE_NO_DEVICE, payload, sizeof(call) + size);
+}
+
+bool flightRecorder::dump(const std::string& path, uint64_t* coveredUs) const {
+	uint64_t now = steadyNanoseconds();
+	std::vector<uint64_t> copied;
+	std::vector<flightRecord> records;
+
+	std::vector<const ring*> rings;
+	{
+		std::lock_guard guard(m_lock);
+		if (m_apiCallStorage) rings.push_back(m_apiCallStorage.get());
+		for (const auto& known : m_known) {
+			if (known->storage) rings.push_back(known->storage.get());
+		}
+	}
+
+	// Copied first and turned into records after, the copy doesn't move anymore by then
+	struct span { size_t offset; size_t count; bool wrapped; };
+	std::vector<span> spans;
+	const size_t recordWords = FLIGHT_RECORDER_SLOT_WORDS - 1;
+
+	for (const ring* source : rings) {
+		uint64_t head = source->head.load(std::memory_order_acquire);
+		uint64_t first = head > source->mask + 1 ? head - (source->mask + 1) : 0;
+		spans.push_back({ copied.size() / recordWords, 0, first > 0 });
+
+		// Slots that are still being written or got overwritten while copying are left out
+		for (uint64_t ticket = first; ticket < head; ticket++) {
+			const slot& entry = source->slots[ticket & source->mask];
+			if (entry.sequence.load(std::memory_order_acquire) != ticket * 2 + 2) continue;
+
+			size_t offset = copied.size();
+			copied.resize(offset + recordWords);
+			for (size_t i = 0; i < recordWords; i++)
+				copied[offset + i] = entry.words[i].load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (entry.sequence.load(std::memory_order_relaxed) != ticket * 2 + 2) {
+				copied.resize(offset);
+				continue;
+			}
+			spans.back().count++;
+		}
+	}
+
+	// Everything is there back to whichever wrapped ring lost its oldest records last
+	uint64_t completeFrom = m_startedNs.load(std::memory_order_relaxed);
+	for (const span& entries : spans) {
+		for (size_t i = 0; i < entries.count; i++) {
+			const uint64_t* words = &copied[(entries.offset + i) * recordWords];
+
+			flightRecord entry = {};
+			entry.timeNs = words[0];
+			entry.size = (uint32_t)std::min<uint64_t>(words[1] & 0xFFFFFFFF, payloadCapacity);
+			entry.device = (uint16_t)(words[1] >> 32);
+			entry.type = (uint8_t)(words[1] >> 48);
+			entry.payload = reinterpret_cast<const uint8_t*>(&words[2]);
+			records.push_back(entry);
+		}
+
+		if (entries.wrapped && entries.count > 0)
+			completeFrom = std::max(completeFrom, copied[entries.offset * recordWords]);
+	}
+
+	if (coveredUs) *coveredUs = completeFrom > 0 && now > completeFrom ? (now - completeFrom) / 1000 : 0;
+
+	std::stable_sort(records.begin(), records.end(), [](const flightRecord& a, const flightRecord& b) { return a.timeNs < b.timeNs; });
+	uint64_t base = records.empty() ? 0 : records.front().timeNs;
+
+	std::vector<uint8_t> file(sizeof(captureFileHeader));
+	captureFileHeader header = makeCaptureFileHeader();
+	std::memcpy(file.data(), &header, sizeof(header));
+
+	// Every device shows up as opened at the start with the feature reports it answered back then
+	{
+		std::lock_guard guard(m_lock);
+		for (size_t i = 0; i < m_known.size(); i++) {
+			std::vector<uint8_t> payload = captureDevicePayload(m_known[i]->info);
+			appendCaptureRecord(file, captureRecordType::Device, (uint16_t)i, 0, payload.data(), payload.size());
+
+			for (const auto& feature : m_known[i]->features)
+				appendCaptureRecord(file, captureRecordType::FeatureGet, (uint16_t)i, 0, feature.second.data(), feature.second.size());
+
+			appendCaptureRecord(file, captureRecordType::Open, (uint16_t)i, 0, nullptr, 0);
+		}
+	}
+
+	for (const flightRecord& entry : records)
+		appendCaptureRecord(file, (captureRecordType)entry.type, entry.device, entry.timeNs - base, entry.payload, entry.size);
+
+	std::FILE* out = std::fopen(path.c_str(), "wb");
+	if (!out) return false;
+
+	bool written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+	return std::fclose(out) == 0 && written;
+}
+#pragma endregion
+
+#pragma region Transport
+int flightRecorder::init() {
+	return inner().init();
+}
+
+std::vector<transportDeviceInfo> flightRecorder::enumerate(uint16_t vendorID, uint16_t productID) {
+	std::vector<transportDeviceInfo> devices = inner().enumerate(vendorID, productID);
+
+	std::lock_guard guard(m_lock);
+	for (const transportDeviceInfo& info : devices)
+		m_enumerated[info.path] = info;
+
+	return devices;
+}
+
+transportDevice* flightRecorder::open(const std::string& path) {
+	transportDevice* handle = inner().open(path);
+	if (!handle) return nullptr;
+
+	auto dev = std::make_unique<device>();
+	dev->inner = handle;
+
+	{
+		std::lock_guard guard(m_lock);
+		auto known = std::find_if(m_known.begin(), m_known.end(), [&](const auto& entry) { return entry->info.path == path; });
+
+		if (known != m_known.end()) {
+			dev->index = (uint16_t)(known - m_known.begin());
+		}
+		else {
+			auto entry = std::make_unique<knownDevice>();
+			entry->info.path = path;
+			auto enumerated = m_enumerated.find(path);
+			if (enumerated != m_enumerated.end()) entry->info = enumerated->second;
+
+			dev->index = (uint16_t)m_known.size();
+			m_known.push_back(std::move(entry));
+		}
+
+		dev->known = m_known[dev->index].get();
+		if (enabled()) allocateRings();
+	}
+
+	record(dev->known->history.load(std::memory_order_acquire), captureRecordType::Open, dev->index, nullptr, 0);
+	return reinterpret_cast<transportDevice*>(dev.release());
+}
+
+void flightRecorder::close(transportDevice* handle) {
+	device* dev = recorderDevice(handle);
+	if (!dev) return;
+
+	inner().close(dev->inner);
+	record(dev->known->history.load(std::memory_order_acquire), captureRecordType::Close, dev->index, nullptr, 0);
+	delete dev;
+}
+
+int flightRecorder::read(transportDevice* handle, unsigned char* data, size_t length, int timeoutMs) {
+	device* dev = recorderDevice(handle);
+	int res = inner().read(dev->inner, data, length, timeoutMs);
+
+	if (res > 0)
+		record(dev->known->history.load(std::memory_order_acquire), captureRecordType::Input, dev->index, data, (size_t)res);
+	else if (res < 0)
+		record(dev->known->history.load(std::memory_order_acquire), captureRecordType::ReadError, dev->index, &res, sizeof(res));
+
+	return res;
+}
+
+int flightRecorder::write(transportDevice* handle, const unsigned char* data, size_t length) {
+	device* dev = recorderDevice(handle);
+	record(dev->known->history.load(std::memory_order_acquire), captureRecordType::Output, dev->index, data, length);
+	return inner().write(dev->inner, data, length);
+}
+
+int flightRecorder::getFeatureReport(transportDevice* handle, unsigned char* data, size_t length) {
+	device* dev = recorderDevice(handle);
+	int res = inner().getFeatureReport(dev->inner, data, length);
+
+	if (res > 0) {
+		std::lock_guard guard(m_lock);
+		dev->known->features[data[0]].assign(data, data + res);
+	}
+
+	return res;
+}
+
+int flightRecorder::sendFeatureReport(transportDevice* handle, const unsigned char* data, size_t length) {
+	device* dev = recorderDevice(handle);
+	record(dev->known->history.load(std::memory_order_acquire), captureRecordType::FeatureSend, dev->index, data, length);
+	return inner().sendFeatureReport(dev->inner, data, length);
+}
+#pragma endregion
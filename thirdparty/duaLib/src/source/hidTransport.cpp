@@ -0,0 +1,70 @@
+﻿#include "transport.h"
+#include <hidapi.h>
+
+static std::string narrowString(const wchar_t* text) {
+	std::string narrow;
+	if (!text) return narrow;
+
+	for (; *text; text++)
+		narrow += (*text < 0x80) ? (char)*text : '?';
+
+	return narrow;
+}
+
+static hid_device* hidDevice(transportDevice* device) {
+	return reinterpret_cast<hid_device*>(device);
+}
+
+class hidapiTransport : public deviceTransport {
+public:
+	int init() override {
+		return hid_init();
+	}
+
+	std::vector<transportDeviceInfo> enumerate(uint16_t vendorID, uint16_t productID) override {
+		std::vector<transportDeviceInfo> devices;
+		hid_device_info* head = hid_enumerate(vendorID, productID);
+
+		for (hid_device_info* info = head; info; info = info->next) {
+			transportDeviceInfo device = {};
+			device.path = info->path;
+			device.serial = narrowString(info->serial_number);
+			device.vendorID = info->vendor_id;
+			device.productID = info->product_id;
+			device.busType = info->bus_type;
+			devices.push_back(device);
+		}
+
+		hid_free_enumeration(head);
+		return devices;
+	}
+
+	transportDevice* open(const std::string& path) override {
+		return reinterpret_cast<transportDevice*>(hid_open_path(path.c_str()));
+	}
+
+	void close(transportDevice* device) override {
+		hid_close(hidDevice(device));
+	}
+
+	int read(transportDevice* device, unsigned char* data, size_t length, int timeoutMs) override {
+		return hid_read_timeout(hidDevice(device), data, length, timeoutMs);
+	}
+
+	int write(transportDevice* device, const unsigned char* data, size_t length) override {
+		return hid_write(hidDevice(device), data, length);
+	}
+
+	int getFeatureReport(transportDevice* device, unsigned char* data, size_t length) override {
+		return hid_get_feature_report(hidDevice(device), data, length);
+	}
+
+	int sendFeatureReport(transportDevice* device, const unsigned char* data, size_t length) override {
+		return hid_send_feature_report(hidDevice(device), data, length);
+	}
+};
+
+deviceTransport& hidTransport() {
+	static hidapiTransport transport;
+	return transport;
+}
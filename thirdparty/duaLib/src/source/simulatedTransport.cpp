@@ -0,0 +1,463 @@
+﻿#include "simulatedTransport.h"
+#include <hidapi.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include "crc.h"
+
+#define SIMULATED_VENDOR_ID 0x54c
+#define SIMULATED_DUALSENSE_ID 0x0ce6
+#define SIMULATED_DUALSENSE_EDGE_ID 0x0df2
+#define SIMULATED_WIRELESS_ADAPTOR_ID 0xba0
+#define SIMULATED_PATH_PREFIX "simulated:"
+#define SIMULATED_MAX_QUEUED_REPORTS 32 // hidapi doesn't queue more than this either
+#define SIMULATED_MAX_CAPTURED_REPORTS 65536
+#define SIMULATED_MAX_READ_DELAYS 65536
+#define SIMULATED_USB_REPORT_SIZE 64
+#define SIMULATED_BT_REPORT_SIZE 78
+
+struct simulatedTransport::device {
+	simulatedDeviceConfig config = {};
+	int index = 0;
+	bool dualsense = false;
+	std::mutex lock{};
+	std::condition_variable changed{};
+	bool connected = true;
+	int openCount = 0;
+	dualsenseData::USBGetStateData dualsenseState = {};
+	dualshock4Data::USBGetStateData dualshock4State = {};
+	std::chrono::steady_clock::time_point start = {};      // Device clock starts here
+	std::chrono::steady_clock::time_point nextReport = {}; // When the next input report is due
+	std::minstd_rand random{};
+	uint64_t reportsSent = 0;
+	uint64_t outputDropped = 0;
+	std::deque<capturedReport> output = {};
+	std::vector<uint32_t> readDelays = {}; // Microseconds every report waited after it was due, newest ones get dropped when full
+};
+
+// Centered sticks, nothing pressed or touched, lying flat on a table
+template <typename T>
+static void neutralState(T& state) {
+	state.LeftStickX = state.LeftStickY = state.RightStickX = state.RightStickY = 128;
+	state.DPad = Direction::None;
+	state.AccelerometerY = 8192;
+}
+
+static bool isBluetooth(const simulatedTransport::device& dev) {
+	return dev.config.busType == HID_API_BUS_BLUETOOTH;
+}
+
+static std::chrono::microseconds reportInterval(const simulatedTransport::device& dev) {
+	return std::chrono::microseconds(std::max<uint32_t>(1000000 / std::max<uint32_t>(dev.config.reportRateHz, 1), 1));
+}
+
+// Bluetooth reports end with a CRC32 over the HID header byte and everything before the CRC
+static void writeCrc(unsigned char prefix, unsigned char* report, size_t size) {
+	uint32_t crc = computeWithPrefix(prefix, report, size - 4);
+	std::memcpy(report + size - 4, &crc, sizeof(crc));
+}
+
+static int copyReport(const void* report, size_t size, unsigned char* data, size_t length) {
+	size_t copied = std::min(size, length);
+	std::memcpy(data, report, copied);
+	return (int)copied;
+}
+
+// Frames the current state like the device would, the counters and timestamps come from the device clock
+static int buildInputReport(simulatedTransport::device& dev, unsigned char* data, size_t length) {
+	uint64_t deviceUs = std::chrono::duration_cast<std::chrono::microseconds>(dev.nextReport - dev.start).count();
+	unsigned char report[SIMULATED_BT_REPORT_SIZE] = {};
+
+	if (dev.dualsense) {
+		dualsenseData::USBGetStateData state = dev.dualsenseState;
+		state.SensorTimestamp = (uint32_t)(deviceUs * 3); // 0.33us units
+		state.DeviceTimeStamp = (uint32_t)deviceUs;
+
+		if (isBluetooth(dev)) {
+			state.SeqNo = 0x01;
+
+			dualsenseData::ReportIn31 bt = {};
+			bt.Data.ReportID = 0x31;
+			bt.Data.HasHID = 1;
+			bt.Data.SeqNo = dev.reportsSent & 0x0F;
+			bt.Data.State.StateData = state;
+			std::memcpy(report, &bt, sizeof(bt));
+			writeCrc(0xA1, report, sizeof(bt));
+			return copyReport(report, sizeof(bt), data, length);
+		}
+
+		state.SeqNo = (uint8_t)dev.reportsSent;
+
+		dualsenseData::ReportIn01USB usb = {};
+		usb.ReportID = 0x01;
+		usb.State = state;
+		std::memcpy(report, &usb, sizeof(usb));
+		return copyReport(report, SIMULATED_USB_REPORT_SIZE, data, length);
+	}
+
+	dualshock4Data::USBGetStateData state = dev.dualshock4State;
+	state.Timestamp = (uint16_t)(deviceUs * 3 / 16); // 5.33us units
+
+	if (isBluetooth(dev)) {
+		state.Counter = dev.reportsSent & 0x3F;
+
+		report[0] = 0x11;
+		report[1] = 0xC0; // HID data present
+		std::memcpy(report + 3, &state, sizeof(state));
+		writeCrc(0xA1, report, SIMULATED_BT_REPORT_SIZE);
+		return copyReport(report, SIMULATED_BT_REPORT_SIZE, data, length);
+	}
+
+	report[0] = 0x01;
+	std::memcpy(report + 1, &state, sizeof(state));
+	return copyReport(report, SIMULATED_USB_REPORT_SIZE, data, length);
+}
+
+// The neutral calibration, nominal counts come out of it unchanged
+template <typename T>
+static void fillCalibration(T& report) {
+	report.GyroSpeedPlus = 1000;
+	report.GyroSpeedMinus = 1000;
+	report.AccelXPlus = report.AccelYPlus = report.AccelZPlus = 8192;
+	report.AccelXMinus = report.AccelYMinus = report.AccelZMinus = -8192;
+}
+
+static int dualsenseFeatureReport(simulatedTransport::device& dev, unsigned char* data, size_t length) {
+	unsigned char report[64] = {};
+	size_t size = 0;
+
+	switch (data[0]) {
+		case 0x05: {
+			dualsenseData::ReportFeatureInCalibration calibration = {};
+			calibration.ReportID = 0x05;
+			fillCalibration(calibration);
+			calibration.GyroPitchPlus = calibration.GyroYawPlus = calibration.GyroRollPlus = 16384;
+			calibration.GyroPitchMinus = calibration.GyroYawMinus = calibration.GyroRollMinus = -16384;
+			size = sizeof(calibration);
+			std::memcpy(report, &calibration, size);
+			break;
+		}
+		case 0x09: {
+			dualsenseData::ReportFeatureInMacAll mac = {};
+			mac.ReportID = 0x09;
+			std::memcpy(mac.ClientMac, dev.config.macAddress, sizeof(mac.ClientMac));
+			mac.Hard08 = 0x08;
+			mac.Hard25 = 0x25;
+			size = sizeof(mac);
+			std::memcpy(report, &mac, size);
+			break;
+		}
+		case 0x20: {
+			dualsenseData::ReportFeatureInVersion version = {};
+			version.ReportID = 0x20;
+			std::memcpy(version.BuildDate, "Jan 01 2024", sizeof(version.BuildDate));
+			std::memcpy(version.BuildTime, "00:00:00", sizeof(version.BuildTime));
+			version.FirmwareVersion = 0x01000000;
+			size = sizeof(version);
+			std::memcpy(report, &version, size);
+			break;
+		}
+		default:
+			return -1;
+	}
+
+	if (isBluetooth(dev))
+		writeCrc(0xA3, report, size);
+
+	return copyReport(report, size, data, length);
+}
+
+static int dualshock4FeatureReport(simulatedTransport::device& dev, unsigned char* data, size_t length) {
+	bool bluetooth = isBluetooth(dev);
+	unsigned char report[64] = {};
+	size_t size = 0;
+
+	if (data[0] == (bluetooth ? 0x05 : 0x02)) {
+		dualshock4Data::ReportFeatureInCalibrationBT calibration = {};
+		calibration.Data.ReportID = data[0];
+		fillCalibration(calibration.Data);
+
+		// Bluetooth and the wireless adaptor list all plus values first
+		bool plusFirst = bluetooth || dev.config.productID == SIMULATED_WIRELESS_ADAPTOR_ID;
+		for (int i = 0; i < 6; i++)
+			calibration.Data.GyroRange[i] = (plusFirst ? i < 3 : i % 2 == 0) ? 16384 : -16384;
+
+		size = bluetooth ? sizeof(calibration) : sizeof(calibration.Data);
+		std::memcpy(report, &calibration, size);
+	}
+	else if (data[0] == (bluetooth ? 0x09 : 0x12)) {
+		dualshock4Data::ReportFeatureInMacAllBT mac = {};
+		mac.Data.ReportID = data[0];
+		std::memcpy(mac.Data.ClientMac, dev.config.macAddress, sizeof(mac.Data.ClientMac));
+		mac.Data.Hard08 = 0x08;
+		mac.Data.Hard25 = 0x25;
+		size = bluetooth ? sizeof(mac) : sizeof(mac.Data);
+		std::memcpy(report, &mac, size);
+	}
+	else {
+		return -1;
+	}
+
+	if (bluetooth)
+		writeCrc(0xA3, report, size);
+
+	return copyReport(report, size, data, length);
+}
+
+static void capture(simulatedTransport::device& dev, bool feature, const unsigned char* data, size_t length) {
+	if (dev.output.size() >= SIMULATED_MAX_CAPTURED_REPORTS) {
+		dev.output.pop_front();
+		dev.outputDropped++;
+	}
+
+	capturedReport report = {};
+	report.writtenAt = std::chrono::steady_clock::now();
+	report.feature = feature;
+	report.data.assign(data, data + length);
+	dev.output.push_back(std::move(report));
+}
+
+static simulatedTransport::device* simulatedDevice(transportDevice* device) {
+	return reinterpret_cast<simulatedTransport::device*>(device);
+}
+
+simulatedTransport::simulatedTransport() = default;
+simulatedTransport::~simulatedTransport() = default;
+
+simulatedTransport::device* simulatedTransport::find(int index) const {
+	std::lock_guard guard(m_lock);
+	if (index < 0 || index >= (int)m_devices.size()) return nullptr;
+	return m_devices[index].get();
+}
+
+int simulatedTransport::addDevice(const simulatedDeviceConfig& config) {
+	std::lock_guard guard(m_lock);
+
+	auto dev = std::make_unique<device>();
+	dev->config = config;
+	dev->index = (int)m_devices.size();
+	dev->dualsense = config.productID == SIMULATED_DUALSENSE_ID || config.productID == SIMULATED_DUALSENSE_EDGE_ID;
+	dev->start = std::chrono::steady_clock::now();
+	dev->random.seed(dev->index + 1); // Same jitter on every run
+	neutralState(dev->dualsenseState);
+	neutralState(dev->dualshock4State);
+	dev->dualsenseState.touchData.Finger[0].NotTouching = 1;
+	dev->dualsenseState.touchData.Finger[1].NotTouching = 1;
+	dev->dualshock4State.Finger1Active = 1; // Set means not touching
+	dev->dualshock4State.Finger2Active = 1;
+
+	static const uint8_t zeroMac[6] = {};
+	if (std::memcmp(dev->config.macAddress, zeroMac, sizeof(zeroMac)) == 0) {
+		const uint8_t mac[6] = { (uint8_t)(dev->index + 1), (uint8_t)((dev->index + 1) >> 8), 0x00, 0x5A, 0x51, 0x02 };
+		std::memcpy(dev->config.macAddress, mac, sizeof(mac));
+	}
+
+	m_devices.push_back(std::move(dev));
+	return (int)m_devices.size() - 1;
+}
+
+void simulatedTransport::setConnected(int index, bool connected) {
+	device* dev = find(index);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->connected = connected;
+	dev->changed.notify_all();
+}
+
+void simulatedTransport::setReportRate(int index, uint32_t reportRateHz) {
+	device* dev = find(index);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->config.reportRateHz = reportRateHz;
+	dev->changed.notify_all();
+}
+
+void simulatedTransport::setInput(int index, const dualsenseData::USBGetStateData& state) {
+	device* dev = find(index);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->dualsenseState = state;
+}
+
+void simulatedTransport::setInput(int index, const dualshock4Data::USBGetStateData& state) {
+	device* dev = find(index);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->dualshock4State = state;
+}
+
+std::vector<capturedReport> simulatedTransport::takeOutputReports(int index) {
+	device* dev = find(index);
+	if (!dev) return {};
+
+	std::lock_guard guard(dev->lock);
+	std::vector<capturedReport> reports(std::make_move_iterator(dev->output.begin()), std::make_move_iterator(dev->output.end()));
+	dev->output.clear();
+	return reports;
+}
+
+std::vector<uint32_t> simulatedTransport::takeReadDelays(int index) {
+	device* dev = find(index);
+	if (!dev) return {};
+
+	std::lock_guard guard(dev->lock);
+	std::vector<uint32_t> delays;
+	delays.swap(dev->readDelays);
+	return delays;
+}
+
+uint64_t simulatedTransport::reportsSent(int index) const {
+	device* dev = find(index);
+	if (!dev) return 0;
+
+	std::lock_guard guard(dev->lock);
+	return dev->reportsSent;
+}
+
+int simulatedTransport::openHandles(int index) const {
+	device* dev = find(index);
+	if (!dev) return 0;
+
+	std::lock_guard guard(dev->lock);
+	return dev->openCount;
+}
+
+uint64_t simulatedTransport::outputReportsDropped(int index) const {
+	device* dev = find(index);
+	if (!dev) return 0;
+
+	std::lock_guard guard(dev->lock);
+	return dev->outputDropped;
+}
+
+int simulatedTransport::deviceCount() const {
+	std::lock_guard guard(m_lock);
+	return (int)m_devices.size();
+}
+
+int simulatedTransport::init() {
+	return 0;
+}
+
+std::vector<transportDeviceInfo> simulatedTransport::enumerate(uint16_t vendorID, uint16_t productID) {
+	std::vector<transportDeviceInfo> devices;
+	std::lock_guard guard(m_lock);
+
+	for (auto& dev : m_devices) {
+		std::lock_guard deviceGuard(dev->lock);
+		if (!dev->connected) continue;
+		if (vendorID != 0 && vendorID != SIMULATED_VENDOR_ID) continue;
+		if (productID != 0 && productID != dev->config.productID) continue;
+
+		transportDeviceInfo info = {};
+		info.path = SIMULATED_PATH_PREFIX + std::to_string(dev->index);
+		info.serial = "SIM" + std::to_string(dev->index);
+		info.vendorID = SIMULATED_VENDOR_ID;
+		info.productID = dev->config.productID;
+		info.busType = dev->config.busType;
+		devices.push_back(info);
+	}
+
+	return devices;
+}
+
+transportDevice* simulatedTransport::open(const std::string& path) {
+	if (path.rfind(SIMULATED_PATH_PREFIX, 0) != 0) return nullptr;
+
+	device* dev = find(std::atoi(path.c_str() + sizeof(SIMULATED_PATH_PREFIX) - 1));
+	if (!dev) return nullptr;
+
+	std::lock_guard guard(dev->lock);
+	if (!dev->connected) return nullptr;
+
+	dev->openCount++;
+	dev->nextReport = std::chrono::steady_clock::now();
+	return reinterpret_cast<transportDevice*>(dev);
+}
+
+void simulatedTransport::close(transportDevice* handle) {
+	device* dev = simulatedDevice(handle);
+	if (!dev) return;
+
+	std::lock_guard guard(dev->lock);
+	dev->openCount--;
+	dev->changed.notify_all();
+}
+
+int simulatedTransport::read(transportDevice* handle, unsigned char* data, size_t length, int timeoutMs) {
+	device* dev = simulatedDevice(handle);
+	if (!dev || !data) return -1;
+
+	std::unique_lock guard(dev->lock);
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = now + std::chrono::milliseconds(std::max(timeoutMs, 0));
+
+	// Wait for the next report like a blocking read would
+	while (dev->connected && dev->nextReport > now) {
+		if (timeoutMs >= 0 && now >= deadline) return 0;
+		dev->changed.wait_until(guard, timeoutMs >= 0 ? std::min(dev->nextReport, deadline) : dev->nextReport);
+		now = std::chrono::steady_clock::now();
+	}
+
+	if (!dev->connected) return -1;
+
+	// Reports nobody read in time fall out of the queue
+	auto interval = reportInterval(*dev);
+	if (now - dev->nextReport > interval * SIMULATED_MAX_QUEUED_REPORTS)
+		dev->nextReport = now - interval * SIMULATED_MAX_QUEUED_REPORTS;
+
+	int size = buildInputReport(*dev, data, length);
+
+	if (dev->readDelays.size() < SIMULATED_MAX_READ_DELAYS)
+		dev->readDelays.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(now - dev->nextReport).count());
+
+	int32_t jitter = 0;
+	if (dev->config.jitterUs > 0) {
+		std::uniform_int_distribution<int32_t> distribution(-(int32_t)dev->config.jitterUs, (int32_t)dev->config.jitterUs);
+		jitter = distribution(dev->random);
+	}
+
+	dev->nextReport += std::max(interval + std::chrono::microseconds(jitter), std::chrono::microseconds(1));
+	dev->reportsSent++;
+	return size;
+}
+
+int simulatedTransport::write(transportDevice* handle, const unsigned char* data, size_t length) {
+	device* dev = simulatedDevice(handle);
+	if (!dev || !data) return -1;
+
+	std::lock_guard guard(dev->lock);
+	if (!dev->connected) return -1;
+
+	capture(*dev, false, data, length);
+	return (int)length;
+}
+
+int simulatedTransport::getFeatureReport(transportDevice* handle, unsigned char* data, size_t length) {
+	device* dev = simulatedDevice(handle);
+	if (!dev || !data || length == 0) return -1;
+
+	std::lock_guard guard(dev->lock);
+	if (!dev->connected) return -1;
+
+	return dev->dualsense ? dualsenseFeatureReport(*dev, data, length) : dualshock4FeatureReport(*dev, data, length);
+}
+
+int simulatedTransport::sendFeatureReport(transportDevice* handle, const unsigned char* data, size_t length) {
+	device* dev = simulatedDevice(handle);
+	if (!dev || !data) return -1;
+
+	std::lock_guard guard(dev->lock);
+	if (!dev->connected) return -1;
+
+	capture(*dev, true, data, length);
+	return (int)length;
+}